@@ -0,0 +1,335 @@
+#include "BinaryTraceReader.h"
+
+#include <cstring>
+
+static const char BinaryTraceMagic[8] = { 'O', 'L', 'T', 'R', 'A', 'C', 'E', '\0' };
+static const uint32_t BinaryTraceVersion = 1;
+
+enum BinaryTraceRecord
+{
+    RecordString = 1,
+    RecordProcess = 2,
+    RecordSamples = 3,
+    RecordOverhead = 4,
+    RecordComposition = 7,
+    RecordRollup = 8,
+};
+
+// Only the columns Cutelooker plots, the others are skipped
+enum BinaryTraceColumn
+{
+    ColumnCpuUsage = 0,
+    ColumnWorkingSetSize = 3,
+    ColumnPagefileUsage = 8,
+    ColumnReadBytes = 11,
+    ColumnWriteBytes,
+    ColumnReadOperations,
+    ColumnWriteOperations,
+    ColumnCpuTime,
+    ColumnCycleTime,
+    ColumnCount,
+    ColumnCountWithoutIo = 11, // older traces
+};
+
+enum BinaryTraceCompositionColumn
+{
+    CompositionImage,
+    CompositionMapped,
+    CompositionShareable,
+    CompositionHeap,
+    CompositionStack,
+    CompositionPrivate,
+    CompositionColumnCount,
+};
+
+enum BinaryTraceRollupColumn
+{
+    RollupWorkingSetSize,
+    RollupPrivateUsage,
+    RollupCpuUsage,
+    RollupProcessCount,
+    RollupColumnCount,
+};
+
+enum BinaryTraceOverheadColumn
+{
+    OverheadSnapshotTime,
+    OverheadQueryCount,
+    OverheadQueryTime,
+    OverheadWriteTime,
+    OverheadCpuUsage,
+    OverheadWorkingSetSize,
+    OverheadMissedDeadlines,
+    OverheadTick,
+    OverheadInterval,
+    OverheadQueueTime,
+    OverheadQueuedRecords,
+    OverheadDroppedTicks,
+    OverheadColumnCount,
+};
+
+class VarintReader
+{
+public:
+    VarintReader(const uint8_t* begin, const uint8_t* end) : m_ptr(begin), m_end(end) { }
+
+    bool read(uint64_t& value)
+    {
+        value = 0;
+        for(int shift = 0; m_ptr < m_end && shift < 64; shift += 7)
+        {
+            auto byte = *m_ptr++;
+            value |= uint64_t(byte & 0x7F) << shift;
+            if(!(byte & 0x80))
+                return true;
+        }
+        return false;
+    }
+
+    const uint8_t* ptr() const { return m_ptr; }
+    size_t remaining() const { return m_end - m_ptr; }
+
+private:
+    const uint8_t* m_ptr = nullptr;
+    const uint8_t* m_end = nullptr;
+};
+
+// Times and XOR-ed column values shared by the Samples and Overhead records,
+// values are stored column by column (values[column * count + i]). Columns after
+// requiredColumns can be missing in older traces, they are read as 0.
+static bool readBlock(VarintReader& record, int columnCount, std::vector<uint64_t>& times, std::vector<uint64_t>& values, int requiredColumns = -1)
+{
+    uint64_t count = 0, time = 0;
+    if(!record.read(count) || !record.read(time) || count > record.remaining())
+        return false;
+    times.resize(count);
+    for(uint64_t i = 0; i < count; i++)
+    {
+        uint64_t delta = 0;
+        if(i > 0 && !record.read(delta))
+            return false;
+        time += delta;
+        times[i] = time;
+    }
+    values.assign(count * columnCount, 0);
+    for(int column = 0; column < columnCount; column++)
+    {
+        if(requiredColumns >= 0 && column >= requiredColumns && !record.remaining())
+            break;
+        uint64_t previous = 0;
+        for(uint64_t i = 0; i < count; i++)
+        {
+            uint64_t value = 0;
+            if(!record.read(value))
+                return false;
+            previous ^= value;
+            values[column * count + i] = previous;
+        }
+    }
+    return true;
+}
+
+bool isBinaryTrace(const QByteArray& data)
+{
+    return data.size() >= int(sizeof(BinaryTraceMagic)) && memcmp(data.constData(), BinaryTraceMagic, sizeof(BinaryTraceMagic)) == 0;
+}
+
+bool readBinaryTrace(const QByteArray& data, TraceData& trace, QString& error)
+{
+    if(!isBinaryTrace(data) || data.size() < int(sizeof(BinaryTraceMagic) + 4))
+    {
+        error = "Not a binary trace";
+        return false;
+    }
+    // A truncated record at the end stays in the stream, like in a killed run
+    BinaryTraceStream stream;
+    return stream.append(data, trace, error);
+}
+
+bool BinaryTraceStream::append(const QByteArray& data, TraceData& trace, QString& error)
+{
+    // Only the incomplete record of the previous call is buffered, whole files are read in place
+    const QByteArray* input = &data;
+    if(!m_buffer.isEmpty())
+    {
+        m_buffer.append(data);
+        input = &m_buffer;
+    }
+    auto bytes = (const uint8_t*)input->constData();
+    size_t size = input->size();
+    size_t offset = 0;
+    auto success = true;
+    if(!m_headerRead && size >= sizeof(BinaryTraceMagic) + 4)
+    {
+        auto version = uint32_t(bytes[8]) | uint32_t(bytes[9]) << 8 | uint32_t(bytes[10]) << 16 | uint32_t(bytes[11]) << 24;
+        if(memcmp(bytes, BinaryTraceMagic, sizeof(BinaryTraceMagic)) != 0)
+        {
+            error = "Not a binary trace";
+            return false;
+        }
+        if(version != BinaryTraceVersion)
+        {
+            error = QString("Unsupported binary trace version %1").arg(version);
+            return false;
+        }
+        m_headerRead = true;
+        offset = sizeof(BinaryTraceMagic) + 4;
+    }
+    while(m_headerRead && offset < size)
+    {
+        VarintReader header(bytes + offset, bytes + size);
+        uint64_t type = 0, recordSize = 0;
+        if(!header.read(type) || !header.read(recordSize) || recordSize > header.remaining())
+            break; // the rest of the record is still to come
+        if(!readRecord(type, header.ptr(), size_t(recordSize), trace, error))
+        {
+            success = false;
+            break;
+        }
+        offset = header.ptr() + recordSize - bytes;
+    }
+    m_buffer = input->mid(int(offset));
+    return success;
+}
+
+bool BinaryTraceStream::readRecord(uint64_t type, const uint8_t* data, size_t size, TraceData& trace, QString& error)
+{
+    VarintReader record(data, data + size);
+    switch(type)
+    {
+    case RecordString:
+        m_strings.push_back(QString::fromUtf8((const char*)record.ptr(), int(size)));
+        break;
+
+    case RecordProcess:
+    {
+        uint64_t pid = 0, ppid = 0, name = 0;
+        if(!record.read(pid) || !record.read(ppid) || !record.read(name) || name >= m_strings.size())
+        {
+            error = "Corrupt process record";
+            return false;
+        }
+        UniqueProcess uniqueProcess;
+        uniqueProcess.pid = uint32_t(pid);
+        uniqueProcess.ppid = uint32_t(ppid);
+        uniqueProcess.name = m_strings[name];
+        // Creation time was added later, older traces do not have it
+        uint64_t createTime = 0;
+        if(record.read(createTime))
+            uniqueProcess.createTime = createTime;
+        m_processes.push_back(uniqueProcess);
+    }
+    break;
+
+    case RecordSamples:
+    {
+        uint64_t index = 0;
+        if(!record.read(index) || index >= m_processes.size() || !readBlock(record, ColumnCount, m_times, m_values, ColumnCountWithoutIo))
+        {
+            error = "Corrupt samples record";
+            return false;
+        }
+        const auto& times = m_times;
+        const auto& values = m_values;
+        auto count = times.size();
+        // A process can get samples in every append, the trace only has the new ones
+        auto& pdata = trace.processes[m_processes[index]];
+        auto offset = pdata.size();
+        pdata.resize(offset + count);
+        for(size_t i = 0; i < count; i++)
+        {
+            auto& d = pdata[offset + i];
+            d.time = times[i];
+            d.cpuUsage = values[ColumnCpuUsage * count + i] / 100.0;
+            d.memoryUsage = values[ColumnWorkingSetSize * count + i];
+            d.pagefileUsage = values[ColumnPagefileUsage * count + i];
+            d.readBytes = values[ColumnReadBytes * count + i];
+            d.writeBytes = values[ColumnWriteBytes * count + i];
+            d.readOperations = values[ColumnReadOperations * count + i];
+            d.writeOperations = values[ColumnWriteOperations * count + i];
+            d.cpuTime = values[ColumnCpuTime * count + i];
+            d.cycleTime = values[ColumnCycleTime * count + i];
+        }
+    }
+    break;
+
+    case RecordOverhead:
+    {
+        if(!readBlock(record, OverheadColumnCount, m_times, m_values))
+        {
+            error = "Corrupt overhead record";
+            return false;
+        }
+        const auto& times = m_times;
+        const auto& values = m_values;
+        auto count = times.size();
+        for(size_t i = 0; i < count; i++)
+        {
+            OverheadData o;
+            o.time = times[i];
+            o.snapshotTime = values[OverheadSnapshotTime * count + i];
+            o.queryCount = uint32_t(values[OverheadQueryCount * count + i]);
+            o.queryTime = values[OverheadQueryTime * count + i];
+            o.writeTime = values[OverheadWriteTime * count + i];
+            o.cpuUsage = values[OverheadCpuUsage * count + i] / 100.0;
+            o.workingSetSize = values[OverheadWorkingSetSize * count + i];
+            o.missedDeadlines = uint32_t(values[OverheadMissedDeadlines * count + i]);
+            o.tick = values[OverheadTick * count + i];
+            o.interval = uint32_t(values[OverheadInterval * count + i]);
+            o.queueTime = values[OverheadQueueTime * count + i];
+            o.queuedRecords = uint32_t(values[OverheadQueuedRecords * count + i]);
+            o.droppedTicks = uint32_t(values[OverheadDroppedTicks * count + i]);
+            trace.overhead.push_back(o);
+        }
+    }
+    break;
+
+    case RecordComposition:
+    {
+        uint64_t index = 0;
+        uint64_t columns[CompositionColumnCount] = {};
+        CompositionData c;
+        auto valid = record.read(index) && index < m_processes.size() && record.read(c.time);
+        for(size_t i = 0; i < CompositionColumnCount && valid; i++)
+            valid = record.read(columns[i]);
+        if(!valid)
+        {
+            error = "Corrupt composition record";
+            return false;
+        }
+        c.image = columns[CompositionImage];
+        c.mapped = columns[CompositionMapped];
+        c.shareable = columns[CompositionShareable];
+        c.heap = columns[CompositionHeap];
+        c.stack = columns[CompositionStack];
+        c.privateData = columns[CompositionPrivate];
+        trace.compositions[m_processes[index]].push_back(c);
+    }
+    break;
+
+    case RecordRollup:
+    {
+        uint64_t index = 0;
+        uint64_t columns[RollupColumnCount] = {};
+        RollupData r;
+        auto valid = record.read(index) && index < m_processes.size() && record.read(r.time);
+        for(size_t i = 0; i < RollupColumnCount && valid; i++)
+            valid = record.read(columns[i]);
+        if(!valid)
+        {
+            error = "Corrupt rollup record";
+            return false;
+        }
+        r.memoryUsage = columns[RollupWorkingSetSize];
+        r.privateUsage = columns[RollupPrivateUsage];
+        r.cpuUsage = columns[RollupCpuUsage] / 100.0;
+        r.processCount = uint32_t(columns[RollupProcessCount]);
+        trace.rollups[m_processes[index]].push_back(r);
+    }
+    break;
+
+    default: // unknown record
+        break;
+    }
+    return true;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "OnlookerData.h"
+
+#include <QByteArray>
+#include <map>
+#include <vector>
+
+// Reader for the binary trace format written by Onlooker (see Onlooker/BinaryTrace.h)
+bool isBinaryTrace(const QByteArray& data);
+bool readBinaryTrace(const QByteArray& data, TraceData& trace, QString& error);
+
+// Incremental reader for a trace that is streamed live by Onlooker (ONLOOKER_LIVE). The
+// complete records of every append are added to the trace passed along, so it can be a
+// fresh one that only gets the new data. An incomplete record is kept for the next append.
+class BinaryTraceStream
+{
+public:
+    bool append(const QByteArray& data, TraceData& trace, QString& error);
+
+    // In order of appearance, including processes without samples yet
+    const std::vector<UniqueProcess>& processes() const { return m_processes; }
+
+private:
+    bool readRecord(uint64_t type, const uint8_t* data, size_t size, TraceData& trace, QString& error);
+
+    QByteArray m_buffer;
+    bool m_headerRead = false;
+    std::vector<QString> m_strings;
+    std::vector<UniqueProcess> m_processes;
+    std::vector<uint64_t> m_times;
+    std::vector<uint64_t> m_values;
+};
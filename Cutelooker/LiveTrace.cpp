@@ -0,0 +1,89 @@
+#include "LiveTrace.h"
+
+LiveTrace::LiveTrace(QObject* parent)
+    : QObject(parent)
+    , m_server(new QLocalServer(this))
+{
+    connect(m_server, &QLocalServer::newConnection, this, &LiveTrace::newConnectionSlot);
+}
+
+bool LiveTrace::listen(const QString& name, QString& error)
+{
+    close();
+    // A socket left behind by a viewer that crashed makes listen fail
+    QLocalServer::removeServer(name);
+    if(!m_server->listen(name))
+    {
+        error = m_server->errorString();
+        return false;
+    }
+    return true;
+}
+
+void LiveTrace::close()
+{
+    if(m_socket)
+    {
+        m_socket->disconnect(this);
+        m_socket->abort();
+        m_socket->deleteLater();
+        m_socket = nullptr;
+    }
+    m_stream.reset();
+    m_server->close();
+}
+
+void LiveTrace::newConnectionSlot()
+{
+    while(auto socket = m_server->nextPendingConnection())
+    {
+        // One run at a time, the writes of a second Onlooker just fail
+        if(m_socket)
+        {
+            socket->abort();
+            socket->deleteLater();
+            continue;
+        }
+        m_socket = socket;
+        m_stream = std::make_unique<BinaryTraceStream>();
+        connect(socket, &QLocalSocket::readyRead, this, &LiveTrace::readyReadSlot);
+        connect(socket, &QLocalSocket::disconnected, this, &LiveTrace::disconnectedSlot);
+        emit started();
+        readyReadSlot();
+    }
+}
+
+void LiveTrace::readyReadSlot()
+{
+    if(!m_socket)
+        return;
+    auto bytes = m_socket->readAll();
+    if(bytes.isEmpty())
+        return;
+    TraceData data;
+    QString error;
+    auto success = m_stream->append(bytes, data, error);
+    emit received(data);
+    if(!success)
+    {
+        auto socket = m_socket;
+        m_socket = nullptr;
+        m_stream.reset();
+        socket->disconnect(this);
+        socket->abort();
+        socket->deleteLater();
+        emit finished(error);
+    }
+}
+
+void LiveTrace::disconnectedSlot()
+{
+    // Whatever arrived before the connection closed
+    readyReadSlot();
+    if(!m_socket)
+        return;
+    m_socket->deleteLater();
+    m_socket = nullptr;
+    m_stream.reset();
+    emit finished(QString());
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <QObject>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include "OnlookerData.h"
+#include "BinaryTraceReader.h"
+
+#include <memory>
+
+// Waits for Onlooker to connect (ONLOOKER_LIVE=<name>) and parses the trace it streams.
+// One run is received at a time, the next connection starts a new one.
+class LiveTrace : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit LiveTrace(QObject* parent = nullptr);
+
+    // Local socket on Linux, named pipe on Windows
+    bool listen(const QString& name, QString& error);
+    void close();
+    bool isListening() const { return m_server->isListening(); }
+    bool isReceiving() const { return m_socket != nullptr; }
+    QString name() const { return m_server->serverName(); }
+
+signals:
+    // A new run connected, the data of the previous one is obsolete
+    void started();
+    // Only the data that arrived since the previous signal
+    void received(const TraceData& data);
+    // The run ended or the stream was corrupt (error is set)
+    void finished(const QString& error);
+
+private slots:
+    void newConnectionSlot();
+    void readyReadSlot();
+    void disconnectedSlot();
+
+private:
+    QLocalServer* m_server = nullptr;
+    QLocalSocket* m_socket = nullptr;
+    std::unique_ptr<BinaryTraceStream> m_stream;
+};
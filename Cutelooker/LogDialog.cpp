@@ -1,5 +1,6 @@
 #include "LogDialog.h"
 #include "ui_LogDialog.h"
+#include "TraceFile.h"
 #include <QIcon>
 #include <QFile>
 #include <QJsonDocument>
@@ -31,14 +32,16 @@ LogDialog::~LogDialog()
 
 bool LogDialog::loadLogJson(const QString& jsonFile)
 {
-    QFile f(jsonFile);
-    if(!f.open(QFile::ReadOnly))
+    TraceFile f;
+    QString error;
+    QByteArray data;
+    if(!f.open(jsonFile, error) || !f.readAll(data, error))
     {
-        QMessageBox::warning(this, tr("Error"), tr("Failed to open JSON."));
+        QMessageBox::warning(this, tr("Error"), tr("Failed to open JSON:\n%1").arg(error));
         return false;
     }
     QJsonParseError parseError;
-    auto json = QJsonDocument::fromJson(f.readAll(), &parseError);
+    auto json = QJsonDocument::fromJson(data, &parseError);
     if(json.isNull())
     {
         QMessageBox::warning(this, tr("Error"), tr("Failed to parse JSON:\n%s").arg(parseError.errorString()));
@@ -1,5 +1,7 @@
 #include "MainWindow.h"
 #include "ui_MainWindow.h"
+#include "BinaryTraceReader.h"
+#include "TraceFile.h"
 
 #include <QGraphicsWidget>
 #include <QFile>
@@ -10,9 +12,11 @@
 #include <QJsonValue>
 #include <QSettings>
 #include <QFileInfo>
+#include <QInputDialog>
 
 #include <cmath>
 #include <algorithm>
+#include <iterator>
 
 #ifdef Q_OS_WIN
 #include <windows.h>
@@ -30,6 +34,10 @@ MainWindow::MainWindow(QWidget* parent)
     m_informationDialog = new InformationDialog(this);
     m_logDialog = new LogDialog(this);
     connect(m_logDialog, SIGNAL(logSelectionChanged(uint64_t)), this, SLOT(logSelectionChangedSlot(uint64_t)));
+    m_live = new LiveTrace(this);
+    connect(m_live, &LiveTrace::started, this, &MainWindow::liveStartedSlot);
+    connect(m_live, &LiveTrace::received, this, &MainWindow::liveReceivedSlot);
+    connect(m_live, &LiveTrace::finished, this, &MainWindow::liveFinishedSlot);
 
     QSettings settings;
     restoreGeometry(settings.value("MainWindowGeometry").toByteArray());
@@ -37,6 +45,8 @@ MainWindow::MainWindow(QWidget* parent)
     m_informationDialog->restoreGeometry(settings.value("InformationDialog").toByteArray());
     m_logDialog->restoreGeometry(settings.value("LogDialog").toByteArray());
     ui->actionPlot_pagefile->setChecked(getPlotPagefileSetting());
+    ui->actionPlot_overhead->setChecked(getPlotOverheadSetting());
+    ui->actionPlot_io->setChecked(getPlotIoSetting());
 
     // Windows hack for setting the icon in the taskbar.
 #ifdef Q_OS_WIN
@@ -71,19 +81,54 @@ void MainWindow::dragEnterEvent(QDragEnterEvent* event)
     }
 }
 
+// Onlooker writes the trace while sampling, one line per tick. When it was
+// killed the array is not closed, so drop the last partial line and close it.
+static QJsonDocument parseTraceJson(const QByteArray& data, QJsonParseError* parseError)
+{
+    auto json = QJsonDocument::fromJson(data, parseError);
+    if(json.isNull() && data.startsWith('['))
+    {
+        auto lastLine = data.lastIndexOf('\n');
+        if(lastLine != -1)
+        {
+            auto recovered = QJsonDocument::fromJson(data.left(lastLine + 1) + "]");
+            if(recovered.isArray())
+                return recovered;
+        }
+    }
+    return json;
+}
+
 void MainWindow::dropEvent(QDropEvent* event)
 {
     if(event->mimeData()->hasUrls())
     {
         QString jsonFile = QDir::toNativeSeparators(event->mimeData()->urls()[0].toLocalFile());
-        QFile f(jsonFile);
-        if(!f.open(QFile::ReadOnly))
+        TraceFile f;
+        QString error;
+        QByteArray data;
+        if(!f.open(jsonFile, error) || !f.read(data, error))
+        {
+            QMessageBox::warning(this, tr("Error"), tr("Failed to open JSON:\n%1").arg(error));
+            return;
+        }
+        if(isBinaryTrace(data))
         {
-            QMessageBox::warning(this, tr("Error"), tr("Failed to open JSON."));
+            QSettings settings;
+            settings.setValue("BrowseDirectory", QFileInfo(jsonFile).absoluteDir().absolutePath());
+            loadChart(jsonFile);
+            event->acceptProposedAction();
             return;
         }
+        QByteArray rest;
+        if(!f.readAll(rest, error))
+        {
+            QMessageBox::warning(this, tr("Error"), tr("Failed to read JSON:\n%1").arg(error));
+            return;
+        }
+        data.append(rest);
         QJsonParseError parseError;
-        auto json = QJsonDocument::fromJson(f.readAll(), &parseError);
+        auto json = parseTraceJson(data, &parseError);
         if(json.isNull())
         {
             QMessageBox::warning(this, tr("Error"), tr("Failed to parse JSON:\n%s").arg(parseError.errorString()));
@@ -92,7 +137,7 @@ void MainWindow::dropEvent(QDropEvent* event)
         QSettings settings;
         settings.setValue("BrowseDirectory", QFileInfo(jsonFile).absoluteDir().absolutePath());
         if(json.isArray()) // Data
-            loadJsonChart(jsonFile);
+            loadChart(jsonFile);
         else if(json.isObject()) // Log
             loadJsonLog(jsonFile);
         event->acceptProposedAction();
@@ -115,6 +160,7 @@ protected:
     }
 };
 
+// Refers to the times of the window, so the axis follows a live plot as it grows
 class TimeAxisTicker : public QCPAxisTicker
 {
 public:
@@ -137,9 +183,54 @@ protected:
     }
 
 private:
-    std::vector<uint64_t> m_times;
+    const std::vector<uint64_t>& m_times;
 };
 
+// Last entry at or before the time, end() if there is none
+template <typename Map>
+static auto findAtOrBefore(Map& map, uint64_t time)
+{
+    auto itr = map.upper_bound(time);
+    if(itr == map.begin())
+        return map.end();
+    return --itr;
+}
+
+// The bars are evenly spaced, so when the samples are not (adaptive sampling, missed ticks)
+// they are resampled on a regular grid of the shortest interval to keep the time axis linear
+template <typename Timeline>
+static std::vector<uint64_t> plotTimes(const Timeline& timeline, size_t processCount)
+{
+    std::vector<uint64_t> times;
+    uint64_t step = 0;
+    bool uneven = false;
+    for(const auto& event : timeline)
+    {
+        if(!times.empty())
+        {
+            auto delta = event.first - times.back();
+            if(step && delta != step)
+                uneven = true;
+            step = step ? std::min(step, delta) : delta;
+        }
+        times.push_back(event.first);
+    }
+    if(!uneven)
+        return times;
+
+    // limit the number of bars, but never show fewer than there are samples
+    const uint64_t maxBars = 20000000;
+    auto startTime = times.front();
+    auto endTime = times.back();
+    auto maxTimes = std::max<uint64_t>(times.size(), maxBars / std::max<size_t>(processCount, 1));
+    while((endTime - startTime) / step + 1 > maxTimes)
+        step *= 2;
+    times.clear();
+    for(auto time = startTime; time <= endTime; time += step)
+        times.push_back(time);
+    return times;
+}
+
 template <typename Cont, typename Pred>
 Cont filter(const Cont &container, Pred predicate)
 {
@@ -148,54 +239,180 @@ Cont filter(const Cont &container, Pred predicate)
     return result;
 }
 
-void MainWindow::loadJsonChart(const QString& jsonFile)
+bool MainWindow::readJsonTrace(const QByteArray& bytes, TraceData& trace)
 {
-    auto plotPagefile = getPlotPagefileSetting();
-    // deserialize json
-    std::map<UniqueProcess, std::vector<ProcessData>> processData;
+    QJsonParseError parseError;
+    auto json = parseTraceJson(bytes, &parseError);
+    if(json.isNull())
+    {
+        QMessageBox::warning(this, tr("Error"), tr("Failed to parse JSON:\n%s").arg(parseError.errorString()));
+        return false;
+    }
+    if(!json.isArray())
     {
-        QFile f(jsonFile);
-        if(!f.open(QFile::ReadOnly))
+        QMessageBox::warning(this, tr("Error"), tr("Unexpected data format"));
+        return false;
+    }
+    auto processes = json.array();
+    int processCount = processes.size();
+
+    for(int i = 0; i < processCount; i++)
+    {
+        QJsonValue process = processes[i];
+        auto overhead = process["overhead"];
+        if(overhead.isObject())
         {
-            QMessageBox::warning(this, tr("Error"), tr("Failed to open JSON."));
-            return;
+            OverheadData o;
+            o.time = overhead["time"].toVariant().toULongLong();
+            o.tick = overhead["tick"].toVariant().toULongLong();
+            o.interval = overhead["interval"].toVariant().toUInt();
+            o.snapshotTime = overhead["snapshotTime"].toVariant().toULongLong();
+            o.queryCount = overhead["queryCount"].toVariant().toUInt();
+            o.queryTime = overhead["queryTime"].toVariant().toULongLong();
+            o.writeTime = overhead["writeTime"].toVariant().toULongLong();
+            o.queueTime = overhead["queueTime"].toVariant().toULongLong();
+            o.queuedRecords = overhead["queuedRecords"].toVariant().toUInt();
+            o.cpuUsage = overhead["cpuUsage"].toDouble();
+            o.workingSetSize = overhead["workingSetSize"].toVariant().toULongLong();
+            o.missedDeadlines = overhead["missedDeadlines"].toVariant().toUInt();
+            o.droppedTicks = overhead["droppedTicks"].toVariant().toUInt();
+            trace.overhead.push_back(o);
+            continue;
         }
-        QJsonParseError parseError;
-        auto json = QJsonDocument::fromJson(f.readAll(), &parseError);
-        if(json.isNull())
+        auto composition = process["composition"];
+        if(composition.isObject())
         {
-            QMessageBox::warning(this, tr("Error"), tr("Failed to parse JSON:\n%s").arg(parseError.errorString()));
-            return;
+            UniqueProcess uniqueProcess;
+            uniqueProcess.pid = composition["pid"].toVariant().toLongLong();
+            uniqueProcess.ppid = composition["ppid"].toVariant().toLongLong();
+            uniqueProcess.name = composition["name"].toString();
+            uniqueProcess.createTime = composition["createTime"].toVariant().toULongLong();
+            CompositionData c;
+            c.time = composition["time"].toVariant().toULongLong();
+            c.image = composition["image"].toVariant().toULongLong();
+            c.mapped = composition["mapped"].toVariant().toULongLong();
+            c.shareable = composition["shareable"].toVariant().toULongLong();
+            c.heap = composition["heap"].toVariant().toULongLong();
+            c.stack = composition["stack"].toVariant().toULongLong();
+            c.privateData = composition["private"].toVariant().toULongLong();
+            trace.compositions[uniqueProcess].push_back(c);
+            continue;
         }
-        if(!json.isArray())
+        auto rollup = process["rollup"];
+        if(rollup.isObject())
         {
-            QMessageBox::warning(this, tr("Error"), tr("Unexpected data format"));
-            return;
+            UniqueProcess uniqueProcess;
+            uniqueProcess.pid = rollup["pid"].toVariant().toLongLong();
+            uniqueProcess.ppid = rollup["ppid"].toVariant().toLongLong();
+            uniqueProcess.name = rollup["name"].toString();
+            uniqueProcess.createTime = rollup["createTime"].toVariant().toULongLong();
+            RollupData r;
+            r.time = rollup["time"].toVariant().toULongLong();
+            r.memoryUsage = rollup["workingSetSize"].toVariant().toULongLong();
+            r.privateUsage = rollup["privateUsage"].toVariant().toULongLong();
+            r.cpuUsage = rollup["cpuUsage"].toDouble();
+            r.processCount = rollup["processCount"].toVariant().toUInt();
+            trace.rollups[uniqueProcess].push_back(r);
+            continue;
+        }
+        // Per-thread samples are not plotted
+        if(process["threads"].isObject())
+            continue;
+        // The summaries at the end are aggregates of the samples
+        if(process["summary"].isObject() || process["treeSummary"].isObject())
+            continue;
+        // The version marker of the ticks layout
+        if(process["version"].isDouble())
+            continue;
+        UniqueProcess uniqueProcess;
+        uniqueProcess.pid = process["pid"].toVariant().toLongLong();
+        uniqueProcess.ppid = process["ppid"].toVariant().toLongLong();
+        uniqueProcess.name = process["name"].toString();
+        uniqueProcess.createTime = process["createTime"].toVariant().toULongLong();
+        // A process can be split over several chunks
+        auto& pdata = trace.processes[uniqueProcess];
+        auto datas = process["data"].toArray();
+        auto dataCount = datas.size();
+        auto offset = pdata.size();
+        pdata.resize(offset + dataCount);
+        for(int j = 0; j < dataCount; j++)
+        {
+            QJsonValue data = datas[j];
+            auto& d = pdata[offset + j];
+            d.time = data["time"].toVariant().toLongLong();
+            d.memoryUsage = data["memory"]["workingSetSize"].toVariant().toLongLong();
+            d.pagefileUsage = data["memory"]["pagefileUsage"].toVariant().toLongLong();
+            d.cpuUsage = data["cpuUsage"].toDouble();
+            auto io = data["io"];
+            d.readBytes = io["readBytes"].toVariant().toULongLong();
+            d.writeBytes = io["writeBytes"].toVariant().toULongLong();
+            d.readOperations = io["readOperations"].toVariant().toULongLong();
+            d.writeOperations = io["writeOperations"].toVariant().toULongLong();
+            d.cpuTime = data["cpuTime"].toVariant().toULongLong();
+            d.cycleTime = data["cycleTime"].toVariant().toULongLong();
         }
-        auto processes = json.array();
-        int processCount = processes.size();
+    }
+    return true;
+}
 
-        for(int i = 0; i < processCount; i++)
+void MainWindow::loadChart(const QString& traceFile)
+{
+    auto plotPagefile = getPlotPagefileSetting();
+    m_live->close();
+    m_liveBars.clear();
+    m_liveTopBars = nullptr;
+    // deserialize trace
+    TraceData trace;
+    {
+        TraceFile f;
+        QString error;
+        QByteArray data;
+        if(!f.open(traceFile, error) || !f.read(data, error))
         {
-            QJsonValue process = processes[i];
-            UniqueProcess uniqueProcess;
-            uniqueProcess.pid = process["pid"].toVariant().toLongLong();
-            uniqueProcess.ppid = process["ppid"].toVariant().toLongLong();
-            uniqueProcess.name = process["name"].toString();
-            auto& pdata = processData[uniqueProcess];
-            auto datas = process["data"].toArray();
-            auto dataCount = datas.size();
-            pdata.resize(dataCount);
-            for(int j = 0; j < dataCount; j++)
+            QMessageBox::warning(this, tr("Error"), tr("Failed to open trace:\n%1").arg(error));
+            return;
+        }
+        if(isBinaryTrace(data))
+        {
+            // Chunk by chunk, a compressed trace is never decompressed as a whole
+            BinaryTraceStream stream;
+            while(!data.isEmpty() && stream.append(data, trace, error) && f.read(data, error))
+                ;
+            if(!error.isEmpty())
+            {
+                QMessageBox::warning(this, tr("Error"), tr("Failed to read binary trace:\n%1").arg(error));
+                return;
+            }
+        }
+        else
+        {
+            QByteArray rest;
+            if(!f.readAll(rest, error))
             {
-                QJsonValue data = datas[j];
-                pdata[j].time = data["time"].toVariant().toLongLong();
-                pdata[j].memoryUsage = data["memory"]["workingSetSize"].toVariant().toLongLong();
-                pdata[j].pagefileUsage = data["memory"]["pagefileUsage"].toVariant().toLongLong();
-                pdata[j].cpuUsage = data["cpuUsage"].toDouble();
+                QMessageBox::warning(this, tr("Error"), tr("Failed to read trace:\n%1").arg(error));
+                return;
             }
+            data.append(rest);
+            if(!readJsonTrace(data, trace))
+                return;
         }
     }
+    const auto& processData = trace.processes;
+    m_overhead.clear();
+    for(const OverheadData& overhead : trace.overhead)
+        m_overhead[overhead.time] = overhead;
+    m_compositions.clear();
+    for(const auto& process : trace.compositions)
+    {
+        for(const CompositionData& composition : process.second)
+            m_compositions[process.first][composition.time] = composition;
+    }
+    m_rollups.clear();
+    for(const auto& process : trace.rollups)
+    {
+        for(const RollupData& rollup : process.second)
+            m_rollups[process.first][rollup.time] = rollup;
+    }
 
     // get sorted processes
     std::vector<SortedProcess> sortedProcesses;
@@ -247,121 +464,32 @@ void MainWindow::loadJsonChart(const QString& jsonFile)
 
     // generate chart
     {
-        // TODO: use matplotlib tab20
-        QVector<QColor> colors =
-        {
-            QColor("#F3B415"),
-            QColor("#F27036"),
-            QColor("#663F59"),
-            QColor("#6A6E94"),
-            QColor("#4E88B4"),
-            QColor("#00A7C6"),
-            QColor("#18D8D8"),
-            QColor("#A9D794"),
-            QColor("#46AF78"),
-            QColor("#A93F55"),
-            QColor("#8C5E58"),
-            QColor("#2176FF"),
-            QColor("#33A1FD"),
-            QColor("#7A918D"),
-            QColor("#BAFF29"),
-        };
-        // tab20
-        /*
-        import matplotlib.pyplot as plt
-        cmap = plt.get_cmap('tab20')
-        for i in range(0, 20):
-            print ('QColor' + str(cmap(i / 20.0, bytes=True)[:3]) + ',')
-        */
-        colors =
-        {
-            QColor(31, 119, 180),
-            QColor(174, 199, 232),
-            QColor(255, 127, 14),
-            QColor(255, 187, 120),
-            QColor(44, 160, 44),
-            QColor(152, 223, 138),
-            QColor(214, 39, 40),
-            QColor(255, 152, 150),
-            QColor(148, 103, 189),
-            QColor(197, 176, 213),
-            QColor(140, 86, 75),
-            QColor(196, 156, 148),
-            QColor(227, 119, 194),
-            QColor(247, 182, 210),
-            QColor(127, 127, 127),
-            QColor(199, 199, 199),
-            QColor(188, 189, 34),
-            QColor(219, 219, 141),
-            QColor(23, 190, 207),
-            QColor(158, 218, 229),
-        };
-
-        if(m_customPlot)
-        {
-            m_overlay->hideOverlay();
-            m_customPlot->removeEventFilter(m_overlay);
-            m_informationDialog->hide();
-            m_informationDialog->setInformationText(QString());
-            delete m_customPlot;
-            m_customPlot = nullptr;
-            m_selectedGraph = nullptr;
-        }
-
-        auto customPlot = m_customPlot = new QCustomPlot(this);
-        customPlot->setInteraction(QCP::Interaction::iRangeZoom);
+        auto customPlot = createPlot();
 
         std::map<UniqueProcess, QCPBars*> processBars;
         for(size_t i = 0; i < sortedProcesses.size(); i++)
         {
             const SortedProcess& process = sortedProcesses[i];
-            const QColor& color = colors[i % colors.size()];
-
-            auto bars = new QCPBars(customPlot->xAxis, customPlot->yAxis);
-            bars->setProperty("PID", process.uniqueProcess.pid);
-            bars->setProperty("PPID", process.uniqueProcess.ppid);
-            bars->setName(QString("%1 (PID: %2, Parent: %3)").arg(process.uniqueProcess.name).arg(process.uniqueProcess.pid).arg(process.uniqueProcess.ppid));
-            bars->setBrush(QBrush(color));
-            bars->setPen(QPen(color));
-            bars->setWidthType(QCPBars::wtPlotCoords);
-            bars->setWidth(1);
-            bars->setAntialiased(false);
-            bars->setSelectable(QCP::SelectionType::stSingleData);
-
-            void(QCPBars::* mySelectionChanged)(const QCPDataSelection&) = &QCPBars::selectionChanged;
-            connect(bars, mySelectionChanged, [this, bars](const QCPDataSelection& ds)
-            {
-                if (ds.dataRangeCount() == 0)
-                {
-                    m_selectedGraph = nullptr;
-                }
-                else
-                {
-                    m_selectedGraph = bars;
-                }
-                // TODO: find a better way, this is super delayed
-                overlayCursorChangedSlot(m_lastPos);
-            });
-
-            processBars[process.uniqueProcess] = bars;
-            if(i > 0)
-                bars->moveAbove(processBars[sortedProcesses[i - 1].uniqueProcess]);
+            processBars[process.uniqueProcess] = addProcessBars(customPlot, process.uniqueProcess, i, i > 0 ? processBars[sortedProcesses[i - 1].uniqueProcess] : nullptr);
         }
 
         uint64_t maxSum = 0;
 
         QVector<double> ticks;
-        std::vector<uint64_t> times;
+        auto times = plotTimes(timeline, sortedProcesses.size());
         uint64_t xx = 0;
         std::map<UniqueProcess, QVector<double>> processBarData;
-        for (const auto& event : timeline)
+        auto event = timeline.begin();
+        for (auto time : times)
         {
+            // a sample holds until the next one
+            while (std::next(event) != timeline.end() && std::next(event)->first <= time)
+                ++event;
             ticks.push_back(xx++);
-            times.push_back(event.first);
             uint64_t eventSum = 0;
             for (const auto& process : sortedProcesses)
             {
-                const auto& p = event.second.at(process.uniqueProcess);
+                const auto& p = event->second.at(process.uniqueProcess);
                 auto memoryUsage = plotPagefile ? p.pagefileUsage : p.memoryUsage;
                 eventSum += memoryUsage;
                 processBarData[process.uniqueProcess].push_back(memoryUsage);
@@ -370,21 +498,10 @@ void MainWindow::loadJsonChart(const QString& jsonFile)
         }
         m_times = times;
 
-        // prepare x axis
+        // prepare axes
+        setupAxes(customPlot, plotPagefile);
         customPlot->xAxis->setRange(0, xx);
-        customPlot->xAxis->setLabel("Time");
-        QSharedPointer<TimeAxisTicker> timeTicker(new TimeAxisTicker(times));
-        customPlot->xAxis->setTicker(timeTicker);
-
-        // prepare y axis
-        customPlot->yAxis->setRange(0, maxSum);
-        customPlot->yAxis->setLabel(plotPagefile ? "Pagefile usage" : "Memory usage");
-        QSharedPointer<MemoryAxisTicker> memoryTicker(new MemoryAxisTicker);
-        memoryTicker->setScaleStrategy(MemoryAxisTicker::ssMultiples);
-        memoryTicker->setTickStep(1024ull * 1024 * 10); // 10 mb
-        auto tickStep = memoryTicker->getTickStep(QCPRange(0, maxSum));
-        customPlot->yAxis->setRange(0, std::ceil(maxSum / tickStep) * tickStep);
-        customPlot->yAxis->setTicker(memoryTicker);
+        setMemoryRange(customPlot, maxSum);
 
         // add data
         for(const auto& process : sortedProcesses)
@@ -392,28 +509,204 @@ void MainWindow::loadJsonChart(const QString& jsonFile)
             processBars[process.uniqueProcess]->setData(ticks, processBarData[process.uniqueProcess], true);
         }
 
-        // setup legend
-        customPlot->legend->setVisible(false); // TODO: make menu to toggle the legend
-        customPlot->axisRect()->insetLayout()->setInsetAlignment(0, Qt::AlignTop|Qt::AlignLeft);
-        customPlot->legend->setBrush(QColor(255, 255, 255, 100));
-        customPlot->legend->setBorderPen(Qt::NoPen);
-        QFont legendFont = font();
-        legendFont.setPointSize(10);
-        customPlot->legend->setFont(legendFont);
-        
-        // selection
-        customPlot->setInteraction(QCP::Interaction::iSelectPlottables);
-        customPlot->installEventFilter(m_overlay);
-        setCentralWidget(customPlot);
+        // sampler overhead on the right axis, only at ticks that have samples
+        if(getPlotOverheadSetting() && !m_overhead.empty())
+        {
+            QVector<double> overheadTicks, overheadData;
+            double maxOverhead = 0;
+            for(size_t i = 0; i < times.size(); i++)
+            {
+                auto itr = findAtOrBefore(m_overhead, times[i]);
+                if(itr == m_overhead.end())
+                    continue;
+                auto ms = itr->second.totalTime() / 1000.0;
+                overheadTicks.push_back(i);
+                overheadData.push_back(ms);
+                maxOverhead = qMax(maxOverhead, ms);
+            }
+            auto graph = customPlot->addGraph(customPlot->xAxis, customPlot->yAxis2);
+            graph->setName("Sampler overhead");
+            graph->setPen(QPen(Qt::red));
+            graph->setSelectable(QCP::SelectionType::stNone);
+            graph->setData(overheadTicks, overheadData, true);
+            customPlot->yAxis2->setVisible(true);
+            customPlot->yAxis2->setLabel("Sampler overhead (ms)");
+            customPlot->yAxis2->setRange(0, maxOverhead > 0 ? maxOverhead * 1.1 : 1);
+        }
+
+        // total I/O throughput of the plotted processes on an extra right axis
+        if(getPlotIoSetting())
+        {
+            QVector<double> readData, writeData;
+            double maxIo = 0;
+            auto ioEvent = timeline.begin();
+            for(auto time : times)
+            {
+                while(std::next(ioEvent) != timeline.end() && std::next(ioEvent)->first <= time)
+                    ++ioEvent;
+                uint64_t readBytes = 0, writeBytes = 0;
+                for(const auto& process : sortedProcesses)
+                {
+                    const auto& p = ioEvent->second.at(process.uniqueProcess);
+                    readBytes += p.readBytes;
+                    writeBytes += p.writeBytes;
+                }
+                readData.push_back(readBytes);
+                writeData.push_back(writeBytes);
+                maxIo = qMax(maxIo, double(qMax(readBytes, writeBytes)));
+            }
+            auto ioAxis = customPlot->axisRect()->addAxis(QCPAxis::atRight);
+            ioAxis->setLabel("I/O per second");
+            QSharedPointer<MemoryAxisTicker> ioTicker(new MemoryAxisTicker);
+            ioTicker->setScaleStrategy(MemoryAxisTicker::ssMultiples);
+            ioTicker->setTickStep(1024); // 1 kb
+            ioAxis->setTicker(ioTicker);
+            ioAxis->setRange(0, maxIo > 0 ? maxIo * 1.1 : 1);
+            auto readGraph = customPlot->addGraph(customPlot->xAxis, ioAxis);
+            readGraph->setName("I/O read");
+            readGraph->setPen(QPen(QColor(31, 119, 180), 2));
+            readGraph->setSelectable(QCP::SelectionType::stNone);
+            readGraph->setData(ticks, readData, true);
+            auto writeGraph = customPlot->addGraph(customPlot->xAxis, ioAxis);
+            writeGraph->setName("I/O write");
+            writeGraph->setPen(QPen(QColor(255, 127, 14), 2));
+            writeGraph->setSelectable(QCP::SelectionType::stNone);
+            writeGraph->setData(ticks, writeData, true);
+        }
+
+        showPlot(customPlot);
+    }
+
+    setWindowTitle(tr("%1 - %2").arg(m_windowTitle).arg(QFileInfo(traceFile).fileName()));
+}
+
+// tab20
+/*
+import matplotlib.pyplot as plt
+cmap = plt.get_cmap('tab20')
+for i in range(0, 20):
+    print ('QColor' + str(cmap(i / 20.0, bytes=True)[:3]) + ',')
+*/
+static const QColor processColors[] =
+{
+    QColor(31, 119, 180),
+    QColor(174, 199, 232),
+    QColor(255, 127, 14),
+    QColor(255, 187, 120),
+    QColor(44, 160, 44),
+    QColor(152, 223, 138),
+    QColor(214, 39, 40),
+    QColor(255, 152, 150),
+    QColor(148, 103, 189),
+    QColor(197, 176, 213),
+    QColor(140, 86, 75),
+    QColor(196, 156, 148),
+    QColor(227, 119, 194),
+    QColor(247, 182, 210),
+    QColor(127, 127, 127),
+    QColor(199, 199, 199),
+    QColor(188, 189, 34),
+    QColor(219, 219, 141),
+    QColor(23, 190, 207),
+    QColor(158, 218, 229),
+};
+
+QCustomPlot* MainWindow::createPlot()
+{
+    if(m_customPlot)
+    {
+        m_overlay->hideOverlay();
+        m_customPlot->removeEventFilter(m_overlay);
+        m_informationDialog->hide();
+        m_informationDialog->setInformationText(QString());
+        delete m_customPlot;
+        m_customPlot = nullptr;
+        m_selectedGraph = nullptr;
     }
 
+    auto customPlot = m_customPlot = new QCustomPlot(this);
+    customPlot->setInteraction(QCP::Interaction::iRangeZoom);
+    return customPlot;
+}
+
+QCPBars* MainWindow::addProcessBars(QCustomPlot* customPlot, const UniqueProcess& process, size_t index, QCPBars* below)
+{
+    const QColor& color = processColors[index % std::size(processColors)];
+
+    auto bars = new QCPBars(customPlot->xAxis, customPlot->yAxis);
+    bars->setProperty("PID", process.pid);
+    bars->setProperty("PPID", process.ppid);
+    bars->setProperty("CreateTime", qulonglong(process.createTime));
+    bars->setName(QString("%1 (PID: %2, Parent: %3)").arg(process.name).arg(process.pid).arg(process.ppid));
+    bars->setBrush(QBrush(color));
+    bars->setPen(QPen(color));
+    bars->setWidthType(QCPBars::wtPlotCoords);
+    bars->setWidth(1);
+    bars->setAntialiased(false);
+    bars->setSelectable(QCP::SelectionType::stSingleData);
+
+    void(QCPBars::* mySelectionChanged)(const QCPDataSelection&) = &QCPBars::selectionChanged;
+    connect(bars, mySelectionChanged, [this, bars](const QCPDataSelection& ds)
+    {
+        if (ds.dataRangeCount() == 0)
+        {
+            m_selectedGraph = nullptr;
+        }
+        else
+        {
+            m_selectedGraph = bars;
+        }
+        // TODO: find a better way, this is super delayed
+        overlayCursorChangedSlot(m_lastPos);
+    });
+
+    if(below)
+        bars->moveAbove(below);
+    return bars;
+}
+
+void MainWindow::setupAxes(QCustomPlot* customPlot, bool plotPagefile)
+{
+    customPlot->xAxis->setLabel("Time");
+    QSharedPointer<TimeAxisTicker> timeTicker(new TimeAxisTicker(m_times));
+    customPlot->xAxis->setTicker(timeTicker);
+
+    customPlot->yAxis->setLabel(plotPagefile ? "Pagefile usage" : "Memory usage");
+    QSharedPointer<MemoryAxisTicker> memoryTicker(new MemoryAxisTicker);
+    memoryTicker->setScaleStrategy(MemoryAxisTicker::ssMultiples);
+    memoryTicker->setTickStep(1024ull * 1024 * 10); // 10 mb
+    customPlot->yAxis->setTicker(memoryTicker);
+}
+
+void MainWindow::setMemoryRange(QCustomPlot* customPlot, uint64_t maxSum)
+{
+    auto memoryTicker = qSharedPointerCast<MemoryAxisTicker>(customPlot->yAxis->ticker());
+    auto tickStep = memoryTicker->getTickStep(QCPRange(0, maxSum));
+    customPlot->yAxis->setRange(0, std::ceil(maxSum / tickStep) * tickStep);
+}
+
+void MainWindow::showPlot(QCustomPlot* customPlot)
+{
+    // setup legend
+    customPlot->legend->setVisible(false); // TODO: make menu to toggle the legend
+    customPlot->axisRect()->insetLayout()->setInsetAlignment(0, Qt::AlignTop|Qt::AlignLeft);
+    customPlot->legend->setBrush(QColor(255, 255, 255, 100));
+    customPlot->legend->setBorderPen(Qt::NoPen);
+    QFont legendFont = font();
+    legendFont.setPointSize(10);
+    customPlot->legend->setFont(legendFont);
+
+    // selection
+    customPlot->setInteraction(QCP::Interaction::iSelectPlottables);
+    customPlot->installEventFilter(m_overlay);
+    setCentralWidget(customPlot);
+
     m_hasOpenedInformation = false;
     m_logDialog->clear();
     m_logDialog->hide();
     ui->action_Log->setEnabled(false);
     ui->actionLoad_Log_JSON->setEnabled(true);
     ui->actionInformation->setEnabled(true);
-    setWindowTitle(tr("%1 - %2").arg(m_windowTitle).arg(QFileInfo(jsonFile).fileName()));
 }
 
 void MainWindow::loadJsonLog(const QString& jsonFile)
@@ -425,6 +718,18 @@ void MainWindow::loadJsonLog(const QString& jsonFile)
     }
 }
 
+bool MainWindow::getPlotOverheadSetting() const
+{
+    QSettings settings;
+    return settings.value("PlotOverhead", false).toBool();
+}
+
+bool MainWindow::getPlotIoSetting() const
+{
+    QSettings settings;
+    return settings.value("PlotIo", false).toBool();
+}
+
 bool MainWindow::getPlotPagefileSetting() const
 {
     bool plotPagefile = false;
@@ -439,6 +744,7 @@ void MainWindow::overlayCursorChangedSlot(QPoint pos)
     if(m_customPlot)
     {
         uint32_t selectedPid = 0, selectedPpid = 0;
+        uint64_t selectedCreateTime = 0;
         if (m_selectedGraph)
         {
             auto pidProp = m_selectedGraph->property("PID");
@@ -447,6 +753,7 @@ void MainWindow::overlayCursorChangedSlot(QPoint pos)
             {
                 selectedPid = pidProp.toUInt();
                 selectedPpid = ppidProp.toUInt();
+                selectedCreateTime = m_selectedGraph->property("CreateTime").toULongLong();
             }
         }
 
@@ -455,7 +762,7 @@ void MainWindow::overlayCursorChangedSlot(QPoint pos)
         if(coord >= 0 && coord < m_times.size())
         {
             uint64_t time = m_times[coord];
-            auto itr = m_timeline.find(time);
+            auto itr = findAtOrBefore(m_timeline, time);
             if(itr != m_timeline.end())
             {
                 QString info;
@@ -476,7 +783,7 @@ void MainWindow::overlayCursorChangedSlot(QPoint pos)
                     pagefileUsageSum += data.pagefileUsage;
                     if(info.size())
                         info += "\n";
-                    auto selected = up.pid == selectedPid && up.ppid == selectedPpid;
+                    auto selected = up.pid == selectedPid && up.ppid == selectedPpid && up.createTime == selectedCreateTime;
                     if (selected)
                         info += "<b>";
                     info += QString("%1 (PID: %2, Parent: %3):\n  Memory usage: %4\n  Pagefile usage: %5 (%6)\n  CPU: %7\n")
@@ -487,6 +794,49 @@ void MainWindow::overlayCursorChangedSlot(QPoint pos)
                             .arg(humanReadableSize(data.pagefileUsage))
                             .arg(humanReadableSize((data.pagefileUsage >= data.memoryUsage) * (data.pagefileUsage - data.memoryUsage)))
                             .arg(QString::number(data.cpuUsage, 'f', 3));
+                    if(data.cpuTime)
+                        info += QString("  CPU time: %1 s\n").arg(QString::number(data.cpuTime / 1e7, 'f', 3));
+                    if(data.readBytes || data.writeBytes)
+                    {
+                        info += QString("  I/O read: %1/s (%2 ops/s), write: %3/s (%4 ops/s)\n")
+                                .arg(humanReadableSize(data.readBytes))
+                                .arg(data.readOperations)
+                                .arg(humanReadableSize(data.writeBytes))
+                                .arg(data.writeOperations);
+                    }
+                    // Totals of the subtree, written with the samples of the tick
+                    auto rollups = m_rollups.find(up);
+                    if(rollups != m_rollups.end())
+                    {
+                        auto rollup = rollups->second.find(itr->first);
+                        if(rollup != rollups->second.end())
+                        {
+                            const RollupData& r = rollup->second;
+                            info += QString("  Subtree: %1 processes, memory usage: %2, private usage: %3, CPU: %4\n")
+                                    .arg(r.processCount)
+                                    .arg(humanReadableSize(r.memoryUsage))
+                                    .arg(humanReadableSize(r.privateUsage))
+                                    .arg(QString::number(r.cpuUsage, 'f', 3));
+                        }
+                    }
+                    // The breakdown is sampled less often, only the selected process gets it
+                    auto compositions = m_compositions.find(up);
+                    if(selected && compositions != m_compositions.end())
+                    {
+                        auto composition = findAtOrBefore(compositions->second, time);
+                        if(composition != compositions->second.end())
+                        {
+                            const CompositionData& c = composition->second;
+                            info += QString("  Memory composition (%1 ms before): image %2, mapped %3, shareable %4, heap %5, stack %6, private %7\n")
+                                    .arg(time - c.time)
+                                    .arg(humanReadableSize(c.image))
+                                    .arg(humanReadableSize(c.mapped))
+                                    .arg(humanReadableSize(c.shareable))
+                                    .arg(humanReadableSize(c.heap))
+                                    .arg(humanReadableSize(c.stack))
+                                    .arg(humanReadableSize(c.privateData));
+                        }
+                    }
                     if (selected)
                         info += "</b>";
                 }
@@ -494,6 +844,23 @@ void MainWindow::overlayCursorChangedSlot(QPoint pos)
                         .arg(humanReadableSize(memoryUsageSum))
                         .arg(humanReadableSize(pagefileUsageSum))
                         .arg(humanReadableSize((pagefileUsageSum >= memoryUsageSum) * (pagefileUsageSum - memoryUsageSum)));
+                auto overhead = findAtOrBefore(m_overhead, time);
+                if(overhead != m_overhead.end())
+                {
+                    const OverheadData& o = overhead->second;
+                    info += QString("\n\nSampler overhead: %1 ms\n  Snapshot: %2 ms\n  Queries: %3 (%4 ms)\n  Queueing: %5 ms (backlog: %6 records)\n  Writing: %7 ms\n  Onlooker CPU: %8, memory usage: %9\n  Missed deadlines: %10, dropped ticks: %11")
+                            .arg(QString::number(o.totalTime() / 1000.0, 'f', 3))
+                            .arg(QString::number(o.snapshotTime / 1000.0, 'f', 3))
+                            .arg(o.queryCount)
+                            .arg(QString::number(o.queryTime / 1000.0, 'f', 3))
+                            .arg(QString::number(o.queueTime / 1000.0, 'f', 3))
+                            .arg(o.queuedRecords)
+                            .arg(QString::number(o.writeTime / 1000.0, 'f', 3))
+                            .arg(QString::number(o.cpuUsage, 'f', 3))
+                            .arg(humanReadableSize(o.workingSetSize))
+                            .arg(o.missedDeadlines)
+                            .arg(o.droppedTicks);
+                }
                 m_informationDialog->setInformationText(info);
                 if(!m_hasOpenedInformation)
                 {
@@ -540,19 +907,19 @@ void MainWindow::on_actionLoad_JSON_triggered()
 {
     QSettings settings;
     QString directory = settings.value("BrowseDirectory").toString();
-    auto jsonFile = QFileDialog::getOpenFileName(this, tr("Data JSON"), directory, tr("Data JSON (*.json)"));
-    if(jsonFile.isEmpty())
+    auto traceFile = QFileDialog::getOpenFileName(this, tr("Data"), directory, tr("Onlooker trace (*.json *.olt *.json.gz *.olt.gz)"));
+    if(traceFile.isEmpty())
         return;
-    settings.setValue("BrowseDirectory", QFileInfo(jsonFile).absoluteDir().absolutePath());
-    jsonFile = QDir::toNativeSeparators(jsonFile);
-    loadJsonChart(jsonFile);
+    settings.setValue("BrowseDirectory", QFileInfo(traceFile).absoluteDir().absolutePath());
+    traceFile = QDir::toNativeSeparators(traceFile);
+    loadChart(traceFile);
 }
 
 void MainWindow::on_actionLoad_Log_JSON_triggered()
 {
     QSettings settings;
     QString directory = settings.value("BrowseDirectory").toString();
-    auto jsonFile = QFileDialog::getOpenFileName(this, tr("Log JSON"), directory, tr("Log JSON (*.json)"));
+    auto jsonFile = QFileDialog::getOpenFileName(this, tr("Log JSON"), directory, tr("Log JSON (*.json *.json.gz)"));
     if(jsonFile.isEmpty())
         return;
     settings.setValue("BrowseDirectory", QFileInfo(jsonFile).absoluteDir().absolutePath());
@@ -570,6 +937,14 @@ void MainWindow::on_action_Log_triggered()
     m_logDialog->show();
 }
 
+void MainWindow::on_actionPlot_overhead_toggled(bool checked)
+{
+    QSettings settings;
+    settings.setValue("PlotOverhead", checked);
+    if(!m_timeline.empty())
+        QMessageBox::information(this, tr("Information"), tr("Reload the data to change the plot."));
+}
+
 void MainWindow::on_actionPlot_pagefile_toggled(bool checked)
 {
     QSettings settings;
@@ -577,3 +952,123 @@ void MainWindow::on_actionPlot_pagefile_toggled(bool checked)
     if(!m_timeline.empty())
         QMessageBox::information(this, tr("Information"), tr("Reload the data to change the plot."));
 }
+
+void MainWindow::on_actionPlot_io_toggled(bool checked)
+{
+    QSettings settings;
+    settings.setValue("PlotIo", checked);
+    if(!m_timeline.empty())
+        QMessageBox::information(this, tr("Information"), tr("Reload the data to change the plot."));
+}
+
+void MainWindow::on_actionWatch_live_triggered()
+{
+    QSettings settings;
+    bool ok = false;
+    auto name = QInputDialog::getText(this, tr("Watch live"), tr("Name passed to Onlooker in ONLOOKER_LIVE:"), QLineEdit::Normal, settings.value("LiveName", "onlooker").toString(), &ok);
+    if(!ok || name.isEmpty())
+        return;
+    settings.setValue("LiveName", name);
+    QString error;
+    if(!m_live->listen(name, error))
+    {
+        QMessageBox::warning(this, tr("Error"), tr("Failed to listen on '%1':\n%2").arg(name).arg(error));
+        return;
+    }
+    setWindowTitle(tr("%1 - waiting for Onlooker on '%2'").arg(m_windowTitle).arg(name));
+}
+
+void MainWindow::liveStartedSlot()
+{
+    m_sortedProcesses.clear();
+    m_timeline.clear();
+    m_times.clear();
+    m_overhead.clear();
+    m_compositions.clear();
+    m_rollups.clear();
+    m_liveBars.clear();
+    m_liveTopBars = nullptr;
+    m_liveTickTime = 0;
+    m_liveMaxSum = 0;
+    m_livePagefile = getPlotPagefileSetting();
+
+    // Only the memory is plotted, the bars are appended as the ticks arrive
+    auto customPlot = createPlot();
+    setupAxes(customPlot, m_livePagefile);
+    customPlot->xAxis->setRange(0, 1);
+    customPlot->yAxis->setRange(0, 1024 * 1024 * 10);
+    showPlot(customPlot);
+    setWindowTitle(tr("%1 - live on '%2'").arg(m_windowTitle).arg(m_live->name()));
+}
+
+void MainWindow::liveReceivedSlot(const TraceData& data)
+{
+    if(!m_customPlot)
+        return;
+
+    // The overhead record closes a tick, the samples up to it are complete
+    for(const OverheadData& overhead : data.overhead)
+    {
+        m_overhead[overhead.time] = overhead;
+        m_liveTickTime = qMax(m_liveTickTime, overhead.time);
+    }
+    for(const auto& process : data.compositions)
+    {
+        for(const CompositionData& composition : process.second)
+            m_compositions[process.first][composition.time] = composition;
+    }
+    for(const auto& process : data.rollups)
+    {
+        for(const RollupData& rollup : process.second)
+            m_rollups[process.first][rollup.time] = rollup;
+    }
+    for(const auto& process : data.processes)
+    {
+        if(!m_liveBars.count(process.first))
+        {
+            // new processes are stacked on top
+            SortedProcess s;
+            s.uniqueProcess = process.first;
+            m_sortedProcesses.push_back(s);
+            auto bars = addProcessBars(m_customPlot, process.first, m_liveBars.size(), m_liveTopBars);
+            m_liveBars[process.first] = bars;
+            m_liveTopBars = bars;
+        }
+        for(const ProcessData& sample : process.second)
+            m_timeline[sample.time][process.first] = sample;
+    }
+
+    auto xRange = m_customPlot->xAxis->range();
+    auto following = xRange.upper >= m_times.size();
+    auto event = m_times.empty() ? m_timeline.begin() : m_timeline.upper_bound(m_times.back());
+    for(; event != m_timeline.end() && event->first <= m_liveTickTime; ++event)
+    {
+        double key = m_times.size();
+        uint64_t eventSum = 0;
+        for(const auto& bars : m_liveBars)
+        {
+            // zero where the process is not present
+            auto& p = event->second[bars.first];
+            p.time = event->first;
+            auto memoryUsage = m_livePagefile ? p.pagefileUsage : p.memoryUsage;
+            eventSum += memoryUsage;
+            bars.second->addData(key, memoryUsage);
+        }
+        m_liveMaxSum = qMax(m_liveMaxSum, eventSum);
+        m_times.push_back(event->first);
+    }
+
+    if(m_liveMaxSum)
+        setMemoryRange(m_customPlot, m_liveMaxSum);
+    // keep scrolling along unless the user zoomed into the past
+    if(following)
+        m_customPlot->xAxis->setRange(qMax(0.0, xRange.lower), qMax<double>(xRange.upper, m_times.size()));
+    m_customPlot->replot(QCustomPlot::rpQueuedReplot);
+}
+
+void MainWindow::liveFinishedSlot(const QString& error)
+{
+    setWindowTitle(tr("%1 - live on '%2' (finished)").arg(m_windowTitle).arg(m_live->name()));
+    if(!error.isEmpty())
+        QMessageBox::warning(this, tr("Error"), tr("Failed to read the live trace:\n%1").arg(error));
+}
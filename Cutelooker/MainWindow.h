@@ -6,6 +6,7 @@
 #include "OnlookerData.h"
 #include "InformationDialog.h"
 #include "LogDialog.h"
+#include "LiveTrace.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
@@ -25,19 +26,33 @@ protected:
     void dropEvent(QDropEvent* event);
 
 private:
-    void loadJsonChart(const QString& jsonFile);
+    void loadChart(const QString& traceFile);
+    bool readJsonTrace(const QByteArray& bytes, TraceData& trace);
     void loadJsonLog(const QString& jsonFile);
     bool getPlotPagefileSetting() const;
+    bool getPlotOverheadSetting() const;
+    bool getPlotIoSetting() const;
+    QCustomPlot* createPlot();
+    QCPBars* addProcessBars(QCustomPlot* customPlot, const UniqueProcess& process, size_t index, QCPBars* below);
+    void setupAxes(QCustomPlot* customPlot, bool plotPagefile);
+    void setMemoryRange(QCustomPlot* customPlot, uint64_t maxSum);
+    void showPlot(QCustomPlot* customPlot);
 
 private slots:
     void overlayCursorChangedSlot(QPoint pos);
     void logSelectionChangedSlot(uint64_t time);
+    void liveStartedSlot();
+    void liveReceivedSlot(const TraceData& data);
+    void liveFinishedSlot(const QString& error);
 
     void on_actionLoad_JSON_triggered();
     void on_actionLoad_Log_JSON_triggered();
     void on_actionInformation_triggered();
     void on_action_Log_triggered();
     void on_actionPlot_pagefile_toggled(bool arg1);
+    void on_actionPlot_overhead_toggled(bool arg1);
+    void on_actionPlot_io_toggled(bool arg1);
+    void on_actionWatch_live_triggered();
 
 private:
     Ui::MainWindow* ui = nullptr;
@@ -54,4 +69,14 @@ private:
     std::vector<SortedProcess> m_sortedProcesses;
     std::map<uint64_t, std::map<UniqueProcess, ProcessData>> m_timeline;
     std::vector<uint64_t> m_times;
+    std::map<uint64_t, OverheadData> m_overhead;
+    std::map<UniqueProcess, std::map<uint64_t, CompositionData>> m_compositions; // by time
+    std::map<UniqueProcess, std::map<uint64_t, RollupData>> m_rollups; // by time
+
+    LiveTrace* m_live = nullptr;
+    std::map<UniqueProcess, QCPBars*> m_liveBars;
+    QCPBars* m_liveTopBars = nullptr;
+    uint64_t m_liveTickTime = 0; // last tick that is complete
+    uint64_t m_liveMaxSum = 0;
+    bool m_livePagefile = false;
 };
@@ -5,16 +5,19 @@
 #include <cstddef>
 #include <tuple>
 #include <iterator>
+#include <map>
+#include <vector>
 
 struct UniqueProcess
 {
     uint32_t pid = -1;
     uint32_t ppid = -1;
     QString name;
+    uint64_t createTime = 0; // tells processes with a reused pid apart
 
     bool operator<(const UniqueProcess& o) const
     {
-        return std::tie(pid, ppid, name) < std::tie(o.pid, o.ppid, o.name);
+        return std::tie(pid, ppid, name, createTime) < std::tie(o.pid, o.ppid, o.name, o.createTime);
     }
 };
 
@@ -24,6 +27,65 @@ struct ProcessData
     uint64_t memoryUsage = 0;
     uint64_t pagefileUsage = 0;
     double cpuUsage = 0.0;
+    // I/O per second since the previous sample
+    uint64_t readBytes = 0;
+    uint64_t writeBytes = 0;
+    uint64_t readOperations = 0;
+    uint64_t writeOperations = 0;
+    // Totals since the process started, 0 in older traces
+    uint64_t cpuTime = 0; // kernel and user, 100ns units
+    uint64_t cycleTime = 0; // 0 when not counted
+};
+
+// Sampler overhead of a tick, durations in microseconds
+struct OverheadData
+{
+    uint64_t time = 0;
+    uint64_t tick = 0; // number of the tick on the schedule grid, gaps are missed ticks
+    uint32_t interval = 0;
+    uint64_t snapshotTime = 0;
+    uint32_t queryCount = 0;
+    uint64_t queryTime = 0;
+    uint64_t writeTime = 0; // by the writer thread
+    uint64_t queueTime = 0; // handing the tick to the writer thread
+    uint32_t queuedRecords = 0;
+    double cpuUsage = 0.0;
+    uint64_t workingSetSize = 0;
+    uint32_t missedDeadlines = 0;
+    uint32_t droppedTicks = 0; // because the writer thread fell behind
+
+    uint64_t totalTime() const { return snapshotTime + queryTime + queueTime + writeTime; }
+};
+
+// Memory of a process by origin in bytes, sampled less often than ProcessData
+struct CompositionData
+{
+    uint64_t time = 0;
+    uint64_t image = 0;
+    uint64_t mapped = 0;
+    uint64_t shareable = 0; // not backed by a file
+    uint64_t heap = 0;
+    uint64_t stack = 0;
+    uint64_t privateData = 0;
+};
+
+// Totals of a process and its descendants in a tick, only processes with children have them
+struct RollupData
+{
+    uint64_t time = 0;
+    uint64_t memoryUsage = 0;
+    uint64_t privateUsage = 0;
+    double cpuUsage = 0.0;
+    uint32_t processCount = 0; // including the process itself
+};
+
+// Everything read from a trace file
+struct TraceData
+{
+    std::map<UniqueProcess, std::vector<ProcessData>> processes;
+    std::vector<OverheadData> overhead;
+    std::map<UniqueProcess, std::vector<CompositionData>> compositions;
+    std::map<UniqueProcess, std::vector<RollupData>> rollups;
 };
 
 struct SortedProcess
@@ -0,0 +1,126 @@
+#include "TraceFile.h"
+
+#ifdef ONLOOKER_ZLIB
+#include <zlib.h>
+#endif // ONLOOKER_ZLIB
+
+static const int ChunkSize = 1024 * 1024;
+
+#ifdef ONLOOKER_ZLIB
+struct TraceFile::Inflater
+{
+    z_stream stream = { };
+
+    Inflater()
+    {
+        // 15 bits of window, +16 for a gzip header
+        inflateInit2(&stream, 15 + 16);
+    }
+
+    ~Inflater()
+    {
+        inflateEnd(&stream);
+    }
+};
+#else
+struct TraceFile::Inflater
+{
+};
+#endif // ONLOOKER_ZLIB
+
+TraceFile::TraceFile() = default;
+
+TraceFile::~TraceFile() = default;
+
+bool TraceFile::open(const QString& fileName, QString& error)
+{
+    m_file.setFileName(fileName);
+    if(!m_file.open(QFile::ReadOnly))
+    {
+        error = m_file.errorString();
+        return false;
+    }
+    auto magic = m_file.peek(2);
+    if(magic.size() == 2 && quint8(magic[0]) == 0x1f && quint8(magic[1]) == 0x8b)
+    {
+#ifdef ONLOOKER_ZLIB
+        m_inflater = std::make_unique<Inflater>();
+#else
+        error = "Compressed file, Cutelooker was built without zlib";
+        return false;
+#endif // ONLOOKER_ZLIB
+    }
+    return true;
+}
+
+bool TraceFile::read(QByteArray& chunk, QString& error)
+{
+    chunk.clear();
+    if(!m_inflater)
+    {
+        chunk = m_file.read(ChunkSize);
+        if(chunk.isEmpty() && m_file.error() != QFile::NoError)
+        {
+            error = m_file.errorString();
+            return false;
+        }
+        return true;
+    }
+#ifdef ONLOOKER_ZLIB
+    z_stream& stream = m_inflater->stream;
+    while(chunk.isEmpty() && !m_end)
+    {
+        if(stream.avail_in == 0)
+        {
+            m_input = m_file.read(ChunkSize);
+            if(m_input.isEmpty())
+            {
+                m_end = true;
+                break;
+            }
+            stream.next_in = (Bytef*)m_input.data();
+            stream.avail_in = uInt(m_input.size());
+        }
+        chunk.resize(ChunkSize);
+        stream.next_out = (Bytef*)chunk.data();
+        stream.avail_out = uInt(chunk.size());
+        auto result = inflate(&stream, Z_NO_FLUSH);
+        chunk.resize(ChunkSize - int(stream.avail_out));
+        if(result == Z_STREAM_END)
+        {
+            // Another gzip member may follow
+            inflateReset(&stream);
+        }
+        else if(result != Z_OK && result != Z_BUF_ERROR)
+        {
+            error = QString("Failed to decompress: %1").arg(stream.msg ? stream.msg : "corrupt data");
+            chunk.clear();
+            return false;
+        }
+    }
+#endif // ONLOOKER_ZLIB
+    return true;
+}
+
+bool TraceFile::readAll(QByteArray& data, QString& error)
+{
+    data.clear();
+    if(!m_inflater)
+    {
+        data = m_file.readAll();
+        if(m_file.error() != QFile::NoError)
+        {
+            error = m_file.errorString();
+            return false;
+        }
+        return true;
+    }
+    QByteArray chunk;
+    do
+    {
+        if(!read(chunk, error))
+            return false;
+        data.append(chunk);
+    } while(!chunk.isEmpty());
+    return true;
+}
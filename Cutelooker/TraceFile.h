@@ -0,0 +1,33 @@
+#pragma once
+
+#include <QFile>
+#include <QString>
+#include <QByteArray>
+
+#include <memory>
+
+// Reads a trace or log of Onlooker in chunks. Files compressed with ONLOOKER_COMPRESS (gzip)
+// are decompressed while reading, so a compressed trace is never in memory as a whole.
+class TraceFile
+{
+public:
+    TraceFile();
+    ~TraceFile();
+
+    bool open(const QString& fileName, QString& error);
+    bool isCompressed() const { return m_inflater != nullptr; }
+
+    // The next chunk of the content, empty at the end. A gzip stream that ends early, like
+    // the one of a killed run, ends the content without an error.
+    bool read(QByteArray& chunk, QString& error);
+    // The rest of the content at once, for the formats that have to be parsed as a whole
+    bool readAll(QByteArray& data, QString& error);
+
+private:
+    struct Inflater;
+
+    QFile m_file;
+    std::unique_ptr<Inflater> m_inflater;
+    QByteArray m_input;
+    bool m_end = false;
+};
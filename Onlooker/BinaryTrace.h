@@ -0,0 +1,163 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+/*
+Binary trace format (.olt). Unless noted otherwise integers are unsigned LEB128 varints.
+
+  header:  "OLTRACE\0", version (uint32 little endian)
+  records: type, payload size, payload
+
+  String (1):  UTF-8 bytes. Strings are numbered in order of appearance.
+  Process (2): pid, ppid, string index of the name, creation time (only meaningful to tell
+               processes with the same pid apart). Processes are numbered in order of appearance.
+  Samples (3): process index, sample count n, time of the first sample (ms since epoch),
+               n - 1 time deltas, then n values for every column in BinaryTraceColumn order.
+               Each column value is XOR-ed with the previous value in the same column
+               (the first one with 0), so counters that did not change take a single byte.
+
+  Overhead (4): sample count n, time of the first sample, n - 1 time deltas, then n values for
+               every column in BinaryTraceOverheadColumn order, encoded like the Samples columns.
+
+  Thread (5):  process index, thread id, string index of the name, creation time. Threads are
+               numbered in order of appearance.
+  Threads (6): time of the tick, thread count n, then n rows of thread index followed by the
+               values of every column in BinaryTraceThreadColumn order. One record per tick, it
+               only has the threads that ran or were switched to since the previous tick.
+
+  Composition (7): process index, time, then the bytes of every category in
+               BinaryTraceCompositionColumn order. Written by the slow sampling tier, a
+               process has far fewer of them than samples.
+
+  Rollup (8):  process index, time, then the values of every column in BinaryTraceRollupColumn
+               order. Totals of the subtree of a process in a tick, only written for the
+               processes with sampled descendants.
+
+  Summary (9): process index, then the values of every column in BinaryTraceSummaryColumn
+               order. Aggregates of a process over the whole run, written once per process
+               after its last samples.
+  TreeSummary (10): the values of every column in BinaryTraceSummaryColumn order, aggregated
+               over all processes. Written after the summaries of the processes, a trace
+               that ends without it was not closed.
+
+A process has as many Samples records as needed, they are written in time order. Readers
+skip unknown record types, ignore trailing fields of known records they do not know about
+and ignore a truncated record at the end of the file.
+*/
+
+static const char BinaryTraceMagic[8] = { 'O', 'L', 'T', 'R', 'A', 'C', 'E', '\0' };
+static const uint32_t BinaryTraceVersion = 1;
+
+enum BinaryTraceRecord : uint8_t
+{
+	RecordString = 1,
+	RecordProcess = 2,
+	RecordSamples = 3,
+	RecordOverhead = 4,
+	RecordThread = 5,
+	RecordThreads = 6,
+	RecordComposition = 7,
+	RecordRollup = 8,
+	RecordSummary = 9,
+	RecordTreeSummary = 10,
+};
+
+enum BinaryTraceColumn
+{
+	ColumnCpuUsage, // 1/100 percent
+	ColumnPageFaultCount,
+	ColumnPeakWorkingSetSize,
+	ColumnWorkingSetSize,
+	ColumnQuotaPeakPagedPoolUsage,
+	ColumnQuotaPagedPoolUsage,
+	ColumnQuotaPeakNonPagedPoolUsage,
+	ColumnQuotaNonPagedPoolUsage,
+	ColumnPagefileUsage,
+	ColumnPeakPagefileUsage,
+	ColumnPrivateUsage,
+	ColumnReadBytes, // per second since the previous sample
+	ColumnWriteBytes,
+	ColumnReadOperations,
+	ColumnWriteOperations,
+	ColumnCpuTime, // kernel and user since the process started, 100ns units
+	ColumnCycleTime, // since the process started, 0 when not counted
+	ColumnCount,
+};
+
+// Sampler overhead of a tick, durations in microseconds
+enum BinaryTraceOverheadColumn
+{
+	OverheadSnapshotTime,
+	OverheadQueryCount,
+	OverheadQueryTime,
+	OverheadWriteTime,
+	OverheadCpuUsage, // 1/100 percent
+	OverheadWorkingSetSize,
+	OverheadMissedDeadlines,
+	OverheadTick, // number of the tick on the schedule grid
+	OverheadInterval,
+	OverheadQueueTime, // handing the tick to the writer thread
+	OverheadQueuedRecords,
+	OverheadDroppedTicks,
+	OverheadColumnCount,
+};
+
+// Usages are in 1/100 percent of one processor since the previous tick
+enum BinaryTraceThreadColumn
+{
+	ThreadColumnUserUsage,
+	ThreadColumnKernelUsage,
+	ThreadColumnContextSwitches, // since the previous tick
+	ThreadColumnState, // ThreadState
+	ThreadColumnWaitReason, // KWAIT_REASON on Windows
+	ThreadColumnCount,
+};
+
+// Memory of a process by origin, in bytes
+enum BinaryTraceCompositionColumn
+{
+	CompositionImage,
+	CompositionMapped,
+	CompositionShareable, // not backed by a file
+	CompositionHeap,
+	CompositionStack,
+	CompositionPrivate,
+	CompositionColumnCount,
+};
+
+// Totals of a process and its tracked descendants
+enum BinaryTraceRollupColumn
+{
+	RollupWorkingSetSize,
+	RollupPrivateUsage,
+	RollupCpuUsage, // 1/100 percent
+	RollupProcessCount, // including the process itself
+	RollupColumnCount,
+};
+
+// Aggregates over the whole run, the peaks of a tree summary are those of the sums of a tick
+enum BinaryTraceSummaryColumn
+{
+	SummaryStartTime, // first sample, ms since epoch
+	SummaryEndTime, // last sample
+	SummaryPeakWorkingSetSize,
+	SummaryPeakPrivateUsage,
+	SummaryPeakTime, // of the peak working set
+	SummaryWorkingSetIntegral, // bytes * seconds
+	SummaryCpuTime, // kernel and user, 100ns units
+	SummaryProcessCount,
+	SummaryExitCode, // 32-bit exit code + 1, 0 when not known
+	SummaryColumnCount,
+};
+
+static inline void writeVarint(std::vector<uint8_t>& out, uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		out.push_back(uint8_t(value) | 0x80);
+		value >>= 7;
+	}
+	out.push_back(uint8_t(value));
+}
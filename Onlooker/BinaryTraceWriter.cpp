@@ -0,0 +1,405 @@
+#include "TraceWriter.h"
+#include "BinaryTrace.h"
+#include "FlatHashMap.h"
+#include "Compression.h"
+
+#include <cmath>
+
+#include <algorithm>
+
+class BinaryTraceWriter : public TraceWriter
+{
+	// Samples are buffered per process and written as a block
+	static const size_t BlockSize = 512;
+	// Pending blocks are written at least this often (ms), so a killed run loses little
+	static const uint64_t FlushInterval = 1000;
+
+	FILE* m_traceFile = nullptr;
+	bool m_live = false; // streamed to a viewer, every tick is written right away
+	bool m_success = true; // all records were written
+	FlatHashMap<const std::string*, uint32_t> m_strings; // interned name -> string index
+	uint32_t m_processCount = 0;
+	std::vector<uint32_t> m_processIndices; // index of the caller -> process index in the trace
+	std::vector<std::vector<ProcessData>> m_pending; // process index -> samples
+	std::vector<OverheadData> m_pendingOverhead;
+	uint32_t m_threadCount = 0;
+	std::vector<uint32_t> m_threadIndices; // index of the caller -> thread index in the trace
+	std::vector<uint8_t> m_threadRows; // of the current tick
+	uint32_t m_threadRowCount = 0;
+	uint64_t m_threadTime = 0;
+	std::vector<uint8_t> m_record;
+	std::vector<uint8_t> m_header;
+	uint64_t m_lastTime = 0;
+	uint64_t m_lastFlush = 0;
+	bool m_summaries = false; // started writing the summaries
+
+	static uint64_t column(const ProcessData& data, size_t column)
+	{
+		const MemoryCounters& memory = data.memory;
+		switch (column)
+		{
+		case ColumnCpuUsage:
+			return uint64_t(std::llround(std::max(data.cpuUsage, 0.0) * 100.0));
+		case ColumnPageFaultCount:
+			return memory.pageFaultCount;
+		case ColumnPeakWorkingSetSize:
+			return memory.peakWorkingSetSize;
+		case ColumnWorkingSetSize:
+			return memory.workingSetSize;
+		case ColumnQuotaPeakPagedPoolUsage:
+			return memory.quotaPeakPagedPoolUsage;
+		case ColumnQuotaPagedPoolUsage:
+			return memory.quotaPagedPoolUsage;
+		case ColumnQuotaPeakNonPagedPoolUsage:
+			return memory.quotaPeakNonPagedPoolUsage;
+		case ColumnQuotaNonPagedPoolUsage:
+			return memory.quotaNonPagedPoolUsage;
+		case ColumnPagefileUsage:
+			return memory.pagefileUsage;
+		case ColumnPeakPagefileUsage:
+			return memory.peakPagefileUsage;
+		case ColumnPrivateUsage:
+			return memory.privateUsage;
+		case ColumnReadBytes:
+			return data.io.readBytes;
+		case ColumnWriteBytes:
+			return data.io.writeBytes;
+		case ColumnReadOperations:
+			return data.io.readOperations;
+		case ColumnWriteOperations:
+			return data.io.writeOperations;
+		case ColumnCpuTime:
+			return data.cpuTime;
+		case ColumnCycleTime:
+			return data.cycleTime;
+		default:
+			return 0;
+		}
+	}
+
+	static uint64_t column(const OverheadData& overhead, size_t column)
+	{
+		switch (column)
+		{
+		case OverheadSnapshotTime:
+			return overhead.snapshotTime;
+		case OverheadQueryCount:
+			return overhead.queryCount;
+		case OverheadQueryTime:
+			return overhead.queryTime;
+		case OverheadWriteTime:
+			return overhead.writeTime;
+		case OverheadCpuUsage:
+			return uint64_t(std::llround(std::max(overhead.cpuUsage, 0.0) * 100.0));
+		case OverheadWorkingSetSize:
+			return overhead.workingSetSize;
+		case OverheadMissedDeadlines:
+			return overhead.missedDeadlines;
+		case OverheadTick:
+			return overhead.tick;
+		case OverheadInterval:
+			return overhead.interval;
+		case OverheadQueueTime:
+			return overhead.queueTime;
+		case OverheadQueuedRecords:
+			return overhead.queuedRecords;
+		case OverheadDroppedTicks:
+			return overhead.droppedTicks;
+		default:
+			return 0;
+		}
+	}
+
+	static uint64_t column(const ThreadData& data, size_t column)
+	{
+		switch (column)
+		{
+		case ThreadColumnUserUsage:
+			return uint64_t(std::llround(data.userUsage * 100.0));
+		case ThreadColumnKernelUsage:
+			return uint64_t(std::llround(data.kernelUsage * 100.0));
+		case ThreadColumnContextSwitches:
+			return data.contextSwitches;
+		case ThreadColumnState:
+			return uint64_t(data.state);
+		case ThreadColumnWaitReason:
+			return data.waitReason;
+		default:
+			return 0;
+		}
+	}
+
+	void writeRecord(BinaryTraceRecord type)
+	{
+		m_header.clear();
+		writeVarint(m_header, type);
+		writeVarint(m_header, m_record.size());
+		m_success = fwrite(m_header.data(), 1, m_header.size(), m_traceFile) == m_header.size() && m_success;
+		m_success = fwrite(m_record.data(), 1, m_record.size(), m_traceFile) == m_record.size() && m_success;
+		m_record.clear();
+	}
+
+	uint32_t internString(const std::string* str)
+	{
+		if (auto existing = m_strings.find(str))
+			return *existing;
+		auto index = uint32_t(m_strings.size());
+		m_strings[str] = index;
+		m_record.assign(str->begin(), str->end());
+		writeRecord(RecordString);
+		return index;
+	}
+
+	template <typename T>
+	void writeColumns(const std::vector<T>& samples, size_t columnCount)
+	{
+		writeVarint(m_record, samples.size());
+		writeVarint(m_record, samples[0].time);
+		for (size_t i = 1; i < samples.size(); i++)
+			writeVarint(m_record, samples[i].time - samples[i - 1].time);
+		for (size_t c = 0; c < columnCount; c++)
+		{
+			uint64_t previous = 0;
+			for (const T& data : samples)
+			{
+				auto value = column(data, c);
+				writeVarint(m_record, value ^ previous);
+				previous = value;
+			}
+		}
+	}
+
+	void writeBlock(uint32_t index, const std::vector<ProcessData>& samples)
+	{
+		writeVarint(m_record, index);
+		writeColumns(samples, ColumnCount);
+		writeRecord(RecordSamples);
+	}
+
+	void writeOverhead()
+	{
+		writeColumns(m_pendingOverhead, OverheadColumnCount);
+		writeRecord(RecordOverhead);
+		m_pendingOverhead.clear();
+	}
+
+	// The summaries are the end of the trace, after everything that is still pending
+	void startSummaries()
+	{
+		if (m_summaries)
+			return;
+		flushPending();
+		m_summaries = true;
+	}
+
+	void writeSummary(const SummaryData& data)
+	{
+		uint64_t columns[SummaryColumnCount] = { };
+		columns[SummaryStartTime] = data.startTime;
+		columns[SummaryEndTime] = data.endTime;
+		columns[SummaryPeakWorkingSetSize] = data.peakWorkingSetSize;
+		columns[SummaryPeakPrivateUsage] = data.peakPrivateUsage;
+		columns[SummaryPeakTime] = data.peakTime;
+		columns[SummaryWorkingSetIntegral] = uint64_t(std::llround(data.workingSetIntegral / 1000.0));
+		columns[SummaryCpuTime] = data.cpuTime;
+		columns[SummaryProcessCount] = data.processCount;
+		columns[SummaryExitCode] = data.hasExitCode ? uint64_t(uint32_t(data.exitCode)) + 1 : 0;
+		for (auto column : columns)
+			writeVarint(m_record, column);
+	}
+
+	// The indices of the caller can have gaps, the trace numbers processes in order of appearance
+	uint32_t traceIndex(uint32_t processIndex, const UniqueProcess& process)
+	{
+		if (processIndex >= m_processIndices.size())
+			m_processIndices.resize(processIndex + 1, uint32_t(-1));
+		auto& index = m_processIndices[processIndex];
+		if (index == uint32_t(-1))
+		{
+			index = m_processCount;
+			auto name = internString(process.name);
+			writeVarint(m_record, process.pid);
+			writeVarint(m_record, process.ppid);
+			writeVarint(m_record, name);
+			writeVarint(m_record, process.createTime);
+			writeRecord(RecordProcess);
+			m_processCount++;
+			m_pending.resize(m_processCount);
+		}
+		return index;
+	}
+
+	void flushPending()
+	{
+		for (uint32_t index = 0; index < m_pending.size(); index++)
+		{
+			auto& pending = m_pending[index];
+			if (!pending.empty())
+			{
+				writeBlock(index, pending);
+				pending.clear();
+			}
+			else if (pending.capacity())
+			{
+				// No samples since the last flush, the process exited
+				std::vector<ProcessData>().swap(pending);
+			}
+		}
+		if (!m_pendingOverhead.empty())
+			writeOverhead();
+		m_success = fflush(m_traceFile) == 0 && m_success;
+		m_lastFlush = m_lastTime;
+	}
+
+public:
+	BinaryTraceWriter() = default;
+
+	explicit BinaryTraceWriter(FILE* liveStream) :
+		m_traceFile(liveStream),
+		m_live(true)
+	{
+	}
+
+	~BinaryTraceWriter() override
+	{
+		if (m_traceFile)
+			fclose(m_traceFile);
+	}
+
+	bool open(const std::string& basename) override
+	{
+		if (!m_live)
+			m_traceFile = openOutput(basename + ".olt");
+		if (!m_traceFile)
+			return false;
+		uint8_t version[4] =
+		{
+			uint8_t(BinaryTraceVersion),
+			uint8_t(BinaryTraceVersion >> 8),
+			uint8_t(BinaryTraceVersion >> 16),
+			uint8_t(BinaryTraceVersion >> 24),
+		};
+		m_success = fwrite(BinaryTraceMagic, 1, sizeof(BinaryTraceMagic), m_traceFile) == sizeof(BinaryTraceMagic);
+		m_success = fwrite(version, 1, sizeof(version), m_traceFile) == sizeof(version) && m_success;
+		m_success = fflush(m_traceFile) == 0 && m_success;
+		return m_success;
+	}
+
+	void addSample(uint32_t processIndex, const UniqueProcess& process, const ProcessData& data) override
+	{
+		auto index = traceIndex(processIndex, process);
+		auto& pending = m_pending[index];
+		pending.push_back(data);
+		if (pending.size() == BlockSize)
+		{
+			writeBlock(index, pending);
+			pending.clear();
+		}
+		m_lastTime = data.time;
+	}
+
+	void addThreadSample(uint32_t processIndex, const UniqueProcess& uniqueProcess, const ThreadData& data) override
+	{
+		auto process = traceIndex(processIndex, uniqueProcess);
+		if (data.index >= m_threadIndices.size())
+			m_threadIndices.resize(data.index + 1, uint32_t(-1));
+		auto& index = m_threadIndices[data.index];
+		if (index == uint32_t(-1))
+		{
+			index = m_threadCount++;
+			auto name = internString(data.name);
+			writeVarint(m_record, process);
+			writeVarint(m_record, data.tid);
+			writeVarint(m_record, name);
+			writeVarint(m_record, data.createTime);
+			writeRecord(RecordThread);
+		}
+
+		writeVarint(m_threadRows, index);
+		for (size_t c = 0; c < ThreadColumnCount; c++)
+			writeVarint(m_threadRows, column(data, c));
+		m_threadRowCount++;
+		m_threadTime = data.time;
+	}
+
+	void addComposition(uint32_t processIndex, const UniqueProcess& process, const CompositionData& data) override
+	{
+		static_assert(int(CompositionColumnCount) == int(MemoryCategoryCount), "composition columns");
+		auto index = traceIndex(processIndex, process);
+		writeVarint(m_record, index);
+		writeVarint(m_record, data.time);
+		for (size_t c = 0; c < CompositionColumnCount; c++)
+			writeVarint(m_record, data.composition.bytes[c]);
+		writeRecord(RecordComposition);
+	}
+
+	void addRollup(uint32_t processIndex, const UniqueProcess& process, const RollupData& data) override
+	{
+		auto index = traceIndex(processIndex, process);
+		writeVarint(m_record, index);
+		writeVarint(m_record, data.time);
+		writeVarint(m_record, data.workingSetSize);
+		writeVarint(m_record, data.privateUsage);
+		writeVarint(m_record, uint64_t(std::llround(std::max(data.cpuUsage, 0.0) * 100.0)));
+		writeVarint(m_record, data.processCount);
+		writeRecord(RecordRollup);
+	}
+
+	void addOverhead(const OverheadData& overhead) override
+	{
+		m_pendingOverhead.push_back(overhead);
+		if (m_pendingOverhead.size() == BlockSize)
+			writeOverhead();
+		m_lastTime = overhead.time;
+	}
+
+	void endTick() override
+	{
+		if (m_threadRowCount)
+		{
+			writeVarint(m_record, m_threadTime);
+			writeVarint(m_record, m_threadRowCount);
+			m_record.insert(m_record.end(), m_threadRows.begin(), m_threadRows.end());
+			writeRecord(RecordThreads);
+			m_threadRows.clear();
+			m_threadRowCount = 0;
+		}
+		if (m_live || m_lastTime - m_lastFlush >= FlushInterval)
+			flushPending();
+	}
+
+	void addSummary(uint32_t processIndex, const UniqueProcess& process, const SummaryData& data) override
+	{
+		auto index = traceIndex(processIndex, process);
+		startSummaries();
+		writeVarint(m_record, index);
+		writeSummary(data);
+		writeRecord(RecordSummary);
+	}
+
+	void addTreeSummary(const SummaryData& data) override
+	{
+		startSummaries();
+		writeSummary(data);
+		writeRecord(RecordTreeSummary);
+	}
+
+	bool close() override
+	{
+		flushPending();
+		auto success = fclose(m_traceFile) == 0 && m_success;
+		m_traceFile = nullptr;
+		// The viewer going away is not an error of the run
+		return success || m_live;
+	}
+};
+
+std::unique_ptr<TraceWriter> createBinaryTraceWriter()
+{
+	return std::make_unique<BinaryTraceWriter>();
+}
+
+std::unique_ptr<TraceWriter> createLiveTraceWriter(FILE* stream)
+{
+	return std::make_unique<BinaryTraceWriter>(stream);
+}
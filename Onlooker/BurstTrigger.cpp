@@ -0,0 +1,139 @@
+#include "BurstTrigger.h"
+#include "Utils.h"
+
+#include <cstdio>
+#include <cctype>
+#include <cstring>
+
+#include <algorithm>
+
+BurstTrigger::BurstTrigger(const std::vector<Rule>& rules)
+{
+	m_rules.resize(rules.size());
+	for (size_t i = 0; i < rules.size(); i++)
+		m_rules[i].rule = rules[i];
+}
+
+// <number>[ms|s], in milliseconds
+static bool parsePeriod(const std::string& str, uint64_t& ms)
+{
+	double value = 0;
+	int length = 0;
+	if (sscanf(str.c_str(), "%lf%n", &value, &length) != 1 || !(value > 0))
+		return false;
+	auto unit = str.c_str() + length;
+	if (strcmp(unit, "s") == 0)
+		value *= 1000;
+	else if (*unit && strcmp(unit, "ms") != 0)
+		return false;
+	ms = std::max<uint64_t>(uint64_t(value), 1);
+	return true;
+}
+
+bool BurstTrigger::parse(const char* str, std::chrono::microseconds& interval, std::chrono::milliseconds& window, std::vector<Rule>& rules)
+{
+	// Whole milliseconds, like the time stamps of the samples
+	unsigned intervalMs = 0;
+	unsigned long long windowMs = 0;
+	int length = 0;
+	if (!isdigit((unsigned char)str[0]) || sscanf(str, "%u,%llu%n", &intervalMs, &windowMs, &length) != 2 || intervalMs == 0 || windowMs == 0 || str[length] != ',')
+		return false;
+	interval = std::chrono::milliseconds(intervalMs);
+	window = std::chrono::milliseconds(windowMs);
+	return parseRules(str + length + 1, rules);
+}
+
+bool BurstTrigger::parseRules(const char* str, std::vector<Rule>& rules)
+{
+	rules.clear();
+	std::string list = str;
+	size_t position = 0;
+	while (position <= list.size())
+	{
+		auto end = list.find(',', position);
+		if (end == std::string::npos)
+			end = list.size();
+		Rule rule;
+		rule.text = list.substr(position, end - position);
+		position = end + 1;
+
+		auto separator = rule.text.find('>');
+		if (separator == std::string::npos)
+			return false;
+		auto metric = rule.text.substr(0, separator);
+		auto threshold = rule.text.substr(separator + 1);
+		if (metric == "private" || metric == "memory")
+		{
+			rule.type = metric == "private" ? Rule::TreePrivate : Rule::TreeMemory;
+			if (!parseSize(threshold, rule.bytes))
+				return false;
+		}
+		else if (metric == "growth")
+		{
+			rule.type = Rule::Growth;
+			auto slash = threshold.find('/');
+			if (slash == std::string::npos || !parseSize(threshold.substr(0, slash), rule.bytes) || !parsePeriod(threshold.substr(slash + 1), rule.period))
+				return false;
+		}
+		else
+		{
+			return false;
+		}
+		rules.push_back(rule);
+	}
+	return !rules.empty();
+}
+
+void BurstTrigger::addSample(ProcessId id, uint64_t time, const MemoryCounters& memory)
+{
+	m_privateUsage += memory.privateUsage;
+	m_workingSetSize += memory.workingSetSize;
+
+	uint64_t value = memory.privateUsage;
+	for (RuleState& state : m_rules)
+	{
+		if (state.rule.type != Rule::Growth)
+			continue;
+		auto& samples = state.windows[id].samples;
+		while (!samples.empty() && samples.back().value >= value)
+			samples.pop_back();
+		samples.push_back({ time, value });
+		while (samples.front().time + state.rule.period < time)
+			samples.pop_front();
+		state.growth = std::max(state.growth, value - samples.front().value);
+	}
+}
+
+void BurstTrigger::processExited(ProcessId id)
+{
+	for (RuleState& state : m_rules)
+		state.windows.erase(id);
+}
+
+const BurstTrigger::Rule* BurstTrigger::endTick()
+{
+	const Rule* fired = nullptr;
+	for (RuleState& state : m_rules)
+	{
+		auto active = false;
+		switch (state.rule.type)
+		{
+		case Rule::TreePrivate:
+			active = m_privateUsage > state.rule.bytes;
+			break;
+		case Rule::TreeMemory:
+			active = m_workingSetSize > state.rule.bytes;
+			break;
+		case Rule::Growth:
+			active = state.growth >= state.rule.bytes;
+			break;
+		}
+		if (active && !state.active && !fired)
+			fired = &state.rule;
+		state.active = active;
+		state.growth = 0;
+	}
+	m_privateUsage = 0;
+	m_workingSetSize = 0;
+	return fired;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "ProcessData.h"
+#include "FlatHashMap.h"
+
+#include <chrono>
+#include <deque>
+#include <string>
+#include <vector>
+
+// Rules on the memory of a tree that start a burst: a short window of fast sampling with
+// the expensive extras (per-thread data, memory composition) that would cost too much for
+// the whole run. They also trigger the dumps of the flight recorder. A rule fires when it
+// becomes true, not for as long as it stays true.
+class BurstTrigger
+{
+public:
+	struct Rule
+	{
+		enum Type
+		{
+			TreePrivate, // private bytes of the tree above the threshold
+			TreeMemory, // working set of the tree above the threshold
+			Growth, // private bytes of a single process grew by the threshold within the period
+		};
+
+		Type type = TreePrivate;
+		uint64_t bytes = 0;
+		uint64_t period = 0; // milliseconds, Growth only
+		std::string text; // as configured, for the log
+	};
+
+	explicit BurstTrigger(const std::vector<Rule>& rules);
+
+	BurstTrigger(const BurstTrigger&) = delete;
+	BurstTrigger& operator=(const BurstTrigger&) = delete;
+
+	// Parse the value of ONLOOKER_BURST: <interval ms>,<window ms>,<rule>[,<rule>...] where a
+	// rule is private><size>, memory><size> or growth><size>/<period> (for example
+	// growth>1G/1s), sizes take a K, M or G suffix and periods an ms or s suffix
+	static bool parse(const char* str, std::chrono::microseconds& interval, std::chrono::milliseconds& window, std::vector<Rule>& rules);
+	// Parse a comma separated list of rules only
+	static bool parseRules(const char* str, std::vector<Rule>& rules);
+
+	// Sampling thread, for every sample of the tree. The time is in milliseconds.
+	void addSample(ProcessId id, uint64_t time, const MemoryCounters& memory);
+	void processExited(ProcessId id);
+
+	// After the samples of a tick: the first rule that became true, nullptr when none did
+	const Rule* endTick();
+
+private:
+	struct GrowthSample
+	{
+		uint64_t time = 0;
+		uint64_t value = 0;
+	};
+
+	// Growth is measured against the minimum of the samples of the last period. Only the
+	// samples that can still become the minimum are kept, so their values increase.
+	struct GrowthWindow
+	{
+		std::deque<GrowthSample> samples;
+	};
+
+	struct RuleState
+	{
+		Rule rule;
+		bool active = false;
+		uint64_t growth = 0; // largest of the current tick
+		FlatHashMap<ProcessId, GrowthWindow> windows;
+	};
+
+	std::vector<RuleState> m_rules;
+	uint64_t m_privateUsage = 0; // of the current tick
+	uint64_t m_workingSetSize = 0;
+};
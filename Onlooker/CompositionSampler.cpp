@@ -0,0 +1,109 @@
+#include "CompositionSampler.h"
+#include "Utils.h"
+
+#include <cstdio>
+
+CompositionSampler::CompositionSampler(ProcessSource& source, std::chrono::milliseconds interval) :
+	m_source(source),
+	m_interval(interval)
+{
+	m_thread = std::thread(&CompositionSampler::samplerThread, this);
+}
+
+CompositionSampler::~CompositionSampler()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wakeup.notify_one();
+	m_thread.join();
+}
+
+bool CompositionSampler::parse(const char* str, std::chrono::milliseconds& interval)
+{
+	unsigned long long ms = 0;
+	if (sscanf(str, "%llu", &ms) != 1 || ms < 10)
+		return false;
+	interval = std::chrono::milliseconds(ms);
+	return true;
+}
+
+void CompositionSampler::setInterval(std::chrono::milliseconds interval)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_interval = interval;
+		m_intervalChanged = true;
+	}
+	m_wakeup.notify_one();
+}
+
+void CompositionSampler::setTargets(const std::vector<Target>& targets)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_targets = targets;
+}
+
+bool CompositionSampler::takeSamples(std::vector<Sample>& samples)
+{
+	if (!m_hasSamples.load(std::memory_order_acquire))
+		return false;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	samples.insert(samples.end(), m_samples.begin(), m_samples.end());
+	m_samples.clear();
+	m_hasSamples = false;
+	return true;
+}
+
+void CompositionSampler::samplerThread()
+{
+	typedef std::chrono::steady_clock Clock;
+	std::vector<Target> targets;
+	std::vector<Sample> samples;
+	// Like the ticks, a walk slower than the interval skips the deadlines it missed
+	auto interval = m_interval;
+	auto deadline = Clock::now() + interval;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wakeup.wait_until(lock, deadline, [this] { return m_stop || m_intervalChanged; });
+			if (m_stop)
+				break;
+			if (m_intervalChanged)
+			{
+				m_intervalChanged = false;
+				interval = m_interval;
+				deadline = Clock::now();
+			}
+			targets = m_targets;
+		}
+
+		samples.clear();
+		for (const Target& target : targets)
+		{
+			if (m_stop)
+				break;
+			Sample sample;
+			sample.id = target.id;
+			sample.pid = target.pid;
+			auto walkStart = monotonicMicroseconds();
+			if (!m_source.queryMemoryComposition(target.pid, target.createTime, sample.composition))
+				continue; // exited or access denied
+			sample.walkTime = monotonicMicroseconds() - walkStart;
+			samples.push_back(sample);
+		}
+		if (!samples.empty())
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_samples.insert(m_samples.end(), samples.begin(), samples.end());
+			m_hasSamples.store(true, std::memory_order_release);
+		}
+
+		auto now = Clock::now();
+		deadline += interval;
+		if (deadline <= now)
+			deadline += ((now - deadline) / interval + 1) * interval;
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "ProcessSource.h"
+#include "ProcessData.h"
+
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+
+// Slow sampling tier: walking the address space of a process is far too expensive for the
+// tick of the monitoring thread, so the tracked processes are walked by a thread of its own
+// on a grid of the given interval. The monitoring thread hands over the processes to walk
+// and picks up the finished walks on its next tick.
+class CompositionSampler
+{
+public:
+	struct Target
+	{
+		ProcessId id = 0;
+		uint32_t pid = 0;
+		uint64_t createTime = 0;
+	};
+
+	struct Sample
+	{
+		ProcessId id = 0;
+		uint32_t pid = 0;
+		uint64_t walkTime = 0; // microseconds
+		MemoryComposition composition;
+	};
+
+	CompositionSampler(ProcessSource& source, std::chrono::milliseconds interval);
+	~CompositionSampler();
+
+	CompositionSampler(const CompositionSampler&) = delete;
+	CompositionSampler& operator=(const CompositionSampler&) = delete;
+
+	// Parse the value of ONLOOKER_MEMORY_COMPOSITION: <interval ms>
+	static bool parse(const char* str, std::chrono::milliseconds& interval);
+
+	// Monitoring thread: walk on a grid of the new interval, starting with a walk right away
+	void setInterval(std::chrono::milliseconds interval);
+
+	// Monitoring thread: the processes to walk from the next walk on
+	void setTargets(const std::vector<Target>& targets);
+
+	// Monitoring thread: append the walks finished since the last call, the lock is only
+	// taken when there are any
+	bool takeSamples(std::vector<Sample>& samples);
+
+private:
+	void samplerThread();
+
+	ProcessSource& m_source;
+
+	std::mutex m_mutex;
+	std::condition_variable m_wakeup;
+	std::atomic<bool> m_stop{ false };
+	std::chrono::milliseconds m_interval;
+	bool m_intervalChanged = false;
+	std::vector<Target> m_targets;
+	std::vector<Sample> m_samples;
+	std::atomic<bool> m_hasSamples{ false };
+	std::thread m_thread; // started last by the constructor
+};
@@ -0,0 +1,330 @@
+#include "Compression.h"
+
+#include <cstring>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#include <io.h>
+#include <fcntl.h>
+#include <share.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/file.h>
+#include <cerrno>
+#endif // _WIN32
+
+#ifdef ONLOOKER_ZLIB
+#include <zlib.h>
+#endif // ONLOOKER_ZLIB
+
+static int compressionLevel = 0;
+static std::mutex compressorsMutex;
+static std::vector<std::thread> compressors;
+static std::atomic<bool> compressionFailed{ false };
+
+bool parseCompression(const char* str, int& level)
+{
+	level = 6;
+	if (strcmp(str, "gzip") == 0)
+		return true;
+	int length = 0;
+	return sscanf(str, "gzip,%d%n", &level, &length) == 1 && str[length] == '\0' && level >= 1 && level <= 9;
+}
+
+FILE* openOutputFile(const std::string& file)
+{
+#ifdef _WIN32
+	return _fsopen(file.c_str(), "wb", _SH_DENYWR);
+#else
+	FILE* fp = fopen(file.c_str(), "wb");
+	// Advisory equivalent of _SH_DENYWR
+	if (fp && flock(fileno(fp), LOCK_EX | LOCK_NB) != 0)
+	{
+		fclose(fp);
+		return nullptr;
+	}
+	return fp;
+#endif // _WIN32
+}
+
+bool compressionSupported()
+{
+#ifdef ONLOOKER_ZLIB
+	return true;
+#else
+	return false;
+#endif // ONLOOKER_ZLIB
+}
+
+void setOutputCompression(int level)
+{
+	compressionLevel = level;
+}
+
+int outputCompression()
+{
+	return compressionLevel;
+}
+
+#ifdef ONLOOKER_ZLIB
+
+#ifdef _WIN32
+static bool createPipe(int fds[2])
+{
+	return _pipe(fds, 64 * 1024, _O_BINARY | _O_NOINHERIT) == 0;
+}
+
+static int readPipe(int fd, void* buffer, size_t size)
+{
+	return _read(fd, buffer, unsigned(size));
+}
+
+// True when the pipe can be read without blocking or was closed, false after the timeout (ms,
+// negative waits forever)
+static bool waitPipe(int fd, int timeout)
+{
+	if (timeout < 0)
+		return true;
+	// Anonymous pipes cannot be waited on, peek until data arrives or the writer closes it
+	auto pipe = HANDLE(_get_osfhandle(fd));
+	auto start = GetTickCount64();
+	for (;;)
+	{
+		DWORD available = 0;
+		if (!PeekNamedPipe(pipe, nullptr, 0, nullptr, &available, nullptr) || available)
+			return true;
+		if (GetTickCount64() - start >= ULONGLONG(timeout))
+			return false;
+		Sleep(10);
+	}
+}
+
+static void closePipe(int fd)
+{
+	_close(fd);
+}
+
+static FILE* openPipe(int fd)
+{
+	return _fdopen(fd, "wb");
+}
+#else
+static bool createPipe(int fds[2])
+{
+	return pipe2(fds, O_CLOEXEC) == 0;
+}
+
+static int readPipe(int fd, void* buffer, size_t size)
+{
+	return int(read(fd, buffer, size));
+}
+
+// True when the pipe can be read without blocking or was closed, false after the timeout (ms,
+// negative waits forever)
+static bool waitPipe(int fd, int timeout)
+{
+	pollfd pipe = { fd, POLLIN, 0 };
+	int result;
+	do
+		result = poll(&pipe, 1, timeout);
+	while (result < 0 && errno == EINTR);
+	return result != 0;
+}
+
+static void closePipe(int fd)
+{
+	close(fd);
+}
+
+static FILE* openPipe(int fd)
+{
+	return fdopen(fd, "wb");
+}
+#endif // _WIN32
+
+// Reads the pipe until the writer closes it. The compressed data is flushed to the file at
+// most once a second, every flush ends a deflate block and costs some compression, so a
+// killed run loses at most the last second like the trace writers lose the last tick. The
+// flush does not wait for more data, the log is written rarely.
+static void compressPipe(int input, FILE* output, int level)
+{
+	z_stream stream = { };
+	// 15 bits of window, +16 for a gzip header
+	auto success = deflateInit2(&stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+	std::vector<unsigned char> in(64 * 1024);
+	std::vector<unsigned char> out(64 * 1024);
+	auto lastFlush = std::chrono::steady_clock::now();
+	auto pending = false; // deflated since the last flush
+	for (;;)
+	{
+		auto timeout = -1;
+		if (pending && success)
+		{
+			auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - lastFlush);
+			timeout = int(std::max<int64_t>(1000 - elapsed.count(), 0));
+		}
+		auto ready = waitPipe(input, timeout);
+		auto count = ready ? readPipe(input, in.data(), in.size()) : 0;
+		if (!success)
+		{
+			// Keep draining, the writer would block on a full pipe
+			if (count <= 0)
+				break;
+			continue;
+		}
+		auto now = std::chrono::steady_clock::now();
+		auto flush = Z_NO_FLUSH;
+		if (ready && count <= 0)
+			flush = Z_FINISH;
+		else if (now - lastFlush >= std::chrono::seconds(1))
+			flush = Z_SYNC_FLUSH;
+		stream.next_in = in.data();
+		stream.avail_in = count > 0 ? uInt(count) : 0;
+		do
+		{
+			stream.next_out = out.data();
+			stream.avail_out = uInt(out.size());
+			deflate(&stream, flush);
+			auto have = out.size() - stream.avail_out;
+			if (have && fwrite(out.data(), 1, have, output) != have)
+				success = false;
+		} while (stream.avail_out == 0 && success);
+		if (flush != Z_NO_FLUSH)
+		{
+			fflush(output);
+			lastFlush = now;
+			pending = false;
+		}
+		else if (count > 0)
+		{
+			pending = true;
+		}
+		if (ready && count <= 0)
+			break;
+	}
+	deflateEnd(&stream);
+	closePipe(input);
+	if (fclose(output) != 0 || !success)
+		compressionFailed = true;
+}
+
+FILE* openOutput(const std::string& file)
+{
+	if (!compressionLevel)
+		return openOutputFile(file);
+	FILE* output = openOutputFile(file + ".gz");
+	if (!output)
+		return nullptr;
+	int fds[2] = { -1, -1 };
+	if (!createPipe(fds))
+	{
+		fclose(output);
+		return nullptr;
+	}
+	FILE* stream = openPipe(fds[1]);
+	if (!stream)
+	{
+		closePipe(fds[0]);
+		closePipe(fds[1]);
+		fclose(output);
+		return nullptr;
+	}
+	std::lock_guard<std::mutex> lock(compressorsMutex);
+	compressors.emplace_back(compressPipe, fds[0], output, compressionLevel);
+	return stream;
+}
+
+#else
+
+FILE* openOutput(const std::string& file)
+{
+	return openOutputFile(file);
+}
+
+#endif // ONLOOKER_ZLIB
+
+bool finishOutputs()
+{
+	std::vector<std::thread> finished;
+	{
+		std::lock_guard<std::mutex> lock(compressorsMutex);
+		finished.swap(compressors);
+	}
+	for (std::thread& compressor : finished)
+		compressor.join();
+	return !compressionFailed.exchange(false);
+}
+
+bool SpoolFile::create(const std::string& file)
+{
+	close();
+	m_success = true;
+#ifdef ONLOOKER_ZLIB
+	if (compressionLevel)
+	{
+		m_compressed = gzopen(file.c_str(), "wb1");
+		return m_compressed != nullptr;
+	}
+#endif // ONLOOKER_ZLIB
+	m_file = openOutputFile(file);
+	return m_file != nullptr;
+}
+
+bool SpoolFile::openForReading(const std::string& file)
+{
+	close();
+	m_success = true;
+#ifdef ONLOOKER_ZLIB
+	m_compressed = gzopen(file.c_str(), "rb");
+	return m_compressed != nullptr;
+#else
+	m_file = fopen(file.c_str(), "rb");
+	return m_file != nullptr;
+#endif // ONLOOKER_ZLIB
+}
+
+void SpoolFile::write(const void* data, size_t size)
+{
+#ifdef ONLOOKER_ZLIB
+	if (m_compressed)
+	{
+		if (size && gzwrite(m_compressed, data, unsigned(size)) != int(size))
+			m_success = false;
+		return;
+	}
+#endif // ONLOOKER_ZLIB
+	if (fwrite(data, 1, size, m_file) != size)
+		m_success = false;
+}
+
+bool SpoolFile::read(void* data, size_t size)
+{
+#ifdef ONLOOKER_ZLIB
+	if (m_compressed)
+		return gzread(m_compressed, data, unsigned(size)) == int(size);
+#endif // ONLOOKER_ZLIB
+	return fread(data, 1, size, m_file) == size;
+}
+
+bool SpoolFile::close()
+{
+#ifdef ONLOOKER_ZLIB
+	if (m_compressed && gzclose(m_compressed) != Z_OK)
+		m_success = false;
+	m_compressed = nullptr;
+#endif // ONLOOKER_ZLIB
+	if (m_file && fclose(m_file) != 0)
+		m_success = false;
+	m_file = nullptr;
+	return m_success;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+
+// Streaming gzip compression of the log, trace and CSV files (ONLOOKER_COMPRESS), so they do
+// not have to be written in full and compressed afterwards. Every compressed file is fed
+// through a pipe to a thread of its own, the writers keep using the FILE* they know.
+
+// Open a file for writing while denying other writers
+FILE* openOutputFile(const std::string& file);
+
+// Parse the value of ONLOOKER_COMPRESS: gzip[,<level 1-9>]
+bool parseCompression(const char* str, int& level);
+// False when Onlooker was built without zlib
+bool compressionSupported();
+// Level 0 turns compression off, only before any output is opened
+void setOutputCompression(int level);
+int outputCompression();
+
+// openOutputFile of the file, or of the file with a .gz extension when compression is on. In
+// that case the stream is the pipe to the compression thread, which finishes the file when
+// the stream is closed.
+FILE* openOutput(const std::string& file);
+// Waits for the compression threads of the closed outputs, false when one failed to write
+bool finishOutputs();
+
+struct gzFile_s;
+
+// A temporary file that the run writes once and reads back, like the CSV spool. It is gzip
+// compressed at the fastest level when the outputs are compressed, written by the calling
+// thread since nothing else waits for it.
+class SpoolFile
+{
+	FILE* m_file = nullptr;
+	gzFile_s* m_compressed = nullptr;
+	bool m_success = true; // all writes succeeded
+
+public:
+	SpoolFile() = default;
+	SpoolFile(const SpoolFile&) = delete;
+	SpoolFile& operator=(const SpoolFile&) = delete;
+	~SpoolFile() { close(); }
+
+	bool create(const std::string& file);
+	// Reads compressed and uncompressed spools
+	bool openForReading(const std::string& file);
+	void write(const void* data, size_t size);
+	// False unless all of the size was read
+	bool read(void* data, size_t size);
+	// False when a write failed
+	bool close();
+
+	explicit operator bool() const { return m_file || m_compressed; }
+};
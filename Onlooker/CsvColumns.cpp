@@ -0,0 +1,156 @@
+#include "CsvColumns.h"
+#include "Utils.h"
+
+#include <cstring>
+
+static const char* metricNames[] = { "memory", "private", "pagefile", "cpu", "read", "write" };
+
+static bool isBytes(CsvColumns::Metric metric)
+{
+	return metric != CsvColumns::Cpu;
+}
+
+static const char* unitName(uint64_t unit)
+{
+	switch (unit)
+	{
+	case 1: return "B";
+	case 1024: return "KB";
+	case 1024 * 1024: return "MB";
+	default: return "GB";
+	}
+}
+
+static bool parseMetric(const std::string& name, CsvColumns::Metric& metric)
+{
+	for (size_t i = 0; i < std::size(metricNames); i++)
+	{
+		if (name == metricNames[i])
+		{
+			metric = CsvColumns::Metric(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool CsvColumns::parse(const char* str, CsvColumns& columns)
+{
+	columns = CsvColumns();
+	columns.metrics.clear();
+	std::string list = str;
+	auto comma = list.find(',');
+	auto metrics = list.substr(0, comma);
+	size_t position = 0;
+	while (position <= metrics.size())
+	{
+		auto end = metrics.find('+', position);
+		if (end == std::string::npos)
+			end = metrics.size();
+		Metric metric = Memory;
+		if (!parseMetric(metrics.substr(position, end - position), metric))
+			return false;
+		columns.metrics.push_back(metric);
+		position = end + 1;
+	}
+
+	columns.filterMetric = columns.metrics.front();
+	std::string threshold;
+	while (comma != std::string::npos)
+	{
+		position = comma + 1;
+		comma = list.find(',', position);
+		auto option = list.substr(position, comma == std::string::npos ? std::string::npos : comma - position);
+		auto greater = option.find('>');
+		if (option.size() == 1 && strchr("BKMG", option[0]))
+		{
+			columns.unit = option[0] == 'B' ? 1 : option[0] == 'K' ? 1024 : option[0] == 'M' ? 1024 * 1024 : 1024 * 1024 * 1024;
+		}
+		else if (greater != std::string::npos && greater + 1 < option.size())
+		{
+			if (greater > 0 && !parseMetric(option.substr(0, greater), columns.filterMetric))
+				return false;
+			threshold = option.substr(greater + 1);
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	auto filter = columns.filterMetric;
+	columns.threshold = filter == Memory || filter == Private || filter == Pagefile ? 1024 * 1024 * 100 : 0;
+	if (threshold.empty())
+		return true;
+	if (threshold == "0")
+	{
+		columns.threshold = 0;
+	}
+	else if (filter == Cpu)
+	{
+		int length = 0;
+		if (sscanf(threshold.c_str(), "%lf%n", &columns.threshold, &length) != 1 || size_t(length) != threshold.size() || !(columns.threshold >= 0))
+			return false;
+	}
+	else
+	{
+		uint64_t bytes = 0;
+		if (!parseSize(threshold, bytes))
+			return false;
+		columns.threshold = double(bytes);
+	}
+	return true;
+}
+
+const char* CsvColumns::name(Metric metric)
+{
+	return metricNames[metric];
+}
+
+double CsvColumns::value(Metric metric, const ProcessData& data) const
+{
+	switch (metric)
+	{
+	case Memory: return double(data.memory.workingSetSize);
+	case Private: return double(data.memory.privateUsage);
+	case Pagefile: return double(data.memory.pagefileUsage);
+	case Cpu: return data.cpuUsage;
+	case Read: return double(data.io.readBytes);
+	case Write: return double(data.io.writeBytes);
+	}
+	return 0;
+}
+
+void CsvColumns::format(Metric metric, double value, TextBuffer& text) const
+{
+	if (isBytes(metric))
+		text.appendUnsigned(uint64_t(value) / unit);
+	else
+		text.appendFixed(value, 1);
+}
+
+std::string CsvColumns::describe() const
+{
+	std::string text;
+	auto bytes = false;
+	for (auto metric : metrics)
+	{
+		if (!text.empty())
+			text += "+";
+		text += name(metric);
+		bytes |= isBytes(metric);
+	}
+	if (bytes)
+		text += std::string(" in ") + unitName(unit);
+	if (filterMetric == Cpu)
+	{
+		char percent[32] = "";
+		snprintf(percent, sizeof(percent), "%g%%", threshold);
+		text += std::string(", processes above ") + percent + " cpu";
+	}
+	else
+	{
+		text += ", processes above " + humanReadableSize(size_t(threshold)) + (filterMetric == Read || filterMetric == Write ? "/s " : " ") + name(filterMetric);
+	}
+	return text;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "ProcessData.h"
+#include "TextBuffer.h"
+
+#include <string>
+#include <vector>
+
+// What the CSV file holds for every process: one column per metric, with the values in a
+// unit of choice. Only the processes whose peak of the filter metric (the first one unless
+// chosen) is above the threshold get columns, so a run with thousands of short-lived helpers
+// stays readable.
+struct CsvColumns
+{
+	enum Metric
+	{
+		Memory, // working set, bytes
+		Private, // bytes
+		Pagefile, // bytes
+		Cpu, // percent of all processors
+		Read, // bytes per second
+		Write, // bytes per second
+	};
+
+	std::vector<Metric> metrics{ Memory };
+	uint64_t unit = 1024 * 1024; // of the byte metrics
+	Metric filterMetric = Memory; // need not be one of the columns
+	double threshold = 1024 * 1024 * 100; // in the unit of the filter metric, not of the CSV
+
+	// Parse the value of ONLOOKER_CSV: <metric>[+<metric>...][,B|K|M|G][,[<metric>]><threshold>]
+	// where a metric is memory, private, pagefile, cpu, read or write. The threshold is a size
+	// with a K, M or G suffix, or a percentage for cpu, of the metric before it (by default the
+	// first column). It defaults to 100M for the memory metrics and to 0 (every process that
+	// had a non-zero value) for the others.
+	static bool parse(const char* str, CsvColumns& columns);
+	static const char* name(Metric metric);
+
+	double value(Metric metric, const ProcessData& data) const;
+	// Append the value as written to the CSV, bytes in whole units
+	void format(Metric metric, double value, TextBuffer& text) const;
+	// For the log
+	std::string describe() const;
+};
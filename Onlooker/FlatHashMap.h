@@ -0,0 +1,183 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include <vector>
+#include <utility>
+#include <functional>
+#include <type_traits>
+
+// Finalizer of splitmix64, spreads keys with few significant bits (pids, indices) over the table
+static inline uint64_t mixHash(uint64_t x)
+{
+	x ^= x >> 30;
+	x *= 0xBF58476D1CE4E5B9ull;
+	x ^= x >> 27;
+	x *= 0x94D049BB133111EBull;
+	x ^= x >> 31;
+	return x;
+}
+
+template <typename Key, typename = void>
+struct FlatHash
+{
+	size_t operator()(const Key& key) const
+	{
+		return size_t(mixHash(std::hash<Key>()(key)));
+	}
+};
+
+template <typename Key>
+struct FlatHash<Key, std::enable_if_t<std::is_integral<Key>::value || std::is_pointer<Key>::value>>
+{
+	size_t operator()(Key key) const
+	{
+		return size_t(mixHash(uint64_t(key)));
+	}
+};
+
+// Open addressing hash map with linear probing, all entries live in a single array.
+// Lookups touch one or two cache lines instead of chasing nodes like std::map/unordered_map,
+// and once the table is large enough inserting and erasing do not allocate.
+// Pointers to values are invalidated by inserting.
+template <typename Key, typename Value, typename Hash = FlatHash<Key>>
+class FlatHashMap
+{
+	struct Slot
+	{
+		Key key = Key();
+		Value value = Value();
+		bool used = false;
+	};
+
+	std::vector<Slot> m_slots;
+	size_t m_size = 0;
+
+	size_t mask() const { return m_slots.size() - 1; }
+	size_t home(const Key& key) const { return Hash()(key) & mask(); }
+
+	size_t findSlot(const Key& key) const
+	{
+		if (m_slots.empty())
+			return size_t(-1);
+		for (auto i = home(key);; i = (i + 1) & mask())
+		{
+			const Slot& slot = m_slots[i];
+			if (!slot.used)
+				return size_t(-1);
+			if (slot.key == key)
+				return i;
+		}
+	}
+
+	void rehash(size_t capacity)
+	{
+		std::vector<Slot> slots(capacity);
+		slots.swap(m_slots);
+		for (Slot& slot : slots)
+		{
+			if (!slot.used)
+				continue;
+			auto i = home(slot.key);
+			while (m_slots[i].used)
+				i = (i + 1) & mask();
+			m_slots[i] = std::move(slot);
+		}
+	}
+
+public:
+	size_t size() const { return m_size; }
+	bool empty() const { return m_size == 0; }
+
+	void reserve(size_t count)
+	{
+		size_t capacity = 16;
+		// Keep the load factor below 70%
+		while (capacity * 7 < count * 10)
+			capacity *= 2;
+		if (capacity > m_slots.size())
+			rehash(capacity);
+	}
+
+	void clear()
+	{
+		for (Slot& slot : m_slots)
+			slot = Slot();
+		m_size = 0;
+	}
+
+	Value* find(const Key& key)
+	{
+		auto i = findSlot(key);
+		return i == size_t(-1) ? nullptr : &m_slots[i].value;
+	}
+
+	const Value* find(const Key& key) const
+	{
+		auto i = findSlot(key);
+		return i == size_t(-1) ? nullptr : &m_slots[i].value;
+	}
+
+	// Returns the value of the key, inserting a default constructed one if needed
+	Value& operator[](const Key& key)
+	{
+		reserve(m_size + 1);
+		auto i = home(key);
+		for (;; i = (i + 1) & mask())
+		{
+			Slot& slot = m_slots[i];
+			if (!slot.used)
+				break;
+			if (slot.key == key)
+				return slot.value;
+		}
+		Slot& slot = m_slots[i];
+		slot.key = key;
+		slot.used = true;
+		m_size++;
+		return slot.value;
+	}
+
+	bool erase(const Key& key)
+	{
+		auto i = findSlot(key);
+		if (i == size_t(-1))
+			return false;
+		// Backward shift deletion, no tombstones are left behind
+		for (auto j = (i + 1) & mask(); m_slots[j].used; j = (j + 1) & mask())
+		{
+			auto k = home(m_slots[j].key);
+			// Move the entry at j into the hole when its home is not in (i, j]
+			if ((j > i && (k <= i || k > j)) || (j < i && k <= i && k > j))
+			{
+				m_slots[i] = std::move(m_slots[j]);
+				i = j;
+			}
+		}
+		m_slots[i] = Slot();
+		m_size--;
+		return true;
+	}
+
+	// Calls fn(key, value) for every entry in unspecified order
+	template <typename Fn>
+	void forEach(Fn&& fn) const
+	{
+		for (const Slot& slot : m_slots)
+		{
+			if (slot.used)
+				fn(slot.key, slot.value);
+		}
+	}
+
+	template <typename Fn>
+	void forEach(Fn&& fn)
+	{
+		for (Slot& slot : m_slots)
+		{
+			if (slot.used)
+				fn(slot.key, slot.value);
+		}
+	}
+};
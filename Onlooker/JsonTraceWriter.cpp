@@ -0,0 +1,472 @@
+#include "TraceWriter.h"
+#include "TextBuffer.h"
+#include "Compression.h"
+
+#include <algorithm>
+#include <vector>
+
+static bool seekFile(FILE* file, uint64_t offset)
+{
+#ifdef _WIN32
+	return _fseeki64(file, int64_t(offset), SEEK_SET) == 0;
+#else
+	return fseeko(file, off_t(offset), SEEK_SET) == 0;
+#endif // _WIN32
+}
+
+// The processes layout is the one Onlooker always wrote: an array with an object per process
+// that holds all its samples. They are only known when the run ends, so until then the text of
+// the samples is spooled to disk in blocks. Every block links to the previous one of its
+// process, which keeps the memory at a block per process. The other chunks are spooled in
+// tick order the same way and follow the processes.
+// The ticks layout (opt-in, version 2) streams every tick as a line of chunks instead, so the
+// trace of a killed run can still be loaded.
+class JsonTraceWriter : public TraceWriter
+{
+	struct SpoolBlock
+	{
+		uint64_t previous = 0; // offset of the previous block of the chain, NoBlock for the first
+		uint64_t size = 0; // of the text that follows
+	};
+	static constexpr uint64_t NoBlock = uint64_t(-1);
+
+	// Samples of a process, each one with a leading separator
+	struct ProcessSamples
+	{
+		UniqueProcess process;
+		uint64_t lastBlock = NoBlock;
+		std::string pending;
+	};
+
+	JsonLayout m_layout;
+	FILE* m_jsonFile = nullptr;
+	std::string m_spoolFile;
+	FILE* m_spool = nullptr;
+	uint64_t m_spoolSize = 0;
+	std::vector<ProcessSamples> m_samples; // by process index
+	size_t m_pendingSize = 0;
+	uint64_t m_lastChunkBlock = NoBlock; // of the chunks that are not samples
+	bool m_tickHasData = false;
+	uint32_t m_threadsProcess = uint32_t(-1); // index of the process whose threads chunk is open
+	TextBuffer m_text; // of the current tick
+	bool m_success = true; // all blocks were written
+
+	static const char* stateName(ThreadState state)
+	{
+		switch (state)
+		{
+		case ThreadState::Running:
+			return "running";
+		case ThreadState::Ready:
+			return "ready";
+		case ThreadState::Waiting:
+			return "waiting";
+		default:
+			return "other";
+		}
+	}
+
+	void closeThreads()
+	{
+		if (m_threadsProcess == uint32_t(-1))
+			return;
+		m_text.appendLiteral("]}}");
+		m_threadsProcess = uint32_t(-1);
+	}
+
+	// Opens a chunk: the separator and the key, up to the value. There always is an element
+	// before, the version marker or the processes.
+	template <size_t N>
+	void startChunk(const char (&key)[N])
+	{
+		m_text.append(',');
+		m_text.appendLiteral(key);
+		m_tickHasData = true;
+	}
+
+	template <size_t N>
+	void field(const char (&key)[N], uint64_t value)
+	{
+		m_text.appendLiteral(key);
+		m_text.appendUnsigned(value);
+	}
+
+	template <size_t N>
+	void field(const char (&key)[N], double value, int precision)
+	{
+		m_text.appendLiteral(key);
+		m_text.appendFixed(value, precision);
+	}
+
+	template <size_t N>
+	void field(const char (&key)[N], const std::string& value)
+	{
+		m_text.appendLiteral(key);
+		m_text.appendJsonString(value);
+	}
+
+	void writeBlock(uint64_t& lastBlock, const char* text, size_t size)
+	{
+		if (!size)
+			return;
+		SpoolBlock block;
+		block.previous = lastBlock;
+		block.size = size;
+		m_success = fwrite(&block, sizeof(block), 1, m_spool) == 1 && fwrite(text, 1, size, m_spool) == size && m_success;
+		lastBlock = m_spoolSize;
+		m_spoolSize += sizeof(block) + size;
+	}
+
+	void writeText()
+	{
+		if (m_layout == JsonLayout::Ticks)
+		{
+			m_success = m_text.writeTo(m_jsonFile) && m_success;
+			return;
+		}
+		writeBlock(m_lastChunkBlock, m_text.data(), m_text.size());
+		m_text.truncate(0);
+	}
+
+	void writeSamples(ProcessSamples& samples)
+	{
+		writeBlock(samples.lastBlock, samples.pending.data(), samples.pending.size());
+		m_pendingSize -= samples.pending.size();
+		samples.pending.clear();
+	}
+
+	// Appends a chain of blocks to the trace, without the leading separator
+	bool copyBlocks(FILE* spool, uint64_t lastBlock, bool skipSeparator)
+	{
+		std::vector<uint64_t> blocks;
+		SpoolBlock block;
+		for (auto offset = lastBlock; offset != NoBlock; offset = block.previous)
+		{
+			if (!seekFile(spool, offset) || fread(&block, sizeof(block), 1, spool) != 1)
+				return false;
+			blocks.push_back(offset);
+		}
+		std::vector<char> text;
+		for (auto it = blocks.rbegin(); it != blocks.rend(); ++it)
+		{
+			if (!seekFile(spool, *it) || fread(&block, sizeof(block), 1, spool) != 1)
+				return false;
+			text.resize(size_t(block.size));
+			if (fread(text.data(), 1, text.size(), spool) != text.size())
+				return false;
+			size_t skip = skipSeparator ? 1 : 0;
+			skipSeparator = false;
+			if (fwrite(text.data() + skip, 1, text.size() - skip, m_jsonFile) != text.size() - skip)
+				return false;
+		}
+		return true;
+	}
+
+	// Writes the spooled processes and chunks as the trace
+	bool writeProcesses()
+	{
+		writeText();
+		for (ProcessSamples& samples : m_samples)
+			writeSamples(samples);
+		auto success = fclose(m_spool) == 0 && m_success;
+		m_spool = nullptr;
+		FILE* spool = fopen(m_spoolFile.c_str(), "rb");
+		if (!spool)
+			return false;
+		m_text.appendLiteral("[\n");
+		auto first = true;
+		for (const ProcessSamples& samples : m_samples)
+		{
+			if (samples.lastBlock == NoBlock)
+				continue;
+			if (!first)
+				m_text.append(',');
+			first = false;
+			process(R"({"pid":)", samples.process);
+			m_text.appendLiteral(R"(,"data":[)");
+			success = m_text.writeTo(m_jsonFile) && success;
+			success = copyBlocks(spool, samples.lastBlock, true) && success;
+			m_text.appendLiteral("]}\n");
+		}
+		success = m_text.writeTo(m_jsonFile) && success;
+		success = copyBlocks(spool, m_lastChunkBlock, first) && success;
+		fclose(spool);
+		remove(m_spoolFile.c_str());
+		return success;
+	}
+
+	// A tick larger than a block is written in several
+	void endChunk()
+	{
+		if (m_text.full())
+			writeText();
+	}
+
+	void toJson(const ProcessData& data)
+	{
+		const MemoryCounters& memory = data.memory;
+		field(R"({"time":)", data.time);
+		field(R"(,"cpuUsage":)", data.cpuUsage, 0);
+		field(R"(,"memory":{"pageFaultCount":)", memory.pageFaultCount);
+		field(R"(,"peakWorkingSetSize":)", memory.peakWorkingSetSize);
+		field(R"(,"workingSetSize":)", memory.workingSetSize);
+		field(R"(,"quotaPeakPagedPoolUsage":)", memory.quotaPeakPagedPoolUsage);
+		field(R"(,"quotaPagedPoolUsage":)", memory.quotaPagedPoolUsage);
+		field(R"(,"quotaPeakNonPagedPoolUsage":)", memory.quotaPeakNonPagedPoolUsage);
+		field(R"(,"quotaNonPagedPoolUsage":)", memory.quotaNonPagedPoolUsage);
+		field(R"(,"pagefileUsage":)", memory.pagefileUsage);
+		field(R"(,"peakPagefileUsage":)", memory.peakPagefileUsage);
+		field(R"(,"privateUsage":)", memory.privateUsage);
+		field(R"(},"io":{"readBytes":)", data.io.readBytes);
+		field(R"(,"writeBytes":)", data.io.writeBytes);
+		field(R"(,"readOperations":)", data.io.readOperations);
+		field(R"(,"writeOperations":)", data.io.writeOperations);
+		field(R"(},"cpuTime":)", data.cpuTime);
+		field(R"(,"cycleTime":)", data.cycleTime);
+		m_text.append('}');
+	}
+
+	void toJson(const OverheadData& overhead)
+	{
+		field(R"({"time":)", overhead.time);
+		field(R"(,"tick":)", overhead.tick);
+		field(R"(,"interval":)", overhead.interval);
+		field(R"(,"snapshotTime":)", overhead.snapshotTime);
+		field(R"(,"queryCount":)", overhead.queryCount);
+		field(R"(,"queryTime":)", overhead.queryTime);
+		field(R"(,"writeTime":)", overhead.writeTime);
+		field(R"(,"queueTime":)", overhead.queueTime);
+		field(R"(,"queuedRecords":)", overhead.queuedRecords);
+		field(R"(,"cpuUsage":)", overhead.cpuUsage, 2);
+		field(R"(,"workingSetSize":)", overhead.workingSetSize);
+		field(R"(,"missedDeadlines":)", overhead.missedDeadlines);
+		field(R"(,"droppedTicks":)", overhead.droppedTicks);
+		m_text.append('}');
+	}
+
+	// The fields after the identity, up to the end of the object
+	void toJson(const SummaryData& data)
+	{
+		static const double GB = 1024.0 * 1024.0 * 1024.0;
+		field(R"(,"startTime":)", data.startTime);
+		field(R"(,"endTime":)", data.endTime);
+		field(R"(,"lifetime":)", (data.endTime - data.startTime) / 1000.0, 3);
+		field(R"(,"peakWorkingSetSize":)", data.peakWorkingSetSize);
+		field(R"(,"peakPrivateUsage":)", data.peakPrivateUsage);
+		field(R"(,"peakTime":)", data.peakTime);
+		field(R"(,"workingSetGigabyteSeconds":)", data.workingSetIntegral / 1000.0 / GB, 6);
+		field(R"(,"cpuSeconds":)", data.cpuTime / 1e7, 3);
+		if (data.hasExitCode)
+			field(R"(,"exitCode":)", double(data.exitCode), 0);
+		else
+			m_text.appendLiteral(R"(,"exitCode":null)");
+		m_text.append('}');
+	}
+
+	// The identity of a process at the start of a chunk
+	template <size_t N>
+	void process(const char (&key)[N], const UniqueProcess& process)
+	{
+		field(key, process.pid);
+		field(R"(,"ppid":)", process.ppid);
+		field(R"(,"createTime":)", process.createTime);
+		field(R"(,"name":)", *process.name);
+	}
+
+public:
+	explicit JsonTraceWriter(JsonLayout layout) :
+		m_layout(layout)
+	{
+	}
+
+	~JsonTraceWriter() override
+	{
+		if (m_jsonFile)
+			fclose(m_jsonFile);
+		if (m_spool)
+		{
+			fclose(m_spool);
+			remove(m_spoolFile.c_str());
+		}
+	}
+
+	bool open(const std::string& basename) override
+	{
+		m_jsonFile = openOutput(basename + ".json");
+		if (!m_jsonFile)
+			return false;
+		if (m_layout == JsonLayout::Processes)
+		{
+			m_spoolFile = basename + ".json.tmp";
+			m_spool = openOutputFile(m_spoolFile);
+			return m_spool != nullptr;
+		}
+		// Every tick is written as a line of chunks, so a truncated trace can be
+		// recovered by dropping the last incomplete line and closing the array
+		fprintf(m_jsonFile, "[\n{\"version\":2,\"layout\":\"ticks\"}\n");
+		fflush(m_jsonFile);
+		return true;
+	}
+
+	void addSample(uint32_t index, const UniqueProcess& uniqueProcess, const ProcessData& data) override
+	{
+		closeThreads();
+		if (m_layout == JsonLayout::Processes)
+		{
+			if (index >= m_samples.size())
+				m_samples.resize(index + 1);
+			ProcessSamples& samples = m_samples[index];
+			samples.process = uniqueProcess;
+			auto start = m_text.size();
+			m_text.append(',');
+			toJson(data);
+			samples.pending.append(m_text.data() + start, m_text.size() - start);
+			m_pendingSize += m_text.size() - start;
+			m_text.truncate(start);
+			if (samples.pending.size() >= 64 * 1024)
+				writeSamples(samples);
+			// Thousands of short-lived processes release their blocks too
+			if (m_pendingSize >= 16 * 1024 * 1024)
+			{
+				for (ProcessSamples& other : m_samples)
+				{
+					writeSamples(other);
+					std::string().swap(other.pending);
+				}
+			}
+			return;
+		}
+		startChunk("");
+		process(R"({"pid":)", uniqueProcess);
+		m_text.appendLiteral(R"(,"data":[)");
+		toJson(data);
+		m_text.appendLiteral("]}");
+		endChunk();
+	}
+
+	void addThreadSample(uint32_t index, const UniqueProcess& process, const ThreadData& data) override
+	{
+		// The threads of a process that ran in a tick share a chunk, it has no pid of its own either
+		if (index != m_threadsProcess)
+		{
+			closeThreads();
+			startChunk(R"({"threads":)");
+			field(R"({"pid":)", process.pid);
+			field(R"(,"createTime":)", process.createTime);
+			field(R"(,"time":)", data.time);
+			m_text.appendLiteral(R"(,"data":[)");
+			m_threadsProcess = index;
+		}
+		else
+		{
+			m_text.append(',');
+		}
+		field(R"({"tid":)", data.tid);
+		field(R"(,"createTime":)", data.createTime);
+		field(R"(,"name":)", *data.name);
+		field(R"(,"userUsage":)", data.userUsage, 1);
+		field(R"(,"kernelUsage":)", data.kernelUsage, 1);
+		field(R"(,"contextSwitches":)", data.contextSwitches);
+		m_text.appendLiteral(R"(,"state":")");
+		m_text.append(stateName(data.state));
+		field(R"(","waitReason":)", data.waitReason);
+		m_text.append('}');
+		endChunk();
+	}
+
+	void addComposition(uint32_t index, const UniqueProcess& uniqueProcess, const CompositionData& data) override
+	{
+		(void)index;
+		closeThreads();
+		const auto& bytes = data.composition.bytes;
+		startChunk(R"({"composition":)");
+		process(R"({"pid":)", uniqueProcess);
+		field(R"(,"time":)", data.time);
+		field(R"(,"image":)", bytes[MemoryImage]);
+		field(R"(,"mapped":)", bytes[MemoryMapped]);
+		field(R"(,"shareable":)", bytes[MemoryShareable]);
+		field(R"(,"heap":)", bytes[MemoryHeap]);
+		field(R"(,"stack":)", bytes[MemoryStack]);
+		field(R"(,"private":)", bytes[MemoryPrivate]);
+		m_text.appendLiteral("}}");
+		endChunk();
+	}
+
+	void addRollup(uint32_t index, const UniqueProcess& uniqueProcess, const RollupData& data) override
+	{
+		(void)index;
+		closeThreads();
+		startChunk(R"({"rollup":)");
+		process(R"({"pid":)", uniqueProcess);
+		field(R"(,"time":)", data.time);
+		field(R"(,"workingSetSize":)", data.workingSetSize);
+		field(R"(,"privateUsage":)", data.privateUsage);
+		field(R"(,"cpuUsage":)", data.cpuUsage, 0);
+		field(R"(,"processCount":)", data.processCount);
+		m_text.appendLiteral("}}");
+		endChunk();
+	}
+
+	void addOverhead(const OverheadData& overhead) override
+	{
+		closeThreads();
+		// Not a process chunk, readers tell them apart by the missing pid
+		startChunk(R"({"overhead":)");
+		toJson(overhead);
+		m_text.append('}');
+		endChunk();
+	}
+
+	void endTick() override
+	{
+		closeThreads();
+		if (!m_tickHasData)
+			return;
+		m_text.append('\n');
+		m_tickHasData = false;
+		if (m_layout == JsonLayout::Processes)
+		{
+			endChunk();
+			return;
+		}
+		m_success = m_text.writeTo(m_jsonFile) && m_success;
+		fflush(m_jsonFile);
+	}
+
+	void addSummary(uint32_t index, const UniqueProcess& uniqueProcess, const SummaryData& data) override
+	{
+		(void)index;
+		closeThreads();
+		startChunk(R"({"summary":)");
+		process(R"({"pid":)", uniqueProcess);
+		toJson(data);
+		m_text.append('}');
+		endChunk();
+	}
+
+	void addTreeSummary(const SummaryData& data) override
+	{
+		closeThreads();
+		// The summaries are the last line, ended like a tick
+		startChunk(R"({"treeSummary":)");
+		field(R"({"processCount":)", data.processCount);
+		toJson(data);
+		m_text.append('}');
+		endTick();
+	}
+
+	bool close() override
+	{
+		auto success = m_layout == JsonLayout::Ticks || writeProcesses();
+		m_text.appendLiteral("]\n");
+		success = m_text.writeTo(m_jsonFile) && m_success && success;
+		success = fclose(m_jsonFile) == 0 && success;
+		m_jsonFile = nullptr;
+		return success;
+	}
+};
+
+std::unique_ptr<TraceWriter> createJsonTraceWriter(JsonLayout layout)
+{
+	return std::make_unique<JsonTraceWriter>(layout);
+}
@@ -0,0 +1,598 @@
+#ifdef __linux__
+
+#include "ProcessSource.h"
+#include "Utils.h"
+#include "FlatHashMap.h"
+
+#include <cstring>
+#include <cstdlib>
+
+#include <algorithm>
+#include <atomic>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <sys/sysinfo.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <signal.h>
+
+// Read a small /proc file into buf (null terminated), returns the length or -1
+static ssize_t readProcFile(const char* path, char* buf, size_t cb)
+{
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	ssize_t total = 0;
+	while (total + 1 < ssize_t(cb))
+	{
+		auto n = read(fd, buf + total, cb - 1 - total);
+		if (n <= 0)
+			break;
+		total += n;
+	}
+	close(fd);
+	buf[total] = '\0';
+	return total;
+}
+
+// Fields of /proc/<pid>/stat, see proc(5)
+struct ProcStat
+{
+	char comm[16] = ""; // TASK_COMM_LEN, at most 15 characters
+	char state = '\0';
+	uint32_t ppid = 0;
+	uint64_t minflt = 0;
+	uint64_t majflt = 0;
+	uint64_t utime = 0;
+	uint64_t stime = 0;
+	uint64_t starttime = 0;
+};
+
+// Also used for /proc/<pid>/task/<tid>/stat, which has the same format
+static bool readProcStat(const char* path, ProcStat& stat)
+{
+	char buf[1024];
+	if (readProcFile(path, buf, sizeof(buf)) <= 0)
+		return false;
+
+	// The comm field can contain spaces and parentheses
+	auto commStart = strchr(buf, '(');
+	auto commEnd = strrchr(buf, ')');
+	if (!commStart || !commEnd || commEnd < commStart)
+		return false;
+	auto commLength = std::min(size_t(commEnd - commStart - 1), sizeof(stat.comm) - 1);
+	memcpy(stat.comm, commStart + 1, commLength);
+	stat.comm[commLength] = '\0';
+
+	// Fields after comm, starting with state (field 3)
+	char* p = commEnd + 2;
+	uint64_t fields[20] = { 0 };
+	for (size_t i = 0; i < std::size(fields) && *p; i++)
+	{
+		if (i == 0)
+			stat.state = *p++; // state is a single character
+		else
+			fields[i] = strtoull(p, &p, 10);
+		while (*p == ' ')
+			p++;
+	}
+	stat.ppid = uint32_t(fields[4 - 3]);
+	stat.minflt = fields[10 - 3];
+	stat.majflt = fields[12 - 3];
+	stat.utime = fields[14 - 3];
+	stat.stime = fields[15 - 3];
+	stat.starttime = fields[22 - 3];
+	return true;
+}
+
+static bool readProcStat(uint32_t pid, ProcStat& stat)
+{
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/%u/stat", pid);
+	return readProcStat(path, stat);
+}
+
+// Value of a "key: 1234" line of a /proc file
+static uint64_t procValue(const char* file, const char* key)
+{
+	auto line = strstr(file, key);
+	if (!line)
+		return 0;
+	return strtoull(line + strlen(key), nullptr, 10);
+}
+
+// Value of a "Key: 1234 kB" line in /proc/<pid>/status, in bytes
+static size_t statusValue(const char* status, const char* key)
+{
+	return size_t(procValue(status, key)) * 1024;
+}
+
+// FNV-1a
+static uint32_t hashString(const char* str)
+{
+	uint32_t hash = 2166136261u;
+	for (; *str; str++)
+		hash = (hash ^ uint8_t(*str)) * 16777619u;
+	return hash;
+}
+
+// In 100ns units since boot, the clock of the start times in /proc/<pid>/stat
+static uint64_t bootTime()
+{
+	timespec ts;
+	clock_gettime(CLOCK_BOOTTIME, &ts);
+	return uint64_t(ts.tv_sec) * 10000000 + ts.tv_nsec / 100;
+}
+
+// Layout of the records returned by getdents64
+struct LinuxDirent64
+{
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[1];
+};
+
+// What tells the images of a process apart, by pid
+struct ProcImage
+{
+	uint64_t createTime = 0;
+	uint32_t commHash = 0;
+	uint32_t imageHash = 0; // of the executable
+};
+
+// CPU times of a process read while enumerating, the entry of its ProcessInfo
+struct ProcEntry
+{
+	uint64_t kernelTime = 0;
+	uint64_t userTime = 0;
+};
+
+class LinuxProcessSource : public ProcessSource
+{
+	long m_pageSize = sysconf(_SC_PAGESIZE);
+	long m_clockTicks = sysconf(_SC_CLK_TCK);
+	// /proc stays open and is read with getdents64 into a reused buffer, readdir would allocate
+	int m_procFd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	std::vector<char> m_direntBuffer = std::vector<char>(64 * 1024);
+	std::vector<ProcEntry> m_entries; // of the last snapshot, in the order of the processes
+	FlatHashMap<uint32_t, ProcImage> m_images; // of the last snapshot
+	FlatHashMap<uint32_t, ProcImage> m_nextImages;
+	uint64_t m_snapshotTime = 0;
+
+	// The executable only changes on exec. comm changes on exec too, but also when the main
+	// thread is renamed, so it only decides when the executable is looked at again.
+	uint32_t imageHash(uint32_t pid, const ProcStat& stat)
+	{
+		ProcImage image;
+		image.createTime = stat.starttime;
+		image.commHash = hashString(stat.comm);
+		auto previous = m_images.find(pid);
+		auto sameProcess = previous && previous->createTime == stat.starttime;
+		if (sameProcess && previous->commHash == image.commHash)
+		{
+			image.imageHash = previous->imageHash;
+		}
+		else
+		{
+			char path[32];
+			char exe[4096];
+			snprintf(path, sizeof(path), "%u/exe", pid);
+			auto length = readlinkat(m_procFd, path, exe, sizeof(exe) - 1);
+			if (length >= 0)
+			{
+				exe[length] = '\0';
+				image.imageHash = hashString(exe);
+			}
+			else if (sameProcess)
+			{
+				// Processes of other users and kernel threads have no readable executable
+				image.imageHash = previous->imageHash;
+			}
+		}
+		m_nextImages[pid] = image;
+		return image.imageHash;
+	}
+
+public:
+	~LinuxProcessSource() override
+	{
+		if (m_procFd >= 0)
+			close(m_procFd);
+	}
+
+	bool snapshot(std::vector<ProcessInfo>& processes) override
+	{
+		processes.clear();
+		m_entries.clear();
+		m_nextImages.clear();
+		if (m_procFd < 0 || lseek(m_procFd, 0, SEEK_SET) != 0)
+			return false;
+		while (true)
+		{
+			auto size = syscall(SYS_getdents64, m_procFd, m_direntBuffer.data(), m_direntBuffer.size());
+			if (size < 0)
+				return false;
+			if (size == 0)
+				break;
+			for (long offset = 0; offset < size;)
+			{
+				auto entry = (const LinuxDirent64*)(m_direntBuffer.data() + offset);
+				offset += entry->d_reclen;
+				char* end = nullptr;
+				auto pid = strtoul(entry->d_name, &end, 10);
+				if (*end || end == entry->d_name)
+					continue;
+				ProcStat stat;
+				if (!readProcStat(uint32_t(pid), stat))
+					continue; // exited in the meantime
+				ProcessInfo info;
+				info.pid = uint32_t(pid);
+				info.ppid = stat.ppid;
+				info.createTime = stat.starttime;
+				info.imageHash = imageHash(uint32_t(pid), stat);
+				processes.push_back(info);
+				ProcEntry procEntry;
+				procEntry.kernelTime = stat.stime * 10000000 / m_clockTicks;
+				procEntry.userTime = stat.utime * 10000000 / m_clockTicks;
+				m_entries.push_back(procEntry);
+			}
+		}
+		std::swap(m_images, m_nextImages);
+		m_snapshotTime = bootTime();
+		for (size_t i = 0; i < processes.size(); i++)
+			processes[i].entry = &m_entries[i];
+		return true;
+	}
+
+	uint64_t snapshotTime() const override
+	{
+		return m_snapshotTime;
+	}
+
+	std::string processName(const ProcessInfo& process) override
+	{
+		ProcStat stat;
+		if (!readProcStat(process.pid, stat))
+			return std::string();
+		return stat.comm;
+	}
+
+	bool queryProcess(const ProcessInfo& process, MemoryCounters& memory, CpuTimes& cpu, IoCounters& io) override
+	{
+		ProcStat stat;
+		if (!readProcStat(process.pid, stat) || stat.starttime != process.createTime)
+			return false;
+
+		char path[64];
+		char buf[4096];
+		snprintf(path, sizeof(path), "/proc/%u/statm", process.pid);
+		if (readProcFile(path, buf, sizeof(buf)) <= 0)
+			return false;
+		unsigned long long size = 0, resident = 0;
+		if (sscanf(buf, "%llu %llu", &size, &resident) != 2)
+			return false;
+
+		snprintf(path, sizeof(path), "/proc/%u/status", process.pid);
+		if (readProcFile(path, buf, sizeof(buf)) <= 0)
+			return false;
+
+		// Anonymous memory (resident or swapped) is the closest equivalent of the commit charge
+		auto privateUsage = statusValue(buf, "RssAnon:") + statusValue(buf, "VmSwap:");
+		memory.pageFaultCount = uint32_t(stat.minflt + stat.majflt);
+		memory.workingSetSize = size_t(resident * m_pageSize);
+		memory.peakWorkingSetSize = std::max(statusValue(buf, "VmHWM:"), memory.workingSetSize);
+		memory.quotaPagedPoolUsage = statusValue(buf, "VmPTE:");
+		memory.quotaPeakPagedPoolUsage = memory.quotaPagedPoolUsage;
+		memory.pagefileUsage = privateUsage;
+		memory.peakPagefileUsage = privateUsage;
+		memory.privateUsage = privateUsage;
+
+		// All processes of the tick share the time of the snapshot, Onlooker itself is not in it
+		if (auto entry = (const ProcEntry*)process.entry)
+		{
+			cpu.now = m_snapshotTime;
+			cpu.kernelTime = entry->kernelTime;
+			cpu.userTime = entry->userTime;
+		}
+		else
+		{
+			cpu.now = bootTime();
+			cpu.kernelTime = stat.stime * 10000000 / m_clockTicks;
+			cpu.userTime = stat.utime * 10000000 / m_clockTicks;
+		}
+		cpu.startTime = stat.starttime * 10000000 / m_clockTicks;
+
+		// Needs the same permissions as ptrace, characters and system calls include cached I/O like on Windows
+		snprintf(path, sizeof(path), "/proc/%u/io", process.pid);
+		if (readProcFile(path, buf, sizeof(buf)) > 0)
+		{
+			io.readTransferCount = procValue(buf, "rchar:");
+			io.writeTransferCount = procValue(buf, "wchar:");
+			io.readOperationCount = procValue(buf, "syscr:");
+			io.writeOperationCount = procValue(buf, "syscw:");
+		}
+		return true;
+	}
+
+	bool queryThreads(const ProcessInfo& process, uint64_t& now, std::vector<ThreadCounters>& threads) override
+	{
+		threads.clear();
+		char path[64];
+		snprintf(path, sizeof(path), "/proc/%u/task", process.pid);
+		int taskFd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (taskFd < 0)
+			return false;
+		now = bootTime();
+		auto success = true;
+		while (true)
+		{
+			auto size = syscall(SYS_getdents64, taskFd, m_direntBuffer.data(), m_direntBuffer.size());
+			if (size <= 0)
+			{
+				success = size == 0;
+				break;
+			}
+			for (long offset = 0; offset < size;)
+			{
+				auto entry = (const LinuxDirent64*)(m_direntBuffer.data() + offset);
+				offset += entry->d_reclen;
+				char* end = nullptr;
+				auto tid = strtoul(entry->d_name, &end, 10);
+				if (*end || end == entry->d_name)
+					continue;
+				ProcStat stat;
+				snprintf(path, sizeof(path), "/proc/%u/task/%lu/stat", process.pid, tid);
+				if (!readProcStat(path, stat))
+					continue; // exited in the meantime
+				// The main thread has the start time of the process, a mismatch means the pid was reused
+				if (tid == process.pid && stat.starttime != process.createTime)
+				{
+					close(taskFd);
+					threads.clear();
+					return false;
+				}
+
+				ThreadCounters thread;
+				thread.tid = uint32_t(tid);
+				thread.createTime = stat.starttime;
+				thread.kernelTime = stat.stime * 10000000 / m_clockTicks;
+				thread.userTime = stat.utime * 10000000 / m_clockTicks;
+				switch (stat.state)
+				{
+				case 'R':
+					thread.state = ThreadState::Running;
+					break;
+				case 'S':
+				case 'D':
+				case 'I':
+					thread.state = ThreadState::Waiting;
+					break;
+				default:
+					thread.state = ThreadState::Other;
+					break;
+				}
+				static_assert(sizeof(thread.name) >= sizeof(stat.comm), "thread name");
+				memcpy(thread.name, stat.comm, sizeof(stat.comm));
+
+				// Run time, wait time and number of times the thread was switched to (needs schedstats)
+				char buf[128];
+				snprintf(path, sizeof(path), "/proc/%u/task/%lu/schedstat", process.pid, tid);
+				if (readProcFile(path, buf, sizeof(buf)) > 0)
+				{
+					char* p = buf;
+					strtoull(p, &p, 10);
+					strtoull(p, &p, 10);
+					thread.contextSwitches = uint32_t(strtoull(p, &p, 10));
+				}
+				threads.push_back(thread);
+			}
+		}
+		close(taskFd);
+		return success;
+	}
+
+	// smaps_rollup only has totals, the mappings of smaps are categorized by their path instead
+	bool queryMemoryComposition(uint32_t pid, uint64_t createTime, MemoryComposition& composition) override
+	{
+		ProcStat stat;
+		if (!readProcStat(pid, stat) || stat.starttime != createTime)
+			return false;
+		char path[64];
+		snprintf(path, sizeof(path), "/proc/%u/smaps", pid);
+		FILE* smaps = fopen(path, "re");
+		if (!smaps)
+			return false;
+
+		// Libraries also map their headers and data without execute permission, so a file is an
+		// image when any of its mappings is executable, which is only known at the end
+		struct FileMapping
+		{
+			uint64_t inode;
+			uint64_t bytes;
+		};
+		std::vector<FileMapping> fileMappings;
+		std::vector<uint64_t> imageInodes;
+
+		composition = MemoryComposition();
+		uint64_t* current = nullptr; // receives the memory of the current mapping
+		char line[512];
+		while (fgets(line, sizeof(line), smaps))
+		{
+			auto length = strlen(line);
+			if (length && line[length - 1] == '\n')
+				line[--length] = '\0';
+			else
+			{
+				// Only the start of a long path is needed
+				int c;
+				while ((c = fgetc(smaps)) != EOF && c != '\n')
+					;
+			}
+
+			// "Key: 1234 kB" lines follow the header of their mapping
+			if (line[0] >= 'A' && line[0] <= 'Z')
+			{
+				uint64_t kb = 0;
+				if (strncmp(line, "Rss:", 4) == 0)
+					kb = strtoull(line + 4, nullptr, 10);
+				else if (strncmp(line, "Swap:", 5) == 0)
+					kb = strtoull(line + 5, nullptr, 10);
+				if (current)
+					*current += kb * 1024;
+				continue;
+			}
+
+			// start-end perms offset dev inode path
+			char perms[5] = "";
+			unsigned long long inode = 0;
+			int pathOffset = 0;
+			current = nullptr;
+			if (sscanf(line, "%*x-%*x %4s %*x %*x:%*x %llu %n", perms, &inode, &pathOffset) != 2 || !pathOffset)
+				continue;
+			const char* mappingPath = line + pathOffset;
+			auto shared = perms[3] == 's';
+			if (!*mappingPath)
+				current = &composition.bytes[shared ? MemoryShareable : MemoryPrivate];
+			else if (*mappingPath == '[')
+			{
+				if (strcmp(mappingPath, "[heap]") == 0)
+					current = &composition.bytes[MemoryHeap];
+				else if (strncmp(mappingPath, "[stack", 6) == 0)
+					current = &composition.bytes[MemoryStack];
+				else if (strncmp(mappingPath, "[anon_shmem:", 12) == 0)
+					current = &composition.bytes[MemoryShareable];
+				else if (strncmp(mappingPath, "[anon:", 6) == 0)
+					current = &composition.bytes[MemoryPrivate];
+				else
+					current = &composition.bytes[MemoryImage]; // vdso and friends
+			}
+			else if (shared && (strncmp(mappingPath, "/dev/zero", 9) == 0 || strncmp(mappingPath, "/dev/shm/", 9) == 0 || strncmp(mappingPath, "/memfd:", 7) == 0 || strncmp(mappingPath, "/SYSV", 5) == 0))
+				current = &composition.bytes[MemoryShareable];
+			else if (perms[2] == 'x')
+			{
+				imageInodes.push_back(inode);
+				current = &composition.bytes[MemoryImage];
+			}
+			else
+			{
+				fileMappings.push_back({ inode, 0 });
+				current = &fileMappings.back().bytes;
+			}
+		}
+		fclose(smaps);
+
+		for (auto& mapping : fileMappings)
+		{
+			auto image = std::find(imageInodes.begin(), imageInodes.end(), mapping.inode) != imageInodes.end();
+			composition.bytes[image ? MemoryImage : MemoryMapped] += mapping.bytes;
+		}
+		return true;
+	}
+
+	bool querySelf(MemoryCounters& memory, CpuTimes& cpu) override
+	{
+		ProcStat stat;
+		ProcessInfo self;
+		self.pid = currentProcessId();
+		if (!readProcStat(self.pid, stat))
+			return false;
+		self.createTime = stat.starttime;
+		IoCounters io;
+		return queryProcess(self, memory, cpu, io);
+	}
+
+	uint32_t currentProcessId() const override
+	{
+		return uint32_t(getpid());
+	}
+
+	unsigned numberOfProcessors() const override
+	{
+		return unsigned(sysconf(_SC_NPROCESSORS_ONLN));
+	}
+
+	void logSystemInformation(FILE* logFile) override
+	{
+		char szComputerName[256] = "";
+		gethostname(szComputerName, sizeof(szComputerName) - 1);
+		fprintf(logFile, "Computer name: %s\n", szComputerName);
+		struct sysinfo info = { };
+		if (sysinfo(&info) == 0)
+		{
+			uint64_t totalPhys = uint64_t(info.totalram) * info.mem_unit;
+			uint64_t availPhys = uint64_t(info.freeram + info.bufferram) * info.mem_unit;
+			uint64_t totalSwap = uint64_t(info.totalswap) * info.mem_unit;
+			uint64_t availSwap = uint64_t(info.freeswap) * info.mem_unit;
+			fprintf(logFile, "There is %u percent of memory in use.\n", totalPhys ? unsigned((totalPhys - availPhys) * 100 / totalPhys) : 0);
+			fprintf(logFile, "There are %s total of physical memory.\n", humanReadableSize(totalPhys).c_str());
+			fprintf(logFile, "There are %s free of physical memory.\n", humanReadableSize(availPhys).c_str());
+			fprintf(logFile, "There are %s total of swap.\n", humanReadableSize(totalSwap).c_str());
+			fprintf(logFile, "There are %s free of swap.\n", humanReadableSize(availSwap).c_str());
+		}
+	}
+};
+
+std::unique_ptr<ProcessSource> createProcessSource()
+{
+	return std::make_unique<LinuxProcessSource>();
+}
+
+FILE* connectLiveStream(const std::string& name)
+{
+	// QLocalServer puts names that are not absolute into the temporary directory
+	auto path = name;
+	if (path.empty() || path[0] != '/')
+	{
+		auto tmp = getenv("TMPDIR");
+		path = std::string(tmp && *tmp ? tmp : "/tmp") + "/" + name;
+	}
+	sockaddr_un address = { };
+	if (path.size() >= sizeof(address.sun_path))
+		return nullptr;
+	address.sun_family = AF_UNIX;
+	memcpy(address.sun_path, path.c_str(), path.size() + 1);
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return nullptr;
+	if (connect(fd, (const sockaddr*)&address, sizeof(address)) != 0)
+	{
+		close(fd);
+		return nullptr;
+	}
+	// A viewer that goes away makes the writes fail instead of killing Onlooker. The monitored
+	// processes were started before, so they do not inherit this.
+	signal(SIGPIPE, SIG_IGN);
+	FILE* fp = fdopen(fd, "wb");
+	if (!fp)
+		close(fd);
+	return fp;
+}
+
+static std::atomic<bool> dumpRequested;
+
+static void dumpSignalHandler(int)
+{
+	dumpRequested = true;
+}
+
+std::string listenForDumpRequests()
+{
+	struct sigaction action = { };
+	action.sa_handler = dumpSignalHandler;
+	action.sa_flags = SA_RESTART;
+	sigemptyset(&action.sa_mask);
+	if (sigaction(SIGUSR1, &action, nullptr) != 0)
+		return std::string();
+	return "kill -USR1 " + std::to_string(getpid());
+}
+
+bool takeDumpRequest()
+{
+	return dumpRequested.exchange(false);
+}
+
+#endif // __linux__
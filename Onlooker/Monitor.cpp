@@ -0,0 +1,565 @@
+#include "Monitor.h"
+#include "ProcessTimeSeries.h"
+#include "ProcessTree.h"
+#include "SystemTop.h"
+#include "SubtreeRollup.h"
+#include "CompositionSampler.h"
+#include "BurstTrigger.h"
+#include "TickScheduler.h"
+#include "Compression.h"
+
+#include <cstdlib>
+#include <cctype>
+#include <cstring>
+#include <cinttypes>
+
+#include <algorithm>
+
+// Output files of one monitored root, or of the system-wide recording
+struct MonitoredRoot
+{
+	uint32_t pid = 0;
+	FILE* logFile = nullptr;
+	std::unique_ptr<BurstTrigger> burstTrigger; // fed by the time series, outlives it
+	std::unique_ptr<BurstTrigger> dumpTrigger;
+	std::unique_ptr<ProcessTimeSeries> timeSeries;
+	std::unique_ptr<SystemTop> systemTop; // samples every process instead of the tree of the pid
+	std::unique_ptr<SubtreeRollup> subtreeRollup;
+};
+
+// Returns true when tracked processes of any root started or exited. The compositions are the
+// walks the slow tier finished since the previous tick.
+static bool enumerateProcesses(ProcessSource& source, ProcessTree& tree, std::vector<MonitoredRoot>& roots, TickScheduler& scheduler, const std::vector<CompositionSampler::Sample>& compositions)
+{
+	// A single snapshot per tick, regardless of the number of roots
+	auto snapshotStart = monotonicMicroseconds();
+	if (!tree.update())
+		return false;
+	auto snapshotTime = monotonicMicroseconds() - snapshotStart;
+
+	// Samples are stamped with the grid point of the tick, not the time they were taken. A replay
+	// is stamped with the time the snapshot was captured at.
+	uint64_t captureTime = 0;
+	if (source.captureTime(captureTime))
+		scheduler.replayTick(captureTime);
+	auto lt = toTickTime(scheduler.tickTime() / 1000);
+
+	auto processesChanged = false;
+	for (uint32_t root = 0; root < roots.size(); root++)
+	{
+		ProcessTimeSeries& timeSeries = *roots[root].timeSeries;
+		for (auto index : tree.removed())
+			timeSeries.processExited(tree.node(index).uniqueProcess);
+		for (auto index : tree.added())
+			timeSeries.processStarted(tree.node(index).uniqueProcess);
+
+		timeSeries.startTick(lt, roots[root].pid, scheduler, snapshotTime);
+		if (roots[root].systemTop)
+		{
+			roots[root].systemTop->sample(tree, lt);
+			timeSeries.endTick();
+			continue;
+		}
+		SubtreeRollup* subtreeRollup = roots[root].subtreeRollup.get();
+		for (auto index : tree.tracked(root))
+		{
+			const ProcessTree::Node& node = tree.node(index);
+			ProcessData sample;
+			if (timeSeries.logTickData(lt, node.uniqueProcess, node.info, sample) && subtreeRollup)
+				subtreeRollup->addSample(index, sample);
+		}
+		if (subtreeRollup)
+			subtreeRollup->endTick(tree, lt);
+		for (const auto& composition : compositions)
+		{
+			// The process can have exited or its pid be reused since it was walked
+			auto index = tree.find(composition.pid);
+			if (index == ProcessTree::NoNode)
+				continue;
+			const ProcessTree::Node& node = tree.node(index);
+			if (node.uniqueProcess.id == composition.id && (node.trackedBy & (1ull << root)))
+				timeSeries.addComposition(lt, node.uniqueProcess, composition.composition, composition.walkTime);
+		}
+		timeSeries.endTick();
+		processesChanged |= tree.trackedChanges(root) != 0;
+	}
+	return processesChanged;
+}
+
+// Value of ONLOOKER_FLIGHT_RECORDER: <minutes>[,<MB>][,<rule>...]
+static bool parseFlightRecorder(const char* str, std::chrono::milliseconds& window, size_t& bytes, std::vector<BurstTrigger::Rule>& rules)
+{
+	double minutes = 0;
+	int length = 0;
+	if (sscanf(str, "%lf%n", &minutes, &length) != 1 || !(minutes > 0) || !(minutes * 60 * 1000 < double(INT64_MAX)))
+		return false;
+	window = std::chrono::milliseconds(int64_t(minutes * 60 * 1000));
+	str += length;
+	unsigned long long megabytes = 64;
+	if (str[0] == ',' && str[1] >= '0' && str[1] <= '9')
+	{
+		// The ring has to fit into the address space, a larger one fails to allocate later
+		if (sscanf(str, ",%llu%n", &megabytes, &length) != 1 || megabytes == 0 || megabytes > SIZE_MAX / (1024 * 1024))
+			return false;
+		str += length;
+	}
+	bytes = size_t(megabytes * 1024 * 1024);
+	rules.clear();
+	if (!*str)
+		return true;
+	return *str == ',' && BurstTrigger::parseRules(str + 1, rules);
+}
+
+bool monitorProcessTree(ProcessSource& source, uint32_t monitoredPid, const std::atomic<bool>& stop)
+{
+	return monitorProcessTrees(source, std::vector<uint32_t>{ monitoredPid }, std::vector<int32_t>(), stop);
+}
+
+bool monitorProcessTrees(ProcessSource& source, const std::vector<uint32_t>& monitoredPids, const std::vector<int32_t>& exitCodes, const std::atomic<bool>& stop)
+{
+	std::vector<uint32_t> pids;
+	for (auto pid : monitoredPids)
+	{
+		if (std::find(pids.begin(), pids.end(), pid) == pids.end())
+			pids.push_back(pid);
+	}
+	if (pids.empty() || pids.size() > ProcessTree::MaxRoots)
+	{
+		fprintf(stderr, "[Onlooker] Between 1 and %u processes can be monitored.\n", ProcessTree::MaxRoots);
+		return false;
+	}
+
+	// "query" opens every tracked process on every tick, "snapshot" reads the counters from the snapshot
+	auto snapshotSampling = false;
+	auto szSampling = getenv("ONLOOKER_SAMPLING");
+	if (szSampling && *szSampling)
+	{
+		if (strcmp(szSampling, "snapshot") == 0)
+			snapshotSampling = true;
+		else if (strcmp(szSampling, "query") == 0)
+			snapshotSampling = false;
+		else
+			fprintf(stderr, "[Onlooker] Unknown sampling mode '%s'.\n", szSampling);
+	}
+	if (snapshotSampling && !source.hasSnapshotCounters())
+	{
+		fprintf(stderr, "[Onlooker] Snapshot sampling is not supported on this platform, querying every process.\n");
+		snapshotSampling = false;
+	}
+
+	// Per-thread CPU usage and context switches of the tracked processes
+	auto threadSampling = false;
+	auto szThreads = getenv("ONLOOKER_THREADS");
+	if (szThreads && *szThreads)
+		threadSampling = strcmp(szThreads, "0") != 0;
+
+	// Per-tick totals of every tracked subtree
+	auto subtreeRollups = false;
+	auto szRollups = getenv("ONLOOKER_ROLLUPS");
+	if (szRollups && *szRollups)
+		subtreeRollups = strcmp(szRollups, "0") != 0;
+
+	// The ticks layout is written as the run goes, a killed run keeps the trace up to its last tick
+	auto traceFormat = TraceFormat::JsonTicks;
+	auto szTraceFormat = getenv("ONLOOKER_TRACE_FORMAT");
+	if (szTraceFormat && *szTraceFormat && !parseTraceFormat(szTraceFormat, traceFormat))
+		fprintf(stderr, "[Onlooker] Unknown trace format '%s', using json-ticks.\n", szTraceFormat);
+
+	// gzip streams instead of the plain log, trace and CSV files
+	auto szCompress = getenv("ONLOOKER_COMPRESS");
+	if (szCompress && *szCompress)
+	{
+		int level = 0;
+		if (!parseCompression(szCompress, level))
+			fprintf(stderr, "[Onlooker] Invalid ONLOOKER_COMPRESS '%s', expected gzip[,<level 1-9>].\n", szCompress);
+		else if (!compressionSupported())
+			fprintf(stderr, "[Onlooker] ONLOOKER_COMPRESS is not supported, Onlooker was built without zlib.\n");
+		else
+			setOutputCompression(level);
+	}
+
+	// Metrics, unit and process filter of the CSV file
+	CsvColumns csvColumns;
+	auto szCsv = getenv("ONLOOKER_CSV");
+	if (szCsv && *szCsv && !CsvColumns::parse(szCsv, csvColumns))
+	{
+		fprintf(stderr, "[Onlooker] Invalid ONLOOKER_CSV '%s', expected <metric>[+<metric>...][,B|K|M|G][,[<metric>]><threshold>].\n", szCsv);
+		csvColumns = CsvColumns();
+	}
+
+	// Records buffered for the writer thread, one per sample plus two per tick
+	size_t writerQueue = 8192;
+	auto szWriterQueue = getenv("ONLOOKER_WRITER_QUEUE");
+	if (szWriterQueue && *szWriterQueue)
+	{
+		if (sscanf(szWriterQueue, "%zu", &writerQueue) != 1 || writerQueue < 16)
+		{
+			fprintf(stderr, "[Onlooker] Invalid ONLOOKER_WRITER_QUEUE '%s', using 8192 records.\n", szWriterQueue);
+			writerQueue = 8192;
+		}
+	}
+
+	// System-wide recording of the top N processes next to the trees of the roots
+	uint32_t systemTopCount = 0;
+	auto systemTopRank = SystemTop::Rank::Memory;
+	auto szSystemTop = getenv("ONLOOKER_SYSTEM_TOP");
+	if (szSystemTop && *szSystemTop && !SystemTop::parse(szSystemTop, systemTopCount, systemTopRank))
+	{
+		fprintf(stderr, "[Onlooker] Invalid ONLOOKER_SYSTEM_TOP '%s', expected <count>[,memory|cpu].\n", szSystemTop);
+		systemTopCount = 0;
+	}
+
+	// Slow tier walking the address space of the tracked processes on its own thread
+	std::chrono::milliseconds compositionInterval(0);
+	auto szComposition = getenv("ONLOOKER_MEMORY_COMPOSITION");
+	if (szComposition && *szComposition && !CompositionSampler::parse(szComposition, compositionInterval))
+	{
+		fprintf(stderr, "[Onlooker] Invalid ONLOOKER_MEMORY_COMPOSITION '%s', expected an interval of at least 10 ms.\n", szComposition);
+		compositionInterval = std::chrono::milliseconds(0);
+	}
+
+	// Short windows of fast sampling with all extras, started by rules on the memory of a tree
+	std::chrono::microseconds burstInterval(0);
+	std::chrono::milliseconds burstWindow(0);
+	std::vector<BurstTrigger::Rule> burstRules;
+	auto szBurst = getenv("ONLOOKER_BURST");
+	if (szBurst && *szBurst && !BurstTrigger::parse(szBurst, burstInterval, burstWindow, burstRules))
+	{
+		fprintf(stderr, "[Onlooker] Invalid ONLOOKER_BURST '%s', expected <interval ms>,<window ms>,<rule>[,<rule>...].\n", szBurst);
+		burstInterval = std::chrono::microseconds(0);
+		burstRules.clear();
+	}
+
+	// Always-on monitoring: only the last minutes are kept in memory and dumped on request
+	std::chrono::milliseconds flightWindow(0);
+	size_t flightBytes = 0;
+	std::vector<BurstTrigger::Rule> dumpRules;
+	std::string dumpRequest;
+	auto szFlightRecorder = getenv("ONLOOKER_FLIGHT_RECORDER");
+	if (szFlightRecorder && *szFlightRecorder)
+	{
+		if (parseFlightRecorder(szFlightRecorder, flightWindow, flightBytes, dumpRules))
+		{
+			dumpRequest = listenForDumpRequests();
+			if (!dumpRequest.empty())
+				fprintf(stderr, "[Onlooker] Flight recorder: request a dump with %s\n", dumpRequest.c_str());
+		}
+		else
+		{
+			fprintf(stderr, "[Onlooker] Invalid ONLOOKER_FLIGHT_RECORDER '%s', expected <minutes>[,<MB>][,<rule>...].\n", szFlightRecorder);
+			flightWindow = std::chrono::milliseconds(0);
+		}
+	}
+
+	// Live stream of the first tree to a waiting Cutelooker, in the binary trace format
+	std::unique_ptr<TraceWriter> liveWriter;
+	auto szLive = getenv("ONLOOKER_LIVE");
+	if (szLive && *szLive && flightWindow.count())
+	{
+		fprintf(stderr, "[Onlooker] ONLOOKER_LIVE is ignored by the flight recorder.\n");
+	}
+	else if (szLive && *szLive)
+	{
+		if (auto liveStream = connectLiveStream(szLive))
+			liveWriter = createLiveTraceWriter(liveStream);
+		else
+			fprintf(stderr, "[Onlooker] Failed to connect to the live viewer '%s', is Cutelooker waiting for it?\n", szLive);
+	}
+
+	// A replay is named after the start of the recording
+	uint64_t captureStart = 0;
+	auto lt = source.captureTime(captureStart) ? toTickTime(captureStart / 1000) : currentTime();
+	// The roots come first, their index is the root index of the ProcessTree
+	std::vector<MonitoredRoot> roots(pids.size() + (systemTopCount ? 1 : 0));
+	auto success = true;
+	for (size_t i = 0; i < roots.size() && success; i++)
+	{
+		MonitoredRoot& root = roots[i];
+		auto systemWide = i == pids.size();
+		root.pid = systemWide ? 0 : pids[i];
+
+		char basename[256] = "";
+		char suffix[32] = "system";
+		if (!systemWide)
+			snprintf(suffix, sizeof(suffix), "%u", root.pid);
+		snprintf(basename, sizeof(basename), "Onlooker_%04d-%02d-%02d_%02d-%02d-%02d_%s",
+			lt.year,
+			lt.month,
+			lt.day,
+			lt.hour,
+			lt.minute,
+			lt.second,
+			suffix
+		);
+		root.logFile = openOutput(std::string(basename) + ".log");
+		if (!root.logFile)
+		{
+			fprintf(stderr, "[Onlooker] Failed to open log file.\n");
+			success = false;
+			continue;
+		}
+		FILE* logFile = root.logFile;
+		{
+			fprintf(logFile, "Onlooker PID: 0x%X (%u)\n", source.currentProcessId(), source.currentProcessId());
+			fprintf(logFile, "Time: %" PRIu64 " (%04d-%02d-%02d %02d:%02d:%02d.%d)\n",
+				lt.time,
+				lt.year,
+				lt.month,
+				lt.day,
+				lt.hour,
+				lt.minute,
+				lt.second,
+				lt.milliseconds
+			);
+			source.logSystemInformation(logFile);
+			fprintf(logFile, "Sampling: %s%s\n", snapshotSampling ? "snapshot" : "query", threadSampling && !systemWide ? ", threads" : "");
+			if (pids.size() > 1)
+			{
+				fprintf(logFile, "Monitored roots (shared snapshot):");
+				for (auto pid : pids)
+					fprintf(logFile, " %u", pid);
+				fprintf(logFile, "\n");
+			}
+			if (liveWriter && i == 0)
+				fprintf(logFile, "Live stream: %s\n", szLive);
+			if (outputCompression())
+				fprintf(logFile, "Compression: gzip level %d\n", outputCompression());
+			if (szCsv && *szCsv && !flightWindow.count())
+				fprintf(logFile, "CSV: %s\n", csvColumns.describe().c_str());
+			if (subtreeRollups && !systemWide)
+				fprintf(logFile, "Subtree rollups: every tick, for the processes with tracked children\n");
+			if (compositionInterval.count() && !systemWide)
+				fprintf(logFile, "Memory composition: every %lld ms\n", (long long)compositionInterval.count());
+			if (!burstRules.empty())
+			{
+				fprintf(logFile, "Burst: every %.3f ms for %lld ms with threads and memory composition, when", burstInterval.count() / 1000.0, (long long)burstWindow.count());
+				for (size_t rule = 0; rule < burstRules.size(); rule++)
+					fprintf(logFile, "%s %s", rule ? " or" : "", burstRules[rule].text.c_str());
+				fprintf(logFile, "\n");
+			}
+			if (flightWindow.count())
+			{
+				auto records = ProcessTimeSeries::flightRecorderCapacity(flightBytes);
+				fprintf(logFile, "Flight recorder: last %g minutes in %zu records (%s), dumped when the run ends",
+					flightWindow.count() / 60000.0,
+					records,
+					humanReadableSize(flightBytes).c_str()
+				);
+				if (!dumpRequest.empty())
+					fprintf(logFile, ", on %s", dumpRequest.c_str());
+				for (const BurstTrigger::Rule& rule : dumpRules)
+					fprintf(logFile, "%s %s", &rule == &dumpRules.front() ? ", when" : " or", rule.text.c_str());
+				fprintf(logFile, "\n");
+			}
+			if (systemWide)
+				fprintf(logFile, "System-wide: top %u processes by %s, the others are summed up as <other>\n", systemTopCount, systemTopRank == SystemTop::Rank::Cpu ? "CPU usage" : "memory usage");
+			fprintf(logFile, "\n");
+			fflush(logFile);
+		}
+
+		root.timeSeries = std::make_unique<ProcessTimeSeries>(source, logFile, traceFormat, snapshotSampling, threadSampling && !systemWide, writerQueue);
+		root.timeSeries->setCsvColumns(csvColumns);
+		if (liveWriter && i == 0)
+			root.timeSeries->addTraceWriter(std::move(liveWriter));
+		if (!burstRules.empty() && !systemWide)
+		{
+			root.burstTrigger = std::make_unique<BurstTrigger>(burstRules);
+			root.timeSeries->addTrigger(root.burstTrigger.get());
+		}
+		if (flightWindow.count())
+		{
+			if (!root.timeSeries->setFlightRecorder(flightWindow, flightBytes))
+			{
+				fprintf(stderr, "[Onlooker] Failed to allocate the flight recorder of %s.\n", humanReadableSize(flightBytes).c_str());
+				root.timeSeries.reset();
+				success = false;
+				continue;
+			}
+			if (!dumpRules.empty() && !systemWide)
+			{
+				root.dumpTrigger = std::make_unique<BurstTrigger>(dumpRules);
+				root.timeSeries->addTrigger(root.dumpTrigger.get());
+			}
+		}
+		if (!root.timeSeries->open(basename))
+		{
+			root.timeSeries.reset();
+			success = false;
+		}
+		else if (systemWide)
+		{
+			root.systemTop = std::make_unique<SystemTop>(*root.timeSeries, systemTopCount, systemTopRank);
+		}
+		else if (subtreeRollups)
+		{
+			root.subtreeRollup = std::make_unique<SubtreeRollup>(*root.timeSeries, uint32_t(i));
+		}
+	}
+
+	// Whole milliseconds, the samples are stamped in milliseconds and every tick needs a time of its own
+	unsigned pollInterval = 100;
+	auto szPollInterval = getenv("ONLOOKER_POLL_INTERVAL");
+	if (szPollInterval && *szPollInterval)
+	{
+		int length = 0;
+		if (!isdigit((unsigned char)szPollInterval[0]) || sscanf(szPollInterval, "%u%n", &pollInterval, &length) != 1 || szPollInterval[length] || pollInterval == 0)
+		{
+			fprintf(stderr, "[Onlooker] Invalid ONLOOKER_POLL_INTERVAL '%s', expected whole milliseconds.\n", szPollInterval);
+			pollInterval = 100;
+		}
+	}
+
+	std::unique_ptr<AdaptiveInterval> adaptiveInterval;
+	auto szAdaptiveInterval = getenv("ONLOOKER_ADAPTIVE_INTERVAL");
+	if (szAdaptiveInterval && *szAdaptiveInterval)
+	{
+		std::chrono::microseconds minInterval, maxInterval;
+		double threshold = 0;
+		if (AdaptiveInterval::parse(szAdaptiveInterval, minInterval, maxInterval, threshold))
+			adaptiveInterval = std::make_unique<AdaptiveInterval>(minInterval, maxInterval, threshold);
+		else
+			fprintf(stderr, "[Onlooker] Invalid ONLOOKER_ADAPTIVE_INTERVAL '%s', expected <min ms>,<max ms>[,<threshold MB/s>].\n", szAdaptiveInterval);
+	}
+
+	ProcessTree tree(source);
+	for (auto pid : pids)
+		tree.addRoot(pid);
+	auto baseInterval = adaptiveInterval ? adaptiveInterval->minInterval() : std::chrono::microseconds(std::chrono::milliseconds(pollInterval));
+	TickScheduler scheduler(baseInterval);
+
+	// Without ONLOOKER_MEMORY_COMPOSITION the slow tier only walks during bursts, as fast as it can
+	auto burstCompositionInterval = std::max(std::chrono::duration_cast<std::chrono::milliseconds>(burstInterval), std::chrono::milliseconds(10));
+	std::unique_ptr<CompositionSampler> compositionSampler;
+	if ((compositionInterval.count() || !burstRules.empty()) && success)
+		compositionSampler = std::make_unique<CompositionSampler>(source, compositionInterval.count() ? compositionInterval : burstCompositionInterval);
+	std::vector<CompositionSampler::Sample> compositions;
+	std::vector<CompositionSampler::Target> compositionTargets;
+
+	auto bursting = false;
+	uint64_t burstEnd = 0; // microseconds since epoch, like the tick time
+	while (!stop && success)
+	{
+		compositions.clear();
+		if (compositionSampler)
+			compositionSampler->takeSamples(compositions);
+		auto processesChanged = enumerateProcesses(source, tree, roots, scheduler, compositions);
+		if (source.finished())
+			break;
+
+		// A rule firing during a burst extends it
+		auto burstChanged = false;
+		if (!burstRules.empty())
+		{
+			const BurstTrigger::Rule* fired = nullptr;
+			uint32_t firedRoot = 0;
+			for (uint32_t root = 0; root < roots.size(); root++)
+			{
+				if (!roots[root].burstTrigger)
+					continue;
+				auto rule = roots[root].burstTrigger->endTick();
+				if (rule && !fired)
+				{
+					fired = rule;
+					firedRoot = root;
+				}
+			}
+			if (fired)
+			{
+				char message[256] = "";
+				snprintf(message, sizeof(message), "%s: %s in the tree of %u, sampling every %.3f ms for %lld ms",
+					bursting ? "extended" : "started",
+					fired->text.c_str(),
+					roots[firedRoot].pid,
+					burstInterval.count() / 1000.0,
+					(long long)burstWindow.count()
+				);
+				for (MonitoredRoot& root : roots)
+					root.timeSeries->logBurst(message);
+				burstChanged = !bursting;
+				bursting = true;
+				burstEnd = scheduler.tickTime() + uint64_t(burstWindow.count()) * 1000;
+			}
+			else if (bursting && scheduler.tickTime() >= burstEnd)
+			{
+				for (MonitoredRoot& root : roots)
+					root.timeSeries->logBurst("ended");
+				burstChanged = true;
+				bursting = false;
+			}
+		}
+		// Dumped before the next tick, so the dump holds the tick that fired
+		if (flightWindow.count())
+		{
+			auto requested = takeDumpRequest();
+			for (MonitoredRoot& root : roots)
+			{
+				auto rule = root.dumpTrigger ? root.dumpTrigger->endTick() : nullptr;
+				if (requested)
+					root.timeSeries->dump("requested");
+				else if (rule)
+					root.timeSeries->dump(rule->text);
+			}
+		}
+
+		if (burstChanged)
+		{
+			scheduler.setInterval(bursting ? burstInterval : baseInterval);
+			for (MonitoredRoot& root : roots)
+			{
+				if (root.burstTrigger && !threadSampling)
+					root.timeSeries->setThreadSampling(bursting);
+			}
+			if (compositionInterval.count())
+				compositionSampler->setInterval(bursting ? burstCompositionInterval : compositionInterval);
+		}
+
+		// The system-wide recording is not walked, only the trees of the roots
+		if (compositionSampler && (processesChanged || burstChanged))
+		{
+			compositionTargets.clear();
+			for (const ProcessTree::Node& node : tree.nodes())
+			{
+				if (node.alive && node.trackedBy && (compositionInterval.count() || bursting))
+					compositionTargets.push_back({ node.uniqueProcess.id, node.info.pid, node.info.createTime });
+			}
+			compositionSampler->setTargets(compositionTargets);
+			if (burstChanged && bursting && !compositionInterval.count())
+				compositionSampler->setInterval(burstCompositionInterval);
+		}
+
+		if (adaptiveInterval && !bursting)
+		{
+			uint64_t memoryChange = 0;
+			for (const MonitoredRoot& root : roots)
+				memoryChange += root.timeSeries->memoryChange();
+			scheduler.setInterval(adaptiveInterval->next(scheduler.interval(), memoryChange, processesChanged));
+		}
+
+		scheduler.waitNextTick();
+	}
+
+	compositionSampler.reset();
+	// Only complete once the caller stopped the monitoring
+	auto exited = stop.load();
+	for (MonitoredRoot& root : roots)
+	{
+		auto monitored = std::find(monitoredPids.begin(), monitoredPids.end(), root.pid);
+		auto exitCode = size_t(monitored - monitoredPids.begin());
+		if (root.timeSeries && exited && exitCode < exitCodes.size())
+			root.timeSeries->setExitCode(exitCodes[exitCode]);
+		// The series refers to the names of the system top until it is closed
+		if (root.timeSeries && !root.timeSeries->close())
+			success = false;
+		root.systemTop.reset();
+		root.timeSeries.reset();
+		if (root.logFile)
+			fclose(root.logFile);
+	}
+	if (!finishOutputs())
+	{
+		fprintf(stderr, "[Onlooker] Failed to write compressed output.\n");
+		success = false;
+	}
+
+	return success;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "ProcessSource.h"
+
+#include <atomic>
+#include <vector>
+
+// Sample the process tree of monitoredPid until stop is set, then write the trace files
+bool monitorProcessTree(ProcessSource& source, uint32_t monitoredPid, const std::atomic<bool>& stop);
+
+// Sample several process trees from a single snapshot per tick, every root gets its own trace files.
+// The exit codes of the monitored processes are in the same order and complete when stop is set,
+// empty when they are not known.
+bool monitorProcessTrees(ProcessSource& source, const std::vector<uint32_t>& monitoredPids, const std::vector<int32_t>& exitCodes, const std::atomic<bool>& stop);
@@ -0,0 +1,141 @@
+#pragma once
+
+#include "ProcessSource.h"
+
+#include <string>
+
+// Identity of a process instance, assigned once when the process is first seen. The low
+// 32 bits are the pid and the high 32 bits a serial number, so a process reusing the pid
+// of an exited one (or replacing its image) never shares the identity of the old one.
+typedef uint64_t ProcessId;
+
+struct UniqueProcess
+{
+	ProcessId id = 0;
+	uint32_t pid = -1;
+	uint32_t ppid = -1;
+	uint64_t createTime = 0;
+	const std::string* name = nullptr; // interned in the StringTable of the ProcessTree
+
+	UniqueProcess() = default;
+	UniqueProcess(ProcessId id, const ProcessInfo& info, const std::string* name) :
+		id(id),
+		pid(info.pid),
+		ppid(info.ppid),
+		createTime(info.createTime),
+		name(name)
+	{
+	}
+
+	bool operator<(const UniqueProcess& o) const
+	{
+		return id < o.id;
+	}
+
+	bool operator==(const UniqueProcess& o) const
+	{
+		return id == o.id;
+	}
+
+	bool operator!=(const UniqueProcess& o) const
+	{
+		return !(*this == o);
+	}
+};
+
+// Cost of sampling a tick, measured by Onlooker on itself. Durations are in microseconds.
+struct OverheadData
+{
+	uint64_t time = 0;
+	uint64_t tick = 0; // number of the tick on the schedule grid
+	uint32_t interval = 0; // interval since the previous grid point, changes with adaptive sampling
+	uint64_t snapshotTime = 0; // enumerating the processes
+	uint32_t queryCount = 0; // per-process counter queries
+	uint64_t queryTime = 0;
+	uint64_t writeTime = 0; // formatting and writing the log, trace and csv, done by the writer thread
+	uint64_t queueTime = 0; // handing the tick to the writer thread
+	uint32_t queuedRecords = 0; // records still waiting for the writer when the tick was queued
+	uint32_t droppedTicks = 0; // ticks dropped so far because the writer fell behind
+	double cpuUsage = 0.0; // of Onlooker
+	size_t workingSetSize = 0; // of Onlooker
+	uint32_t missedDeadlines = 0; // ticks skipped so far because sampling took longer than the interval
+};
+
+// I/O throughput since the previous sample, per second
+struct IoUsage
+{
+	uint64_t readBytes = 0;
+	uint64_t writeBytes = 0;
+	uint64_t readOperations = 0;
+	uint64_t writeOperations = 0;
+};
+
+// A single sample of a process
+struct ProcessData
+{
+	uint64_t time = 0;
+	MemoryCounters memory;
+	double cpuUsage = 0.0;
+	IoUsage io;
+	uint64_t cpuTime = 0; // kernel and user since the process started, 100ns units
+	uint64_t cycleTime = 0; // processor cycles since the process started, 0 when not counted
+
+	ProcessData() = default;
+
+	ProcessData(uint64_t time, const MemoryCounters& memory, double cpuUsage, const IoUsage& io) :
+		time(time),
+		memory(memory),
+		cpuUsage(cpuUsage),
+		io(io)
+	{
+	}
+};
+
+// A single sample of a thread, usages are in percent of one processor since the previous sample
+struct ThreadData
+{
+	uint64_t time = 0;
+	uint32_t index = 0; // assigned by ProcessTimeSeries when the thread is first seen, unique in the trace
+	uint32_t tid = 0;
+	uint64_t createTime = 0;
+	const std::string* name = nullptr; // interned, can be empty
+	double userUsage = 0.0;
+	double kernelUsage = 0.0;
+	uint32_t contextSwitches = 0; // since the previous sample
+	ThreadState state = ThreadState::Other;
+	uint8_t waitReason = 0;
+};
+
+// Memory composition of a process, sampled by the slow tier and added to the next tick
+struct CompositionData
+{
+	uint64_t time = 0;
+	uint64_t walkTime = 0; // microseconds spent walking the address space
+	MemoryComposition composition;
+};
+
+// Totals of a process and its tracked descendants that were sampled in the same tick
+struct RollupData
+{
+	uint64_t time = 0;
+	uint64_t workingSetSize = 0;
+	uint64_t privateUsage = 0;
+	double cpuUsage = 0.0; // percent of all processors
+	uint32_t processCount = 0; // including the process itself
+};
+
+// Aggregates of a process, or of all processes of a trace, over the whole run. The peaks of
+// all processes are those of the sums of the samples of a tick.
+struct SummaryData
+{
+	uint64_t startTime = 0; // first sample, ms since epoch
+	uint64_t endTime = 0; // last sample
+	uint64_t peakWorkingSetSize = 0;
+	uint64_t peakPrivateUsage = 0;
+	uint64_t peakTime = 0; // of the peak working set
+	double workingSetIntegral = 0.0; // bytes * ms, every sample weighed with the time since the previous one
+	uint64_t cpuTime = 0; // kernel and user, 100ns units
+	uint32_t processCount = 0;
+	bool hasExitCode = false; // only the monitored processes that Onlooker started have one
+	int32_t exitCode = 0;
+};
@@ -0,0 +1,374 @@
+#include "ProcessSnapshot.h"
+#include "Monitor.h"
+#include "Utils.h"
+
+#include <cstring>
+#include <cstdlib>
+#include <cinttypes>
+
+#include <algorithm>
+
+// Offsets in SYSTEM_PROCESS_INFORMATION that depend on the pointer size, see native.h
+struct SnapshotLayout
+{
+	size_t imageNameBuffer;
+	size_t uniqueProcessId;
+	size_t inheritedFromUniqueProcessId;
+	size_t pageFaultCount;
+	size_t peakWorkingSetSize; // followed by the other SIZE_T counters
+	size_t readOperationCount; // followed by the other LARGE_INTEGER I/O counters
+	size_t threads; // sizeof(SYSTEM_PROCESS_INFORMATION) without the threads
+};
+
+static const SnapshotLayout SnapshotLayout32 = { 0x3C, 0x44, 0x48, 0x60, 0x64, 0x88, 0xB8 };
+static const SnapshotLayout SnapshotLayout64 = { 0x40, 0x50, 0x58, 0x80, 0x88, 0xD0, 0x100 };
+
+// Offsets in SYSTEM_THREAD_INFORMATION that depend on the pointer size
+struct SnapshotThreadLayout
+{
+	size_t uniqueThread;
+	size_t contextSwitches; // followed by ThreadState and WaitReason
+	size_t size;
+};
+
+static const SnapshotThreadLayout SnapshotThreadLayout32 = { 0x24, 0x30, 0x40 };
+static const SnapshotThreadLayout SnapshotThreadLayout64 = { 0x30, 0x40, 0x50 };
+
+// Same in both layouts
+static const size_t NumberOfThreadsOffset = 0x04;
+static const size_t CycleTimeOffset = 0x18;
+static const size_t CreateTimeOffset = 0x20;
+static const size_t UserTimeOffset = 0x28;
+static const size_t KernelTimeOffset = 0x30;
+static const size_t ImageNameLengthOffset = 0x38;
+static const size_t ThreadKernelTimeOffset = 0x00;
+static const size_t ThreadUserTimeOffset = 0x08;
+static const size_t ThreadCreateTimeOffset = 0x10;
+
+static uint64_t readLittleEndian(const uint8_t* p, size_t size)
+{
+	uint64_t value = 0;
+	for (size_t i = 0; i < size; i++)
+		value |= uint64_t(p[i]) << (i * 8);
+	return value;
+}
+
+bool parseProcessSnapshot(const uint8_t* buffer, size_t size, unsigned pointerSize, uint64_t baseAddress, std::vector<SnapshotProcess>& processes)
+{
+	processes.clear();
+	if (pointerSize != 4 && pointerSize != 8)
+		return false;
+	const SnapshotLayout& layout = pointerSize == 8 ? SnapshotLayout64 : SnapshotLayout32;
+
+	size_t offset = 0;
+	while (offset + layout.threads <= size)
+	{
+		auto entry = buffer + offset;
+		auto field = [&](size_t fieldOffset, size_t fieldSize)
+		{
+			return readLittleEndian(entry + fieldOffset, fieldSize);
+		};
+
+		SnapshotProcess process;
+		process.entry = entry;
+		process.numberOfThreads = uint32_t(field(NumberOfThreadsOffset, 4));
+		process.cycleTime = field(CycleTimeOffset, 8);
+		process.createTime = field(CreateTimeOffset, 8);
+		process.userTime = field(UserTimeOffset, 8);
+		process.kernelTime = field(KernelTimeOffset, 8);
+		process.pid = uint32_t(field(layout.uniqueProcessId, pointerSize));
+		process.ppid = uint32_t(field(layout.inheritedFromUniqueProcessId, pointerSize));
+
+		// The name points into the buffer, ignore it if it does not
+		auto nameLength = uint32_t(field(ImageNameLengthOffset, 2));
+		auto nameAddress = field(layout.imageNameBuffer, pointerSize);
+		if (nameLength && nameAddress >= baseAddress && nameAddress - baseAddress <= size && nameLength <= size - (nameAddress - baseAddress))
+		{
+			process.imageName = buffer + (nameAddress - baseAddress);
+			process.imageNameLength = nameLength;
+		}
+
+		MemoryCounters& memory = process.memory;
+		memory.pageFaultCount = uint32_t(field(layout.pageFaultCount, 4));
+		size_t counters[9];
+		for (size_t i = 0; i < 9; i++)
+			counters[i] = size_t(field(layout.peakWorkingSetSize + i * pointerSize, pointerSize));
+		memory.peakWorkingSetSize = counters[0];
+		memory.workingSetSize = counters[1];
+		memory.quotaPeakPagedPoolUsage = counters[2];
+		memory.quotaPagedPoolUsage = counters[3];
+		memory.quotaPeakNonPagedPoolUsage = counters[4];
+		memory.quotaNonPagedPoolUsage = counters[5];
+		memory.pagefileUsage = counters[6];
+		memory.peakPagefileUsage = counters[7];
+		memory.privateUsage = counters[8]; // PrivatePageCount is in bytes
+
+		IoCounters& io = process.io;
+		io.readOperationCount = field(layout.readOperationCount, 8);
+		io.writeOperationCount = field(layout.readOperationCount + 8, 8);
+		io.otherOperationCount = field(layout.readOperationCount + 16, 8);
+		io.readTransferCount = field(layout.readOperationCount + 24, 8);
+		io.writeTransferCount = field(layout.readOperationCount + 32, 8);
+		io.otherTransferCount = field(layout.readOperationCount + 40, 8);
+
+		// The threads follow the fixed part of the entry, only keep the ones inside of it
+		auto next = uint32_t(field(0, 4));
+		auto entrySize = next ? std::min(size_t(next), size - offset) : size - offset;
+		auto threadSize = pointerSize == 8 ? SnapshotThreadLayout64.size : SnapshotThreadLayout32.size;
+		process.threads = entry + layout.threads;
+		auto threadsFit = entrySize > layout.threads ? (entrySize - layout.threads) / threadSize : 0;
+		process.numberOfThreads = uint32_t(std::min(size_t(process.numberOfThreads), threadsFit));
+		processes.push_back(process);
+
+		if (next == 0)
+			return true;
+		offset += next;
+	}
+	// Truncated entry
+	return false;
+}
+
+std::string snapshotImageName(const SnapshotProcess& process)
+{
+	std::string name;
+	name.reserve(process.imageNameLength / 2);
+	for (uint32_t i = 0; i + 1 < process.imageNameLength; i += 2)
+	{
+		uint32_t c = uint32_t(readLittleEndian(process.imageName + i, 2));
+		if (c >= 0xD800 && c < 0xDC00 && i + 3 < process.imageNameLength)
+		{
+			uint32_t low = uint32_t(readLittleEndian(process.imageName + i + 2, 2));
+			if (low >= 0xDC00 && low < 0xE000)
+			{
+				c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+				i += 2;
+			}
+		}
+		if (c < 0x80)
+		{
+			name += char(c);
+		}
+		else if (c < 0x800)
+		{
+			name += char(0xC0 | (c >> 6));
+			name += char(0x80 | (c & 0x3F));
+		}
+		else if (c < 0x10000)
+		{
+			name += char(0xE0 | (c >> 12));
+			name += char(0x80 | ((c >> 6) & 0x3F));
+			name += char(0x80 | (c & 0x3F));
+		}
+		else
+		{
+			name += char(0xF0 | (c >> 18));
+			name += char(0x80 | ((c >> 12) & 0x3F));
+			name += char(0x80 | ((c >> 6) & 0x3F));
+			name += char(0x80 | (c & 0x3F));
+		}
+	}
+	return name;
+}
+
+void snapshotCpuTimes(const SnapshotProcess& process, uint64_t time, CpuTimes& cpu)
+{
+	cpu.now = time;
+	cpu.kernelTime = process.kernelTime;
+	cpu.userTime = process.userTime;
+	cpu.startTime = process.createTime;
+	cpu.cycleTime = process.cycleTime;
+}
+
+void snapshotThreads(const SnapshotProcess& process, unsigned pointerSize, std::vector<ThreadCounters>& threads)
+{
+	const SnapshotThreadLayout& layout = pointerSize == 8 ? SnapshotThreadLayout64 : SnapshotThreadLayout32;
+	threads.resize(process.numberOfThreads);
+	for (uint32_t i = 0; i < process.numberOfThreads; i++)
+	{
+		auto entry = process.threads + i * layout.size;
+		ThreadCounters& thread = threads[i];
+		thread.tid = uint32_t(readLittleEndian(entry + layout.uniqueThread, pointerSize));
+		thread.createTime = readLittleEndian(entry + ThreadCreateTimeOffset, 8);
+		thread.kernelTime = readLittleEndian(entry + ThreadKernelTimeOffset, 8);
+		thread.userTime = readLittleEndian(entry + ThreadUserTimeOffset, 8);
+		thread.contextSwitches = uint32_t(readLittleEndian(entry + layout.contextSwitches, 4));
+		// KTHREAD_STATE
+		switch (readLittleEndian(entry + layout.contextSwitches + 4, 4))
+		{
+		case 2: // Running
+			thread.state = ThreadState::Running;
+			break;
+		case 1: // Ready
+		case 3: // Standby
+		case 7: // DeferredReady
+			thread.state = ThreadState::Ready;
+			break;
+		case 5: // Waiting
+		case 9: // WaitingForProcessInSwap
+			thread.state = ThreadState::Waiting;
+			break;
+		default:
+			thread.state = ThreadState::Other;
+			break;
+		}
+		thread.waitReason = uint8_t(readLittleEndian(entry + layout.contextSwitches + 8, 4));
+		thread.name[0] = '\0';
+	}
+}
+
+static bool writeLittleEndian(FILE* file, uint64_t value, size_t size)
+{
+	uint8_t bytes[8];
+	for (size_t i = 0; i < size; i++)
+		bytes[i] = uint8_t(value >> (i * 8));
+	return fwrite(bytes, 1, size, file) == size;
+}
+
+static bool readLittleEndian(FILE* file, uint64_t& value, size_t size)
+{
+	uint8_t bytes[8];
+	if (fread(bytes, 1, size, file) != size)
+		return false;
+	value = readLittleEndian(bytes, size);
+	return true;
+}
+
+bool writeSnapshotCaptureHeader(FILE* file, unsigned pointerSize, unsigned numberOfProcessors)
+{
+	return fwrite(SnapshotCaptureMagic, 1, sizeof(SnapshotCaptureMagic), file) == sizeof(SnapshotCaptureMagic)
+		&& writeLittleEndian(file, SnapshotCaptureVersion, 4)
+		&& writeLittleEndian(file, pointerSize, 4)
+		&& writeLittleEndian(file, numberOfProcessors, 4);
+}
+
+bool writeSnapshotCapture(FILE* file, uint64_t time, uint64_t baseAddress, const void* buffer, uint32_t size)
+{
+	return writeLittleEndian(file, time, 8)
+		&& writeLittleEndian(file, baseAddress, 8)
+		&& writeLittleEndian(file, size, 4)
+		&& fwrite(buffer, 1, size, file) == size;
+}
+
+ReplayProcessSource::~ReplayProcessSource()
+{
+	if (m_file)
+		fclose(m_file);
+}
+
+bool ReplayProcessSource::open(const std::string& captureFile)
+{
+	m_captureFile = captureFile;
+	m_file = fopen(captureFile.c_str(), "rb");
+	if (!m_file)
+		return false;
+	char magic[sizeof(SnapshotCaptureMagic)];
+	uint64_t version = 0, pointerSize = 0, numberOfProcessors = 0;
+	if (fread(magic, 1, sizeof(magic), m_file) != sizeof(magic) || memcmp(magic, SnapshotCaptureMagic, sizeof(magic)) != 0)
+		return false;
+	if (!readLittleEndian(m_file, version, 4) || version != SnapshotCaptureVersion)
+		return false;
+	if (!readLittleEndian(m_file, pointerSize, 4) || !readLittleEndian(m_file, numberOfProcessors, 4))
+		return false;
+	m_pointerSize = unsigned(pointerSize);
+	m_numberOfProcessors = std::max(unsigned(numberOfProcessors), 1u);
+	// The output files are named after the start of the capture
+	auto start = ftell(m_file);
+	if (start < 0 || !readLittleEndian(m_file, m_time, 8) || fseek(m_file, start, SEEK_SET) != 0)
+		return false;
+	return true;
+}
+
+bool ReplayProcessSource::captureTime(uint64_t& time) const
+{
+	// FILETIME counts 100ns intervals since 1601-01-01
+	const uint64_t UnixEpoch = 116444736000000000ull;
+	time = m_time > UnixEpoch ? (m_time - UnixEpoch) / 10 : 0;
+	return true;
+}
+
+bool ReplayProcessSource::snapshot(std::vector<ProcessInfo>& processes)
+{
+	processes.clear();
+	uint64_t time = 0, baseAddress = 0, size = 0;
+	if (m_finished || !readLittleEndian(m_file, time, 8) || !readLittleEndian(m_file, baseAddress, 8) || !readLittleEndian(m_file, size, 4))
+	{
+		m_finished = true;
+		return false;
+	}
+	m_buffer.resize(size_t(size));
+	if (fread(m_buffer.data(), 1, m_buffer.size(), m_file) != m_buffer.size())
+	{
+		m_finished = true;
+		return false;
+	}
+	m_time = time;
+	m_snapshotCount++;
+	if (!parseProcessSnapshot(m_buffer.data(), m_buffer.size(), m_pointerSize, baseAddress, m_processes))
+		fprintf(stderr, "[Onlooker] Snapshot %u is truncated.\n", m_snapshotCount);
+	for (const SnapshotProcess& process : m_processes)
+	{
+		ProcessInfo info;
+		info.pid = process.pid;
+		info.ppid = process.ppid;
+		info.createTime = process.createTime;
+		info.entry = &process;
+		processes.push_back(info);
+	}
+	return true;
+}
+
+std::string ReplayProcessSource::processName(const ProcessInfo& process)
+{
+	return snapshotImageName(*(const SnapshotProcess*)process.entry);
+}
+
+bool ReplayProcessSource::queryProcess(const ProcessInfo& process, MemoryCounters& memory, CpuTimes& cpu, IoCounters& io)
+{
+	// The processes do not exist anymore, everything comes from the snapshot
+	return snapshotCounters(process, memory, cpu, io);
+}
+
+bool ReplayProcessSource::querySelf(MemoryCounters& memory, CpuTimes& cpu)
+{
+	(void)memory;
+	(void)cpu;
+	return false;
+}
+
+bool ReplayProcessSource::snapshotCounters(const ProcessInfo& process, MemoryCounters& memory, CpuTimes& cpu, IoCounters& io)
+{
+	auto snapshotProcess = (const SnapshotProcess*)process.entry;
+	memory = snapshotProcess->memory;
+	io = snapshotProcess->io;
+	snapshotCpuTimes(*snapshotProcess, m_time, cpu);
+	return true;
+}
+
+bool ReplayProcessSource::queryThreads(const ProcessInfo& process, uint64_t& now, std::vector<ThreadCounters>& threads)
+{
+	now = m_time;
+	snapshotThreads(*(const SnapshotProcess*)process.entry, m_pointerSize, threads);
+	return true;
+}
+
+void ReplayProcessSource::logSystemInformation(FILE* logFile)
+{
+	fprintf(logFile, "Replay of: %s\n", m_captureFile.c_str());
+	fprintf(logFile, "Pointer size: %u, number of processors: %u\n", m_pointerSize, m_numberOfProcessors);
+}
+
+int replaySnapshotCapture(const std::string& captureFile, const std::vector<uint32_t>& rootPids)
+{
+	ReplayProcessSource source;
+	if (!source.open(captureFile))
+	{
+		fprintf(stderr, "[Onlooker] Failed to open snapshot capture '%s'.\n", captureFile.c_str());
+		return EXIT_FAILURE;
+	}
+	fprintf(stderr, "[Onlooker] Replaying '%s' (%zu root(s))\n", captureFile.c_str(), rootPids.size());
+	// The monitoring ends after the last snapshot
+	std::atomic<bool> stop(false);
+	auto success = monitorProcessTrees(source, rootPids, std::vector<int32_t>(), stop);
+	fprintf(stderr, "[Onlooker] Replayed %u snapshots\n", source.snapshotCount());
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
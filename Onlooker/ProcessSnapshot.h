@@ -0,0 +1,97 @@
+#pragma once
+
+#include "ProcessSource.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+
+#include <string>
+#include <vector>
+#include <atomic>
+
+// Portable parser for the buffers returned by NtQuerySystemInformation(SystemProcessInformation),
+// used by the Windows backend and to replay captured buffers on any platform
+
+// Decoded SYSTEM_PROCESS_INFORMATION entry, times are in 100ns units
+struct SnapshotProcess
+{
+	uint32_t pid = 0;
+	uint32_t ppid = 0;
+	uint32_t numberOfThreads = 0;
+	uint64_t createTime = 0;
+	uint64_t userTime = 0;
+	uint64_t kernelTime = 0;
+	uint64_t cycleTime = 0;
+	MemoryCounters memory;
+	IoCounters io;
+	const uint8_t* imageName = nullptr; // UTF-16LE inside the buffer, not terminated
+	uint32_t imageNameLength = 0; // bytes
+	const uint8_t* threads = nullptr; // SYSTEM_THREAD_INFORMATION array, numberOfThreads entries
+	const uint8_t* entry = nullptr;
+};
+
+// The buffer was filled by a process with the given pointer size (4 or 8) while it was mapped at
+// baseAddress, the image name pointers are resolved relative to it
+bool parseProcessSnapshot(const uint8_t* buffer, size_t size, unsigned pointerSize, uint64_t baseAddress, std::vector<SnapshotProcess>& processes);
+
+std::string snapshotImageName(const SnapshotProcess& process);
+
+// CPU times of a process as of the snapshot taken at the given time (FILETIME)
+void snapshotCpuTimes(const SnapshotProcess& process, uint64_t time, CpuTimes& cpu);
+
+// Decode the threads of a process, the pointer size is the one the buffer was parsed with
+void snapshotThreads(const SnapshotProcess& process, unsigned pointerSize, std::vector<ThreadCounters>& threads);
+
+/*
+Snapshot capture file (.olsnap), all integers little endian:
+
+  header:    "OLSNAP\0\0", version (uint32), pointer size (uint32), number of processors (uint32)
+  snapshots: time (uint64, FILETIME), base address (uint64), size (uint32), raw buffer
+*/
+static const char SnapshotCaptureMagic[8] = { 'O', 'L', 'S', 'N', 'A', 'P', '\0', '\0' };
+static const uint32_t SnapshotCaptureVersion = 1;
+
+bool writeSnapshotCaptureHeader(FILE* file, unsigned pointerSize, unsigned numberOfProcessors);
+bool writeSnapshotCapture(FILE* file, uint64_t time, uint64_t baseAddress, const void* buffer, uint32_t size);
+
+// Replays a capture file as if the snapshots were taken live, counters come from the snapshots
+class ReplayProcessSource : public ProcessSource
+{
+public:
+	~ReplayProcessSource() override;
+
+	bool open(const std::string& captureFile);
+
+	// All snapshots were returned
+	bool finished() const override { return m_finished; }
+	uint32_t snapshotCount() const { return m_snapshotCount; }
+	bool captureTime(uint64_t& time) const override;
+
+	bool snapshot(std::vector<ProcessInfo>& processes) override;
+	std::string processName(const ProcessInfo& process) override;
+	bool queryProcess(const ProcessInfo& process, MemoryCounters& memory, CpuTimes& cpu, IoCounters& io) override;
+	bool querySelf(MemoryCounters& memory, CpuTimes& cpu) override;
+	uint64_t snapshotTime() const override { return m_time; }
+	bool hasSnapshotCounters() const override { return true; }
+	bool snapshotCounters(const ProcessInfo& process, MemoryCounters& memory, CpuTimes& cpu, IoCounters& io) override;
+	bool queryThreads(const ProcessInfo& process, uint64_t& now, std::vector<ThreadCounters>& threads) override;
+	uint32_t currentProcessId() const override { return 0; }
+	unsigned numberOfProcessors() const override { return m_numberOfProcessors; }
+	void logSystemInformation(FILE* logFile) override;
+
+private:
+	FILE* m_file = nullptr;
+	std::string m_captureFile;
+	unsigned m_pointerSize = 8;
+	unsigned m_numberOfProcessors = 1;
+	uint64_t m_time = 0;
+	std::vector<uint8_t> m_buffer;
+	std::vector<SnapshotProcess> m_processes;
+	uint32_t m_snapshotCount = 0;
+	bool m_finished = false;
+};
+
+// Run the monitor on a capture file, the trace files are written like for live processes. There
+// is one tick per snapshot, without waiting, stamped with the time it was captured at.
+int replaySnapshotCapture(const std::string& captureFile, const std::vector<uint32_t>& rootPids);
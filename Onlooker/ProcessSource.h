@@ -0,0 +1,180 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+
+#include <string>
+#include <vector>
+#include <memory>
+
+// Platform-neutral version of PROCESS_MEMORY_COUNTERS_EX
+struct MemoryCounters
+{
+	uint32_t pageFaultCount = 0;
+	size_t peakWorkingSetSize = 0;
+	size_t workingSetSize = 0;
+	size_t quotaPeakPagedPoolUsage = 0;
+	size_t quotaPagedPoolUsage = 0;
+	size_t quotaPeakNonPagedPoolUsage = 0;
+	size_t quotaNonPagedPoolUsage = 0;
+	size_t pagefileUsage = 0;
+	size_t peakPagefileUsage = 0;
+	size_t privateUsage = 0;
+};
+
+// All times are in 100ns units. For the processes of a snapshot they are the times of the
+// snapshot itself, so every process of a tick is measured at the same moment.
+struct CpuTimes
+{
+	uint64_t now = 0;
+	uint64_t kernelTime = 0;
+	uint64_t userTime = 0;
+	uint64_t startTime = 0; // when the process started, in the clock of now, 0 when unknown
+	uint64_t cycleTime = 0; // processor cycles since the process started, 0 when not counted
+};
+
+// Platform-neutral version of IO_COUNTERS, cumulative since the process started
+struct IoCounters
+{
+	uint64_t readOperationCount = 0;
+	uint64_t writeOperationCount = 0;
+	uint64_t otherOperationCount = 0;
+	uint64_t readTransferCount = 0; // bytes
+	uint64_t writeTransferCount = 0;
+	uint64_t otherTransferCount = 0;
+};
+
+// Scheduling state of a thread when its counters were taken
+enum class ThreadState : uint8_t
+{
+	Other,
+	Running,
+	Ready, // runnable, waiting for a processor
+	Waiting,
+};
+
+// Counters of a single thread, times are in 100ns units
+struct ThreadCounters
+{
+	uint32_t tid = 0;
+	uint64_t createTime = 0; // tells threads with a reused id apart
+	uint64_t kernelTime = 0;
+	uint64_t userTime = 0;
+	uint32_t contextSwitches = 0; // switches to the thread, wraps around
+	ThreadState state = ThreadState::Other;
+	uint8_t waitReason = 0; // KWAIT_REASON on Windows, 0 elsewhere
+	char name[16] = ""; // empty when the platform has no cheap way to get it
+};
+
+// Origin of the memory of a process, see queryMemoryComposition
+enum MemoryCategory
+{
+	MemoryImage, // executables and libraries
+	MemoryMapped, // other mapped files
+	MemoryShareable, // shared memory that is not backed by a file
+	MemoryHeap,
+	MemoryStack,
+	MemoryPrivate, // other private memory
+	MemoryCategoryCount,
+};
+
+// Bytes of memory of a process by category
+struct MemoryComposition
+{
+	uint64_t bytes[MemoryCategoryCount] = { };
+};
+
+// Entry of a system-wide process snapshot
+struct ProcessInfo
+{
+	uint32_t pid = -1;
+	uint32_t ppid = -1;
+	uint64_t createTime = 0; // only comparable to other entries of the same source
+	uint32_t imageHash = 0; // changes when the process replaces its image (exec)
+	const void* entry = nullptr; // backend specific, valid until the next snapshot
+};
+
+class ProcessSource
+{
+public:
+	virtual ~ProcessSource() = default;
+
+	// Enumerate all processes running on the system, reusing the storage of the previous snapshot
+	virtual bool snapshot(std::vector<ProcessInfo>& processes) = 0;
+
+	// Only called once for every new process, may allocate
+	virtual std::string processName(const ProcessInfo& process) = 0;
+
+	// When the last snapshot was taken, in the clock of CpuTimes::now
+	virtual uint64_t snapshotTime() const = 0;
+
+	// Query the counters of a process returned by the last snapshot, the I/O counters stay zero
+	// when they cannot be read. The CPU times still come from the snapshot.
+	virtual bool queryProcess(const ProcessInfo& process, MemoryCounters& memory, CpuTimes& cpu, IoCounters& io) = 0;
+
+	// Snapshot sampling: counters of a process taken from the last snapshot itself, so a
+	// tick costs a single query regardless of the number of processes
+	virtual bool hasSnapshotCounters() const { return false; }
+	virtual bool snapshotCounters(const ProcessInfo& process, MemoryCounters& memory, CpuTimes& cpu, IoCounters& io)
+	{
+		(void)process;
+		(void)memory;
+		(void)cpu;
+		(void)io;
+		return false;
+	}
+
+	// Counters of every thread of a process of the last snapshot, reusing the storage of the
+	// vector. now is the time they were taken, comparable to CpuTimes::now.
+	virtual bool queryThreads(const ProcessInfo& process, uint64_t& now, std::vector<ThreadCounters>& threads)
+	{
+		(void)process;
+		(void)now;
+		threads.clear();
+		return false;
+	}
+
+	// Composition of the committed (Windows) or resident and swapped (Linux) memory of a process.
+	// This walks the whole address space, so it is called from its own thread at a low
+	// frequency, concurrently with the other methods. Fails when the pid was reused.
+	virtual bool queryMemoryComposition(uint32_t pid, uint64_t createTime, MemoryComposition& composition)
+	{
+		(void)pid;
+		(void)createTime;
+		(void)composition;
+		return false;
+	}
+
+	// Replay of a recording: the wall clock time the last snapshot was captured at, before the
+	// first snapshot the one of the first (microseconds since epoch). The ticks follow the
+	// recording instead of the clock and the monitoring ends with it.
+	virtual bool captureTime(uint64_t& time) const
+	{
+		(void)time;
+		return false;
+	}
+	virtual bool finished() const { return false; }
+
+	// Query the counters of Onlooker itself
+	virtual bool querySelf(MemoryCounters& memory, CpuTimes& cpu) = 0;
+
+	virtual uint32_t currentProcessId() const = 0;
+	virtual unsigned numberOfProcessors() const = 0;
+
+	// Write the machine information to the header of the log
+	virtual void logSystemInformation(FILE* logFile) = 0;
+};
+
+// Implemented by the platform backend
+std::unique_ptr<ProcessSource> createProcessSource();
+
+// Connect to a viewer waiting for a live trace on a local socket (Linux) or named pipe
+// (Windows) with the given name, the connection is written like a file
+FILE* connectLiveStream(const std::string& name);
+
+// Flight recorder: accept dump requests from outside, SIGUSR1 on Linux and the named event
+// Onlooker_Dump_<pid of Onlooker> on Windows. Returns how to request one, empty on failure.
+std::string listenForDumpRequests();
+// True when a dump was requested since the previous call
+bool takeDumpRequest();
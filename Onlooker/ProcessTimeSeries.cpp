@@ -0,0 +1,1048 @@
+#include "ProcessTimeSeries.h"
+#include "Compression.h"
+
+#include <cmath>
+#include <cinttypes>
+
+ProcessTimeSeries::~ProcessTimeSeries()
+{
+	stopWriter();
+}
+
+bool ProcessTimeSeries::open(const std::string& basename)
+{
+	m_basename = basename;
+	// The flight recorder only writes the traces of its dumps
+	if (!m_flightRecorder)
+	{
+		if (!m_traceWriter->open(basename))
+		{
+			fprintf(stderr, "[Onlooker] Failed to open trace file.\n");
+			return false;
+		}
+		if (!m_csvSpool.create(basename + ".csv.tmp"))
+		{
+			fprintf(stderr, "[Onlooker] Failed to open csv spool file.\n");
+			return false;
+		}
+	}
+	m_writerThread = std::thread(&ProcessTimeSeries::writerThread, this);
+	return true;
+}
+
+void ProcessTimeSeries::processStarted(const UniqueProcess& uniqueProcess)
+{
+	TickRecord record;
+	record.type = TickRecord::ProcessStarted;
+	record.process = uniqueProcess;
+	m_tickRecords.push_back(record);
+}
+
+void ProcessTimeSeries::processExited(const UniqueProcess& uniqueProcess)
+{
+	TickRecord record;
+	record.type = TickRecord::ProcessExited;
+	record.process = uniqueProcess;
+	record.data = ProcessData();
+	auto state = m_processes.find(uniqueProcess.id);
+	if (state)
+	{
+		// Totals as of the last sample
+		record.data.time = state->summary.endTime;
+		record.data.cpuTime = state->lastCpu.cpuTime;
+		record.data.cycleTime = state->lastCpu.cycleTime;
+	}
+	m_tickRecords.push_back(record);
+
+	// Only the summary of a sampled process is kept for the end of the run, the flight
+	// recorder forgets it too so its memory does not grow with the uptime
+	if (state && state->summary.uniqueProcess.id == uniqueProcess.id && !m_flightRecorder)
+		m_exitedProcesses.push_back(state->summary);
+	if (state)
+		m_processes.erase(uniqueProcess.id);
+	for (auto trigger : m_triggers)
+		trigger->processExited(uniqueProcess.id);
+}
+
+void ProcessTimeSeries::setThreadSampling(bool threadSampling)
+{
+	if (threadSampling == m_threadSampling)
+		return;
+	m_threadSampling = threadSampling;
+	if (threadSampling)
+		return;
+	// The next burst starts over, instead of reporting the usage since this one ended
+	m_processes.forEach([](ProcessId, ProcessState& state)
+		{
+			std::vector<LastThread>().swap(state.threads);
+			state.lastThreadTime = 0;
+		});
+}
+
+void ProcessTimeSeries::logBurst(const std::string& message)
+{
+	TickRecord record;
+	record.type = TickRecord::Burst;
+	record.text = m_messages.intern(message);
+	m_tickRecords.push_back(record);
+}
+
+bool ProcessTimeSeries::setFlightRecorder(std::chrono::milliseconds window, size_t bytes)
+{
+	m_flightWindow = uint64_t(window.count());
+	try
+	{
+		m_flightRecorder = std::make_unique<RingBuffer<TickRecord>>(flightRecorderCapacity(bytes));
+	}
+	catch (const std::exception&)
+	{
+		// bad_alloc, or length_error beyond the maximum size of a vector
+		return false;
+	}
+	return true;
+}
+
+void ProcessTimeSeries::dump(const std::string& reason)
+{
+	if (!m_flightRecorder)
+		return;
+	TickRecord record;
+	record.type = TickRecord::Dump;
+	record.text = m_messages.intern(reason);
+	m_tickRecords.push_back(record);
+}
+
+void ProcessTimeSeries::startTick(const TickTime& time, uint32_t monitoredPid, const TickScheduler& scheduler, uint64_t snapshotTime)
+{
+	m_overhead = OverheadData();
+	m_overhead.time = time.time;
+	m_lastTickCpuTime = m_tickCpuTime;
+	m_tickCpuTime = m_source.snapshotTime();
+	m_overhead.tick = scheduler.tick();
+	m_overhead.interval = uint32_t(scheduler.interval().count());
+	m_overhead.snapshotTime = snapshotTime;
+	m_overhead.missedDeadlines = scheduler.totalMissedTicks();
+	m_overhead.queueTime = m_carriedQueueTime;
+	m_carriedQueueTime = 0;
+	m_workingSetChange = 0;
+	m_privateChange = 0;
+	m_tickWorkingSetSize = 0;
+	m_tickPrivateUsage = 0;
+	m_monitoredPid = monitoredPid;
+
+	TickRecord record;
+	record.type = TickRecord::TickStart;
+	record.index = monitoredPid;
+	record.tick.time = time.time;
+	record.tick.missedTicks = scheduler.missedTicks();
+	record.tick.droppedTicks = m_droppedTicks;
+	m_tickRecords.push_back(record);
+}
+
+bool ProcessTimeSeries::queryCounters(const ProcessInfo& process, MemoryCounters& memoryCounters, CpuTimes& cpuTimes, IoCounters& ioCounters)
+{
+	auto queryStart = monotonicMicroseconds();
+	auto success = m_snapshotSampling ? m_source.snapshotCounters(process, memoryCounters, cpuTimes, ioCounters) : m_source.queryProcess(process, memoryCounters, cpuTimes, ioCounters);
+	m_overhead.queryCount++;
+	m_overhead.queryTime += monotonicMicroseconds() - queryStart;
+	return success;
+}
+
+bool ProcessTimeSeries::logTickData(const TickTime& time, const UniqueProcess& uniqueProcess, const ProcessInfo& process, ProcessData& sample)
+{
+	MemoryCounters memoryCounters;
+	CpuTimes cpuTimes;
+	IoCounters ioCounters;
+	if (!queryCounters(process, memoryCounters, cpuTimes, ioCounters))
+		return false;
+	ProcessState& state = m_processes[uniqueProcess.id];
+	if (state.summary.uniqueProcess.id != uniqueProcess.id)
+		state.lastCpu = LastCpuUsage(); // first sample of the process
+	auto ioUsage = getCurrentIoUsage(state.lastIo, ioCounters, cpuTimes.now);
+	addSample(time, uniqueProcess, memoryCounters, getCurrentCPUUsage(state.lastCpu, cpuTimes), cpuTimes, ioUsage);
+	sample = m_tickRecords.back().data;
+	if (m_threadSampling)
+		logThreads(time, uniqueProcess, process);
+	return true;
+}
+
+void ProcessTimeSeries::logThreads(const TickTime& time, const UniqueProcess& uniqueProcess, const ProcessInfo& process)
+{
+	uint64_t now = 0;
+	auto queryStart = monotonicMicroseconds();
+	auto success = m_source.queryThreads(process, now, m_threadCounters);
+	m_overhead.queryCount++;
+	m_overhead.queryTime += monotonicMicroseconds() - queryStart;
+	if (!success)
+		return;
+
+	auto queueStart = monotonicMicroseconds();
+	ProcessState& state = *m_processes.find(uniqueProcess.id);
+	std::sort(m_threadCounters.begin(), m_threadCounters.end(), [](const ThreadCounters& a, const ThreadCounters& b)
+		{
+			return a.tid < b.tid;
+		});
+
+	// Merge with the threads of the previous sample, both are sorted by tid. Nothing is
+	// reported for the first sample of a process, there is no interval to relate it to.
+	auto elapsed = state.lastThreadTime && now > state.lastThreadTime ? now - state.lastThreadTime : 0;
+	auto delta = [](uint64_t current, uint64_t last) { return current > last ? current - last : 0; };
+	m_nextThreads.clear();
+	size_t previous = 0;
+	for (const ThreadCounters& counters : m_threadCounters)
+	{
+		while (previous < state.threads.size() && state.threads[previous].tid < counters.tid)
+			previous++;
+		LastThread last;
+		if (previous < state.threads.size() && state.threads[previous].tid == counters.tid && state.threads[previous].createTime == counters.createTime)
+		{
+			last = state.threads[previous];
+		}
+		else
+		{
+			// Started since the previous sample, all of its time was spent in the interval
+			last.tid = counters.tid;
+			last.createTime = counters.createTime;
+			last.index = m_threadCount++;
+			last.name = m_threadNames.intern(counters.name);
+		}
+
+		auto userTime = delta(counters.userTime, last.userTime);
+		auto kernelTime = delta(counters.kernelTime, last.kernelTime);
+		auto contextSwitches = counters.contextSwitches - last.contextSwitches;
+		// Idle threads are not recorded, so thousands of threads only cost what actually runs
+		if (elapsed && (userTime || kernelTime || contextSwitches))
+		{
+			ThreadData thread;
+			thread.time = time.time;
+			thread.index = last.index;
+			thread.tid = last.tid;
+			thread.createTime = last.createTime;
+			thread.name = last.name;
+			thread.userUsage = userTime * 100.0 / elapsed;
+			thread.kernelUsage = kernelTime * 100.0 / elapsed;
+			thread.contextSwitches = contextSwitches;
+			thread.state = counters.state;
+			thread.waitReason = counters.waitReason;
+			TickRecord record;
+			record.type = TickRecord::ThreadSample;
+			record.index = state.summary.index;
+			record.process = uniqueProcess;
+			record.thread = thread;
+			m_tickRecords.push_back(record);
+		}
+
+		last.userTime = counters.userTime;
+		last.kernelTime = counters.kernelTime;
+		last.contextSwitches = counters.contextSwitches;
+		m_nextThreads.push_back(last);
+	}
+	state.threads.swap(m_nextThreads);
+	state.lastThreadTime = now;
+	m_overhead.queueTime += monotonicMicroseconds() - queueStart;
+}
+
+void ProcessTimeSeries::addSample(const TickTime& time, const UniqueProcess& uniqueProcess, const MemoryCounters& memoryCounters, double cpuUsage, const CpuTimes& cpuTimes, const IoUsage& ioUsage)
+{
+	auto queueStart = monotonicMicroseconds();
+	ProcessState& state = m_processes[uniqueProcess.id];
+	SortedProcess& s = state.summary;
+	if (s.uniqueProcess.id != uniqueProcess.id)
+	{
+		// First sample of the process
+		s.uniqueProcess = uniqueProcess;
+		s.index = m_processCount++;
+		state.lastWorkingSetSize = memoryCounters.workingSetSize;
+		state.lastPrivateUsage = memoryCounters.privateUsage;
+		s.peakTime = time.time;
+		if (!m_treeSummary.startTime)
+			m_treeSummary.startTime = time.time;
+	}
+
+	auto absDiff = [](size_t a, size_t b) { return uint64_t(a > b ? a - b : b - a); };
+	m_workingSetChange += absDiff(memoryCounters.workingSetSize, state.lastWorkingSetSize);
+	m_privateChange += absDiff(memoryCounters.privateUsage, state.lastPrivateUsage);
+	state.lastWorkingSetSize = memoryCounters.workingSetSize;
+	state.lastPrivateUsage = memoryCounters.privateUsage;
+
+	// Every sample is weighed with the time since the previous sample of its process
+	auto integral = s.endTime && time.time > s.endTime ? double(memoryCounters.workingSetSize) * (time.time - s.endTime) : 0.0;
+	s.workingSetIntegral += integral;
+	m_treeSummary.workingSetIntegral += integral;
+	auto cpuTime = cpuTimes.kernelTime + cpuTimes.userTime;
+	m_treeSummary.cpuTime += cpuTime - std::min(s.cpuTime, cpuTime);
+	s.cpuTime = cpuTime;
+	s.peakPrivateUsage = std::max<uint64_t>(memoryCounters.privateUsage, s.peakPrivateUsage);
+	if (memoryCounters.workingSetSize > s.peakWorkingSetSize)
+	{
+		s.peakWorkingSetSize = memoryCounters.workingSetSize;
+		s.peakTime = time.time;
+		if (s.peakWorkingSetSize > m_largestProcess.peakWorkingSetSize)
+			m_largestProcess = s;
+	}
+	m_tickWorkingSetSize += memoryCounters.workingSetSize;
+	m_tickPrivateUsage += memoryCounters.privateUsage;
+
+	s.startTime = std::min(time.time, s.startTime);
+	s.endTime = std::max(time.time, s.endTime);
+	m_treeSummary.endTime = std::max(time.time, m_treeSummary.endTime);
+	for (auto trigger : m_triggers)
+		trigger->addSample(uniqueProcess.id, time.time, memoryCounters);
+
+	// Formatting and writing is left to the writer thread
+	TickRecord record;
+	record.type = TickRecord::Sample;
+	record.index = s.index;
+	record.process = uniqueProcess;
+	record.data = ProcessData(time.time, memoryCounters, cpuUsage, ioUsage);
+	record.data.cpuTime = cpuTime;
+	record.data.cycleTime = cpuTimes.cycleTime;
+	m_tickRecords.push_back(record);
+	m_overhead.queueTime += monotonicMicroseconds() - queueStart;
+}
+
+void ProcessTimeSeries::addComposition(const TickTime& time, const UniqueProcess& uniqueProcess, const MemoryComposition& composition, uint64_t walkTime)
+{
+	auto state = m_processes.find(uniqueProcess.id);
+	if (!state)
+		return;
+	TickRecord record;
+	record.type = TickRecord::Composition;
+	record.index = state->summary.index;
+	record.process = uniqueProcess;
+	record.composition = CompositionData();
+	record.composition.time = time.time;
+	record.composition.walkTime = walkTime;
+	record.composition.composition = composition;
+	m_tickRecords.push_back(record);
+}
+
+void ProcessTimeSeries::addRollup(const UniqueProcess& uniqueProcess, const RollupData& rollup)
+{
+	auto state = m_processes.find(uniqueProcess.id);
+	if (!state)
+		return;
+	TickRecord record;
+	record.type = TickRecord::Rollup;
+	record.index = state->summary.index;
+	record.process = uniqueProcess;
+	record.rollup = rollup;
+	m_tickRecords.push_back(record);
+}
+
+void ProcessTimeSeries::endTick()
+{
+	MemoryCounters memoryCounters;
+	CpuTimes cpuTimes;
+	if (m_source.querySelf(memoryCounters, cpuTimes))
+	{
+		m_overhead.cpuUsage = getCurrentCPUUsage(m_selfCpu, cpuTimes);
+		m_overhead.workingSetSize = memoryCounters.workingSetSize;
+		m_selfCpuTime = cpuTimes.kernelTime + cpuTimes.userTime;
+		m_selfPeakWorkingSetSize = std::max(memoryCounters.peakWorkingSetSize, m_selfPeakWorkingSetSize);
+	}
+	m_ticks++;
+	if (m_tickWorkingSetSize > m_treeSummary.peakWorkingSetSize)
+	{
+		m_treeSummary.peakWorkingSetSize = m_tickWorkingSetSize;
+		m_treeSummary.peakTime = m_overhead.time;
+	}
+	m_treeSummary.peakPrivateUsage = std::max(m_tickPrivateUsage, m_treeSummary.peakPrivateUsage);
+
+	auto queueStart = monotonicMicroseconds();
+	m_overhead.queuedRecords = uint32_t(m_queue.size());
+	m_overhead.droppedTicks = m_totalDroppedTicks;
+	TickRecord record;
+	record.type = TickRecord::TickEnd;
+	record.overhead = m_overhead;
+	m_tickRecords.push_back(record);
+
+	// A tick is queued as a whole so the writer never sees a partial one
+	uint64_t captureTime = 0;
+	if (m_queue.tryPush(m_tickRecords.data(), m_tickRecords.size()))
+	{
+		m_droppedTicks = 0;
+	}
+	else if (m_tickRecords.size() > m_queue.capacity() || m_source.captureTime(captureTime))
+	{
+		// It would never fit or it is replayed, which does not drop ticks: the writer gets it in
+		// parts and the sampling waits for it
+		if (m_tickRecords.size() > m_queue.capacity() && !m_warnedOversizedTick)
+		{
+			fprintf(stderr, "[Onlooker] A tick of %zu records does not fit into the writer queue of %zu records (ONLOOKER_WRITER_QUEUE), such ticks delay the sampling.\n", m_tickRecords.size(), m_queue.capacity());
+			m_warnedOversizedTick = true;
+		}
+		for (size_t queued = 0; queued < m_tickRecords.size();)
+		{
+			auto count = std::min(m_tickRecords.size() - queued, m_queue.capacity() / 2);
+			while (!m_queue.tryPush(m_tickRecords.data() + queued, count))
+			{
+				m_writerWakeup.notify_one();
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+			queued += count;
+		}
+		m_droppedTicks = 0;
+	}
+	else
+	{
+		// Drop the samples, but keep the processes that started or exited if they fit
+		size_t events = 0;
+		while (events < m_tickRecords.size() && m_tickRecords[events].type != TickRecord::TickStart)
+			events++;
+		m_queue.tryPush(m_tickRecords.data(), events);
+		m_droppedTicks++;
+		m_totalDroppedTicks++;
+	}
+	m_tickRecords.clear();
+	m_writerWakeup.notify_one();
+	m_carriedQueueTime = monotonicMicroseconds() - queueStart;
+}
+
+void ProcessTimeSeries::stopWriter()
+{
+	if (!m_writerThread.joinable())
+		return;
+	{
+		std::lock_guard<std::mutex> lock(m_writerMutex);
+		m_stopWriter = true;
+	}
+	m_writerWakeup.notify_one();
+	m_writerThread.join();
+}
+
+void ProcessTimeSeries::writerThread()
+{
+	for (;;)
+	{
+		// Everything queued before the stop request is still written
+		auto stop = m_stopWriter.load();
+
+		// Write all queued records and flush the log once for the batch
+		auto written = false;
+		while (auto record = m_queue.front())
+		{
+			if (m_flightRecorder)
+				recordFlight(*record);
+			else
+				writeRecord(*record);
+			m_queue.pop();
+			written = true;
+		}
+		if (written)
+			fflush(m_logFile);
+		if (stop)
+			break;
+
+		// The sampling thread notifies without taking the lock, the timeout covers a missed wakeup
+		std::unique_lock<std::mutex> lock(m_writerMutex);
+		m_writerWakeup.wait_for(lock, std::chrono::milliseconds(10), [this] { return m_stopWriter || !m_queue.empty(); });
+	}
+}
+
+void ProcessTimeSeries::writeRecord(const TickRecord& record)
+{
+	switch (record.type)
+	{
+	case TickRecord::TickStart:
+	{
+		m_tickWriteStart = monotonicMicroseconds();
+		auto time = toTickTime(record.tick.time);
+		if (record.tick.droppedTicks)
+		{
+			fprintf(m_logFile, "[%02d:%02d:%02d.%03d] Dropped %u tick(s), writing the output fell behind\n",
+				time.hour,
+				time.minute,
+				time.second,
+				time.milliseconds,
+				record.tick.droppedTicks
+			);
+		}
+		if (record.tick.missedTicks)
+		{
+			fprintf(m_logFile, "[%02d:%02d:%02d.%03d] Missed %u tick(s), sampling took longer than the poll interval\n",
+				time.hour,
+				time.minute,
+				time.second,
+				time.milliseconds,
+				record.tick.missedTicks
+			);
+		}
+		fprintf(m_logFile, "[%02d:%02d:%02d.%03d] Tracked processes (monitored: %u):\n",
+			time.hour,
+			time.minute,
+			time.second,
+			time.milliseconds,
+			record.index
+		);
+		break;
+	}
+
+	case TickRecord::ProcessStarted:
+		fprintf(m_logFile, "Started: \"%s\" (PID: %u, Parent: %u)\n", record.process.name->c_str(), record.process.pid, record.process.ppid);
+		break;
+
+	case TickRecord::ProcessExited:
+		fprintf(m_logFile, "Exited: \"%s\" (PID: %u, Parent: %u)", record.process.name->c_str(), record.process.pid, record.process.ppid);
+		if (record.data.time)
+			fprintf(m_logFile, ", CPU time: %.3f s", record.data.cpuTime / 1e7);
+		if (record.data.cycleTime)
+			fprintf(m_logFile, ", cycles: %" PRIu64, record.data.cycleTime);
+		fprintf(m_logFile, "\n");
+		break;
+
+	case TickRecord::Sample:
+	{
+		const UniqueProcess& uniqueProcess = record.process;
+		const MemoryCounters& memoryCounters = record.data.memory;
+		fprintf(m_logFile, "  %s (PID: %u, Parent: %u)\n",
+			uniqueProcess.name->c_str(),
+			uniqueProcess.pid,
+			uniqueProcess.ppid
+		);
+		const IoUsage& io = record.data.io;
+		fprintf(m_logFile, "    Memory usage: %s, Memory peak: %s, Pagefile usage: %s, Pagefile peak: %s ~ CPU: %.0f%% ~ I/O read: %s/s (%" PRIu64 " ops/s), write: %s/s (%" PRIu64 " ops/s)\n",
+			humanReadableSize(memoryCounters.workingSetSize).c_str(),
+			humanReadableSize(memoryCounters.peakWorkingSetSize).c_str(),
+			humanReadableSize(memoryCounters.pagefileUsage).c_str(),
+			humanReadableSize(memoryCounters.peakPagefileUsage).c_str(),
+			record.data.cpuUsage,
+			humanReadableSize(io.readBytes).c_str(),
+			io.readOperations,
+			humanReadableSize(io.writeBytes).c_str(),
+			io.writeOperations
+		);
+
+		m_traceWriter->addSample(record.index, uniqueProcess, record.data);
+
+		CsvRecord csvRecord;
+		csvRecord.time = record.data.time;
+		csvRecord.index = record.index;
+		m_csvValues.resize(m_csvColumns.metrics.size());
+		for (size_t i = 0; i < m_csvValues.size(); i++)
+			m_csvValues[i] = m_csvColumns.value(m_csvColumns.metrics[i], record.data);
+		if (record.index >= m_csvPeaks.size())
+			m_csvPeaks.resize(record.index + 1);
+		auto filterValue = m_csvColumns.value(m_csvColumns.filterMetric, record.data);
+		m_csvPeaks[record.index] = std::max(filterValue, m_csvPeaks[record.index]);
+		m_csvSpool.write(&csvRecord, sizeof(csvRecord));
+		m_csvSpool.write(m_csvValues.data(), m_csvValues.size() * sizeof(double));
+		break;
+	}
+
+	case TickRecord::ThreadSample:
+	{
+		const ThreadData& thread = record.thread;
+		fprintf(m_logFile, "    Thread %u%s%s%s: CPU %.0f%% (kernel %.0f%%), context switches: %u\n",
+			thread.tid,
+			thread.name->empty() ? "" : " \"",
+			thread.name->c_str(),
+			thread.name->empty() ? "" : "\"",
+			thread.userUsage + thread.kernelUsage,
+			thread.kernelUsage,
+			thread.contextSwitches
+		);
+		m_traceWriter->addThreadSample(record.index, record.process, thread);
+		break;
+	}
+
+	case TickRecord::Composition:
+	{
+		const CompositionData& data = record.composition;
+		const auto& bytes = data.composition.bytes;
+		fprintf(m_logFile, "    Memory composition: image %s, mapped %s, shareable %s, heap %s, stack %s, private %s\n",
+			humanReadableSize(bytes[MemoryImage]).c_str(),
+			humanReadableSize(bytes[MemoryMapped]).c_str(),
+			humanReadableSize(bytes[MemoryShareable]).c_str(),
+			humanReadableSize(bytes[MemoryHeap]).c_str(),
+			humanReadableSize(bytes[MemoryStack]).c_str(),
+			humanReadableSize(bytes[MemoryPrivate]).c_str()
+		);
+		m_overheadSummary.compositionCount++;
+		m_overheadSummary.compositionTime += data.walkTime;
+		m_overheadSummary.maxCompositionTime = std::max(data.walkTime, m_overheadSummary.maxCompositionTime);
+		m_traceWriter->addComposition(record.index, record.process, data);
+		break;
+	}
+
+	case TickRecord::Rollup:
+	{
+		const RollupData& rollup = record.rollup;
+		fprintf(m_logFile, "  Subtree of %s (PID: %u): %u processes, Memory usage: %s, Private usage: %s ~ CPU: %.0f%%\n",
+			record.process.name->c_str(),
+			record.process.pid,
+			rollup.processCount,
+			humanReadableSize(size_t(rollup.workingSetSize)).c_str(),
+			humanReadableSize(size_t(rollup.privateUsage)).c_str(),
+			rollup.cpuUsage
+		);
+		m_traceWriter->addRollup(record.index, record.process, rollup);
+		break;
+	}
+
+	case TickRecord::Burst:
+		fprintf(m_logFile, "Burst %s\n", record.text->c_str());
+		break;
+
+	case TickRecord::Dump:
+		dumpFlight(*record.text);
+		break;
+
+	case TickRecord::TickEnd:
+	{
+		OverheadData overhead = record.overhead;
+		auto writeStart = monotonicMicroseconds();
+		summarizeOverhead(overhead, writeStart);
+		m_traceWriter->addOverhead(overhead);
+		m_traceWriter->endTick();
+		m_carriedWriteTime = monotonicMicroseconds() - writeStart;
+		break;
+	}
+	}
+}
+
+void ProcessTimeSeries::summarizeOverhead(OverheadData& overhead, uint64_t writeStart)
+{
+	overhead.writeTime = m_carriedWriteTime + (writeStart - m_tickWriteStart);
+
+	auto& summary = m_overheadSummary;
+	summary.ticks++;
+	summary.snapshotTime += overhead.snapshotTime;
+	summary.maxSnapshotTime = std::max(overhead.snapshotTime, summary.maxSnapshotTime);
+	summary.queryCount += overhead.queryCount;
+	summary.queryTime += overhead.queryTime;
+	summary.maxQueryTime = std::max(overhead.queryTime, summary.maxQueryTime);
+	summary.writeTime += overhead.writeTime;
+	summary.maxWriteTime = std::max(overhead.writeTime, summary.maxWriteTime);
+	summary.queueTime += overhead.queueTime;
+	summary.maxQueueTime = std::max(overhead.queueTime, summary.maxQueueTime);
+	summary.maxQueuedRecords = std::max(overhead.queuedRecords, summary.maxQueuedRecords);
+	summary.missedDeadlines = overhead.missedDeadlines;
+}
+
+// Writer thread of the flight recorder: only the records a trace is made of are kept,
+// the log just gets the bursts and dumps
+void ProcessTimeSeries::recordFlight(const TickRecord& record)
+{
+	switch (record.type)
+	{
+	case TickRecord::TickStart:
+	{
+		m_tickWriteStart = monotonicMicroseconds();
+		// Ticks older than the window go first, a partially evicted one right away
+		while (!m_flightRecorder->empty())
+		{
+			const TickRecord& oldest = m_flightRecorder->front();
+			if (oldest.type == TickRecord::TickStart && oldest.tick.time + m_flightWindow >= record.tick.time)
+				break;
+			evictFlightTick();
+		}
+		storeFlightRecord(record);
+		break;
+	}
+
+	case TickRecord::ProcessStarted:
+	case TickRecord::ProcessExited:
+		break;
+
+	case TickRecord::Sample:
+	case TickRecord::ThreadSample:
+	case TickRecord::Rollup:
+		storeFlightRecord(record);
+		break;
+
+	case TickRecord::Composition:
+	{
+		auto walkTime = record.composition.walkTime;
+		m_overheadSummary.compositionCount++;
+		m_overheadSummary.compositionTime += walkTime;
+		m_overheadSummary.maxCompositionTime = std::max(walkTime, m_overheadSummary.maxCompositionTime);
+		storeFlightRecord(record);
+		break;
+	}
+
+	case TickRecord::Burst:
+	case TickRecord::Dump:
+		writeRecord(record);
+		break;
+
+	case TickRecord::TickEnd:
+	{
+		TickRecord tickEnd = record;
+		auto writeStart = monotonicMicroseconds();
+		summarizeOverhead(tickEnd.overhead, writeStart);
+		storeFlightRecord(tickEnd);
+		m_carriedWriteTime = monotonicMicroseconds() - writeStart;
+		break;
+	}
+	}
+}
+
+void ProcessTimeSeries::storeFlightRecord(const TickRecord& record)
+{
+	while (m_flightRecorder->full())
+		evictFlightTick();
+	m_flightRecorder->push(record);
+}
+
+// Whole ticks are evicted, so a dump never starts in the middle of one
+void ProcessTimeSeries::evictFlightTick()
+{
+	do
+	{
+		m_flightRecorder->pop();
+	} while (!m_flightRecorder->empty() && m_flightRecorder->front().type != TickRecord::TickStart);
+}
+
+bool ProcessTimeSeries::dumpFlight(const std::string& reason)
+{
+	char suffix[32] = "";
+	snprintf(suffix, sizeof(suffix), "_dump%u", ++m_dumpCount);
+	auto basename = m_basename + suffix;
+	auto traceWriter = createTraceWriter(m_traceFormat);
+	if (!traceWriter->open(basename))
+	{
+		fprintf(m_logFile, "Flight recorder: failed to open the trace of dump %u (%s)\n", m_dumpCount, reason.c_str());
+		return false;
+	}
+
+	// A tick that did not fit into the ring as a whole has no start left
+	const RingBuffer<TickRecord>& ring = *m_flightRecorder;
+	uint32_t ticks = 0;
+	uint64_t firstTime = 0, lastTime = 0;
+	auto inTick = false;
+	for (size_t i = 0; i < ring.size(); i++)
+	{
+		const TickRecord& record = ring[i];
+		if (record.type == TickRecord::TickStart)
+		{
+			inTick = true;
+			if (!firstTime)
+				firstTime = record.tick.time;
+			lastTime = record.tick.time;
+		}
+		if (!inTick)
+			continue;
+		switch (record.type)
+		{
+		case TickRecord::Sample:
+			traceWriter->addSample(record.index, record.process, record.data);
+			break;
+		case TickRecord::ThreadSample:
+			traceWriter->addThreadSample(record.index, record.process, record.thread);
+			break;
+		case TickRecord::Composition:
+			traceWriter->addComposition(record.index, record.process, record.composition);
+			break;
+		case TickRecord::Rollup:
+			traceWriter->addRollup(record.index, record.process, record.rollup);
+			break;
+		case TickRecord::TickEnd:
+			traceWriter->addOverhead(record.overhead);
+			traceWriter->endTick();
+			ticks++;
+			break;
+		default:
+			break;
+		}
+	}
+	auto success = traceWriter->close();
+
+	auto first = toTickTime(firstTime);
+	auto last = toTickTime(lastTime);
+	fprintf(m_logFile, "Flight recorder: %s %u ticks (%02d:%02d:%02d.%03d to %02d:%02d:%02d.%03d) to %s%s (%s)\n",
+		success ? "dumped" : "failed to dump",
+		ticks,
+		first.hour,
+		first.minute,
+		first.second,
+		first.milliseconds,
+		last.hour,
+		last.minute,
+		last.second,
+		last.milliseconds,
+		basename.c_str(),
+		traceExtension(m_traceFormat),
+		reason.c_str()
+	);
+	fflush(m_logFile);
+	return success;
+}
+
+bool ProcessTimeSeries::close()
+{
+	stopWriter();
+
+	// The writer is done, the totals of the sampling thread can be merged
+	auto flightSuccess = !m_flightRecorder || dumpFlight("the run ended");
+	m_overheadSummary.cpuTime = m_selfCpuTime;
+	m_overheadSummary.peakWorkingSetSize = m_selfPeakWorkingSetSize;
+	m_overheadSummary.droppedTicks = m_totalDroppedTicks;
+	logOverheadSummary();
+	m_treeSummary.processCount = m_processCount;
+	m_treeSummary.hasExitCode = m_hasExitCode;
+	m_treeSummary.exitCode = m_exitCode;
+	printSummary(stderr);
+	if (m_flightRecorder)
+		return flightSuccess;
+
+	writeSummaries();
+	auto success = m_traceWriter->close();
+	if (!success)
+		fprintf(stderr, "[Onlooker] Failed to write trace file.\n");
+
+	if (!m_csvSpool.close() || !dumpCsv(m_basename + ".csv"))
+	{
+		fprintf(stderr, "[Onlooker] Failed to write csv file.\n");
+		success = false;
+	}
+	remove((m_basename + ".csv.tmp").c_str());
+	return success;
+}
+
+void ProcessTimeSeries::logOverheadSummary()
+{
+	const auto& summary = m_overheadSummary;
+	if (summary.ticks == 0)
+		return;
+	auto average = [&](uint64_t total)
+	{
+		return total / 1000.0 / summary.ticks;
+	};
+	fprintf(m_logFile, "\nOverhead summary:\n");
+	fprintf(m_logFile, "  Ticks: %" PRIu64 ", missed deadlines: %u, dropped: %u\n", summary.ticks, summary.missedDeadlines, summary.droppedTicks);
+	fprintf(m_logFile, "  Snapshot: avg %.3f ms, max %.3f ms\n", average(summary.snapshotTime), summary.maxSnapshotTime / 1000.0);
+	fprintf(m_logFile, "  Process queries: avg %.1f per tick, avg %.3f ms, max %.3f ms\n", double(summary.queryCount) / summary.ticks, average(summary.queryTime), summary.maxQueryTime / 1000.0);
+	fprintf(m_logFile, "  Queueing: avg %.3f ms, max %.3f ms, writer backlog peak: %u of %zu records\n", average(summary.queueTime), summary.maxQueueTime / 1000.0, summary.maxQueuedRecords, m_queue.capacity());
+	fprintf(m_logFile, "  Writing (writer thread): avg %.3f ms, max %.3f ms\n", average(summary.writeTime), summary.maxWriteTime / 1000.0);
+	if (summary.compositionCount)
+		fprintf(m_logFile, "  Memory composition walks (own thread): %" PRIu64 ", avg %.3f ms, max %.3f ms\n", summary.compositionCount, summary.compositionTime / 1000.0 / summary.compositionCount, summary.maxCompositionTime / 1000.0);
+	fprintf(m_logFile, "  Onlooker CPU time: %.3f s, Memory peak: %s\n", summary.cpuTime / 1e7, humanReadableSize(summary.peakWorkingSetSize).c_str());
+	fflush(m_logFile);
+}
+
+// The summaries follow the last tick, the processes in the order of the CSV columns
+void ProcessTimeSeries::writeSummaries()
+{
+	// An image that replaced another one keeps the pid, the last one is the one that exited
+	auto sortedProcesses = getSortedProcesses();
+	auto exited = sortedProcesses.end();
+	for (auto it = sortedProcesses.begin(); it != sortedProcesses.end(); ++it)
+	{
+		if (it->uniqueProcess.pid == m_monitoredPid)
+			exited = it;
+	}
+	for (auto it = sortedProcesses.begin(); it != sortedProcesses.end(); ++it)
+	{
+		SummaryData data;
+		data.startTime = it->startTime;
+		data.endTime = it->endTime;
+		data.peakWorkingSetSize = it->peakWorkingSetSize;
+		data.peakPrivateUsage = it->peakPrivateUsage;
+		data.peakTime = it->peakTime;
+		data.workingSetIntegral = it->workingSetIntegral;
+		data.cpuTime = it->cpuTime;
+		data.processCount = 1;
+		data.hasExitCode = it == exited && m_hasExitCode;
+		data.exitCode = m_exitCode;
+		m_traceWriter->addSummary(it->index, it->uniqueProcess, data);
+	}
+	m_traceWriter->addTreeSummary(m_treeSummary);
+}
+
+// Like time -v, for whoever watches the run
+void ProcessTimeSeries::printSummary(FILE* file) const
+{
+	static const double GB = 1024.0 * 1024.0 * 1024.0;
+	const auto& tree = m_treeSummary;
+	if (!tree.processCount)
+		return;
+	auto elapsed = [&](uint64_t time)
+	{
+		return (time - tree.startTime) / 1000.0;
+	};
+	fprintf(file, "[Onlooker] Summary of the processes of PID %u:\n", m_monitoredPid);
+	fprintf(file, "\tProcesses: %u\n", tree.processCount);
+	fprintf(file, "\tElapsed (sampled) time (s): %.3f\n", elapsed(tree.endTime));
+	fprintf(file, "\tCPU time (s): %.3f\n", tree.cpuTime / 1e7);
+	fprintf(file, "\tPeak working set: %s at %.3f s\n", humanReadableSize(size_t(tree.peakWorkingSetSize)).c_str(), elapsed(tree.peakTime));
+	fprintf(file, "\tPeak private usage: %s\n", humanReadableSize(size_t(tree.peakPrivateUsage)).c_str());
+	fprintf(file, "\tWorking set integral (GB*s): %.3f\n", tree.workingSetIntegral / 1000.0 / GB);
+	const auto& largest = m_largestProcess;
+	if (largest.uniqueProcess.name)
+	{
+		fprintf(file, "\tLargest process: %s (PID: %u), peak working set %s at %.3f s\n",
+			largest.uniqueProcess.name->c_str(),
+			largest.uniqueProcess.pid,
+			humanReadableSize(size_t(largest.peakWorkingSetSize)).c_str(),
+			elapsed(largest.peakTime)
+		);
+	}
+	if (tree.hasExitCode)
+		fprintf(file, "\tExit status: %d\n", tree.exitCode);
+}
+
+// A CSV cell, quoted when the text would end it early
+static std::string csvCell(const std::string& text)
+{
+	if (text.find_first_of(";\"\r\n") == std::string::npos)
+		return text;
+	std::string cell = "\"";
+	for (char c : text)
+	{
+		if (c == '"')
+			cell += '"';
+		cell += c;
+	}
+	return cell + "\"";
+}
+
+// Every sample was spooled in time order while sampling, so the CSV is written in a single
+// pass that only holds the current row: one value per column, the metrics of a process next
+// to each other
+bool ProcessTimeSeries::dumpCsv(const std::string& file)
+{
+	SpoolFile spool;
+	if (!spool.openForReading(m_basename + ".csv.tmp"))
+		return false;
+	FILE* csvFile = openOutput(file);
+	if (!csvFile)
+		return false;
+	const auto& metrics = m_csvColumns.metrics;
+	fprintf(csvFile, "Time");
+	auto sortedProcesses = getSortedProcesses();
+	sortedProcesses = filter(sortedProcesses, [&](const SortedProcess& p)
+		{
+			return p.index < m_csvPeaks.size() && m_csvPeaks[p.index] > m_csvColumns.threshold;
+		});
+	// process index -> first csv column of the process
+	std::vector<size_t> columns(m_processCount, -1);
+	for (size_t i = 0; i < sortedProcesses.size(); i++)
+	{
+		const UniqueProcess& uniqueProcess = sortedProcesses[i].uniqueProcess;
+		columns[sortedProcesses[i].index] = i * metrics.size();
+		for (auto metric : metrics)
+		{
+			char pid[64] = "";
+			snprintf(pid, sizeof(pid), " (pid: %u, ppid: %u)", uniqueProcess.pid, uniqueProcess.ppid);
+			auto header = *uniqueProcess.name + pid;
+			if (metrics.size() > 1)
+				header += std::string(" ") + CsvColumns::name(metric);
+			fprintf(csvFile, ";%s", csvCell(header).c_str());
+		}
+	}
+	fprintf(csvFile, "\r\n");
+
+	// The spool is ordered by time, so every run of equal times is one row
+	std::vector<double> row(sortedProcesses.size() * metrics.size());
+	std::vector<bool> present(row.size());
+	std::vector<double> values(metrics.size());
+	bool hasRow = false;
+	uint64_t rowTime = 0;
+	TextBuffer text;
+	auto success = true;
+	auto flushRow = [&]()
+	{
+		if (!hasRow)
+			return;
+		text.appendUnsigned(rowTime);
+		for (size_t i = 0; i < row.size(); i++)
+		{
+			text.append(';');
+			if (present[i])
+				m_csvColumns.format(metrics[i % metrics.size()], row[i], text);
+		}
+		text.append("\r\n", 2);
+		if (text.full())
+			success = text.writeTo(csvFile) && success;
+		std::fill(present.begin(), present.end(), false);
+		hasRow = false;
+	};
+	CsvRecord record;
+	while (spool.read(&record, sizeof(record)) && spool.read(values.data(), values.size() * sizeof(double)))
+	{
+		auto column = record.index < columns.size() ? columns[record.index] : size_t(-1);
+		if (column == size_t(-1))
+			continue;
+		if (hasRow && record.time != rowTime)
+			flushRow();
+		rowTime = record.time;
+		for (size_t i = 0; i < values.size(); i++)
+		{
+			row[column + i] = values[i];
+			present[column + i] = true;
+		}
+		hasRow = true;
+	}
+	flushRow();
+	success = text.writeTo(csvFile) && success;
+	return fclose(csvFile) == 0 && success;
+}
+
+double ProcessTimeSeries::getCurrentCPUUsage(LastCpuUsage& last, const CpuTimes& cpu)
+{
+	static unsigned numProcessors = 0;
+
+	if (numProcessors == 0)
+		numProcessors = m_source.numberOfProcessors();
+
+	auto cpuTime = cpu.kernelTime + cpu.userTime;
+	if (!last.time)
+	{
+		if (cpu.startTime && cpu.startTime < cpu.now)
+		{
+			// Nothing was used before the process started. One that started since the previous tick
+			// shares its interval with the others, so the usages of a tick add up; one that ran
+			// unseen before gets its average.
+			last.time = m_lastTickCpuTime && cpu.startTime >= m_lastTickCpuTime ? m_lastTickCpuTime : cpu.startTime;
+			last.cpuTime = 0;
+		}
+		else
+		{
+			last.time = cpu.now;
+			last.cpuTime = cpuTime;
+		}
+	}
+
+	// Counters that did not advance count as idle
+	auto percent = 0.0;
+	if (cpu.now > last.time && cpuTime >= last.cpuTime)
+		percent = double(cpuTime - last.cpuTime) / double(cpu.now - last.time) / numProcessors;
+	last.time = cpu.now;
+	last.cpuTime = cpuTime;
+	last.cycleTime = cpu.cycleTime;
+	return percent * 100.0;
+}
+
+IoUsage ProcessTimeSeries::getCurrentIoUsage(LastIoUsage& last, const IoCounters& io, uint64_t now)
+{
+	IoUsage usage;
+	if (last.time && now > last.time)
+	{
+		// The times are in 100ns units, a counter that went backwards counts as idle
+		auto elapsed = now - last.time;
+		auto perSecond = [&](uint64_t current, uint64_t previous)
+		{
+			return current > previous ? uint64_t((current - previous) * 1e7 / elapsed) : 0;
+		};
+		usage.readBytes = perSecond(io.readTransferCount, last.counters.readTransferCount);
+		usage.writeBytes = perSecond(io.writeTransferCount, last.counters.writeTransferCount);
+		usage.readOperations = perSecond(io.readOperationCount, last.counters.readOperationCount);
+		usage.writeOperations = perSecond(io.writeOperationCount, last.counters.writeOperationCount);
+	}
+	last.time = now;
+	last.counters = io;
+	return usage;
+}
+
+std::vector<ProcessTimeSeries::SortedProcess> ProcessTimeSeries::getSortedProcesses() const
+{
+	std::vector<SortedProcess> sortedProcesses = m_exitedProcesses;
+	sortedProcesses.reserve(m_exitedProcesses.size() + m_processes.size());
+	m_processes.forEach([&](ProcessId, const ProcessState& state)
+		{
+			sortedProcesses.push_back(state.summary);
+		});
+	std::sort(sortedProcesses.begin(), sortedProcesses.end());
+	return sortedProcesses;
+}
@@ -0,0 +1,301 @@
+#pragma once
+
+#include "ProcessData.h"
+#include "TraceWriter.h"
+#include "Utils.h"
+#include "FlatHashMap.h"
+#include "TickScheduler.h"
+#include "SpscQueue.h"
+#include "StringTable.h"
+#include "BurstTrigger.h"
+#include "RingBuffer.h"
+#include "CsvColumns.h"
+#include "Compression.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Counters at the previous sample, a zero time before the first one
+struct LastCpuUsage
+{
+	uint64_t time = 0; // CpuTimes::now of the counters
+	uint64_t cpuTime = 0; // kernel and user
+	uint64_t cycleTime = 0;
+};
+
+struct LastIoUsage
+{
+	uint64_t time = 0; // CpuTimes::now of the counters
+	IoCounters counters;
+};
+
+class ProcessTimeSeries
+{
+	// Per-process aggregates, updated while sampling
+	struct SortedProcess
+	{
+		UniqueProcess uniqueProcess;
+		uint32_t index = 0;
+		uint64_t startTime = -1;
+		uint64_t endTime = 0;
+		uint64_t peakWorkingSetSize = 0;
+		uint64_t peakPrivateUsage = 0;
+		uint64_t peakTime = 0; // of the peak working set
+		double workingSetIntegral = 0.0; // bytes * ms
+		uint64_t cpuTime = 0; // at the last sample, 100ns units
+
+		bool operator<(const SortedProcess& o) const
+		{
+			return std::tie(startTime, endTime, uniqueProcess.pid, uniqueProcess.ppid) < std::tie(o.startTime, o.endTime, o.uniqueProcess.pid, o.uniqueProcess.ppid);
+		}
+	};
+
+	// Counters of a thread at the previous sample
+	struct LastThread
+	{
+		uint32_t tid = 0;
+		uint32_t index = 0;
+		uint64_t createTime = 0;
+		uint64_t kernelTime = 0;
+		uint64_t userTime = 0;
+		uint32_t contextSwitches = 0;
+		const std::string* name = nullptr;
+	};
+
+	// State of a process, looked up by identity for every sample
+	struct ProcessState
+	{
+		SortedProcess summary;
+		LastCpuUsage lastCpu;
+		LastIoUsage lastIo;
+		size_t lastWorkingSetSize = 0;
+		size_t lastPrivateUsage = 0;
+		std::vector<LastThread> threads; // sorted by tid, released when the process exits
+		uint64_t lastThreadTime = 0;
+	};
+
+	// Totals of the per-tick overhead, logged when closing
+	struct OverheadSummary
+	{
+		uint64_t ticks = 0;
+		uint64_t snapshotTime = 0;
+		uint64_t maxSnapshotTime = 0;
+		uint64_t queryCount = 0;
+		uint64_t queryTime = 0;
+		uint64_t maxQueryTime = 0;
+		uint64_t writeTime = 0;
+		uint64_t maxWriteTime = 0;
+		uint64_t queueTime = 0;
+		uint64_t maxQueueTime = 0;
+		uint32_t maxQueuedRecords = 0;
+		uint64_t cpuTime = 0; // 100ns units
+		size_t peakWorkingSetSize = 0;
+		uint32_t missedDeadlines = 0;
+		uint32_t droppedTicks = 0;
+		uint64_t compositionCount = 0;
+		uint64_t compositionTime = 0;
+		uint64_t maxCompositionTime = 0;
+	};
+
+	// Handed from the sampling thread to the writer thread, all pointers stay valid until closing
+	struct TickData
+	{
+		uint64_t time = 0;
+		uint32_t missedTicks = 0;
+		uint32_t droppedTicks = 0; // since the previous queued tick, because the queue was full
+	};
+
+	// Only the payload of the type is valid, so a record is no larger than a sample
+	struct TickRecord
+	{
+		enum Type : uint8_t
+		{
+			TickStart, // index (monitored pid), tick
+			ProcessStarted, // process
+			ProcessExited, // process, data (time and cpu totals of the last sample)
+			Sample, // process, index, data
+			ThreadSample, // process, index, thread
+			Composition, // process, index, composition
+			Rollup, // process, index, rollup
+			Burst, // text
+			Dump, // text (the reason)
+			TickEnd, // overhead
+		};
+
+		Type type = TickStart;
+		uint32_t index = 0;
+		UniqueProcess process;
+		union
+		{
+			TickData tick;
+			ProcessData data;
+			ThreadData thread;
+			CompositionData composition;
+			RollupData rollup;
+			OverheadData overhead;
+			const std::string* text;
+		};
+
+		TickRecord() : tick() {}
+	};
+
+	// Record in the CSV spool file, followed by the value of every metric of the columns
+	struct CsvRecord
+	{
+		uint64_t time = 0;
+		uint32_t index = 0;
+	};
+
+	// Sampling thread
+	ProcessSource& m_source;
+	bool m_snapshotSampling = false; // counters come from the snapshot instead of querying every process
+	bool m_threadSampling = false;
+	FlatHashMap<ProcessId, ProcessState> m_processes; // until the process exits
+	std::vector<SortedProcess> m_exitedProcesses;
+	OverheadData m_overhead; // of the current tick
+	LastCpuUsage m_selfCpu;
+	uint64_t m_tickCpuTime = 0; // snapshot time of the current tick, in the clock of CpuTimes::now
+	uint64_t m_lastTickCpuTime = 0;
+	uint64_t m_ticks = 0;
+	uint64_t m_selfCpuTime = 0; // 100ns units
+	size_t m_selfPeakWorkingSetSize = 0;
+	uint64_t m_carriedQueueTime = 0; // queueing done after the overhead of the previous tick was recorded
+	uint64_t m_workingSetChange = 0; // summed over the processes of the current tick
+	uint64_t m_privateChange = 0;
+	std::vector<TickRecord> m_tickRecords; // of the current tick, queued at once in endTick
+	uint32_t m_droppedTicks = 0; // since the last queued tick
+	bool m_warnedOversizedTick = false;
+	uint32_t m_totalDroppedTicks = 0;
+	std::vector<ThreadCounters> m_threadCounters; // reused for every process
+	std::vector<LastThread> m_nextThreads;
+	StringTable m_threadNames; // interned by the sampling thread, read by the writer thread
+	uint32_t m_threadCount = 0;
+	std::vector<BurstTrigger*> m_triggers;
+	StringTable m_messages; // of bursts and dumps, interned by the sampling thread, read by the writer thread
+	uint32_t m_processCount = 0; // indices handed out, the flight recorder releases exited processes
+	uint32_t m_monitoredPid = 0;
+	uint64_t m_tickWorkingSetSize = 0; // summed over the processes of the current tick
+	uint64_t m_tickPrivateUsage = 0;
+	SummaryData m_treeSummary; // kept apart from the processes, which the flight recorder releases
+	SortedProcess m_largestProcess; // by peak working set
+	bool m_hasExitCode = false;
+	int32_t m_exitCode = 0;
+
+	// Shared, the queue is the only way records get to the writer thread
+	SpscQueue<TickRecord> m_queue;
+	std::thread m_writerThread;
+	std::mutex m_writerMutex;
+	std::condition_variable m_writerWakeup;
+	std::atomic<bool> m_stopWriter{ false };
+
+	// Writer thread, the sampling thread only touches them when the writer is not running
+	FILE* m_logFile = nullptr;
+	std::string m_basename;
+	TraceFormat m_traceFormat = TraceFormat::JsonTicks;
+	std::unique_ptr<TraceWriter> m_traceWriter;
+	std::unique_ptr<RingBuffer<TickRecord>> m_flightRecorder; // keeps the ticks instead of writing them
+	uint64_t m_flightWindow = 0; // milliseconds
+	uint32_t m_dumpCount = 0;
+	SpoolFile m_csvSpool;
+	CsvColumns m_csvColumns;
+	std::vector<double> m_csvValues; // of the current record
+	std::vector<double> m_csvPeaks; // of the filter metric, by process index
+	OverheadSummary m_overheadSummary;
+	uint64_t m_tickWriteStart = 0;
+	uint64_t m_carriedWriteTime = 0; // writing done after the overhead of the previous tick was written
+
+public:
+	// The queue holds queueCapacity records (one per sample plus two per tick), when the
+	// writer falls that far behind whole ticks are dropped instead of blocking the sampling
+	ProcessTimeSeries(ProcessSource& source, FILE* logFile, TraceFormat format, bool snapshotSampling, bool threadSampling, size_t queueCapacity) :
+		m_source(source),
+		m_snapshotSampling(snapshotSampling),
+		m_threadSampling(threadSampling),
+		m_queue(queueCapacity),
+		m_logFile(logFile),
+		m_traceFormat(format),
+		m_traceWriter(createTraceWriter(format))
+	{
+	}
+
+	~ProcessTimeSeries();
+
+	// Also write the trace to another writer (a live stream), only before open
+	void addTraceWriter(std::unique_ptr<TraceWriter> traceWriter)
+	{
+		m_traceWriter = createTeeTraceWriter(std::move(m_traceWriter), std::move(traceWriter));
+	}
+
+	// Feed the samples to the rules of a trigger, it has to outlive the series
+	void addTrigger(BurstTrigger* trigger) { m_triggers.push_back(trigger); }
+	// Turn thread sampling on or off from the next tick on, for the window of a burst
+	void setThreadSampling(bool threadSampling);
+	// Note the start or end of a burst in the log, before the next tick
+	void logBurst(const std::string& message);
+
+	// Flight recorder: instead of writing the log, trace and CSV, keep the ticks of the last
+	// window in a ring of a fixed size and write them to a trace of their own on every dump and
+	// when closing. Only before open, false when the ring cannot be allocated.
+	bool setFlightRecorder(std::chrono::milliseconds window, size_t bytes);
+	// Records that fit into a flight recorder of the given size
+	static size_t flightRecorderCapacity(size_t bytes) { return std::max<size_t>(bytes / sizeof(TickRecord), 1); }
+	// Write the flight recorder to a new trace before the next tick, the reason is logged
+	void dump(const std::string& reason);
+
+	// Metrics, unit and filter of the CSV, only before open
+	void setCsvColumns(const CsvColumns& columns) { m_csvColumns = columns; }
+
+	// The trace is written by the writer thread while sampling, the CSV is generated when closing
+	bool open(const std::string& basename);
+	void processStarted(const UniqueProcess& uniqueProcess);
+	void processExited(const UniqueProcess& uniqueProcess);
+	// The snapshot time is in microseconds
+	void startTick(const TickTime& time, uint32_t monitoredPid, const TickScheduler& scheduler, uint64_t snapshotTime);
+	// Query a process and add its sample, and the samples of its threads that ran when thread sampling is enabled.
+	// Returns false when the process could not be queried.
+	bool logTickData(const TickTime& time, const UniqueProcess& uniqueProcess, const ProcessInfo& process, ProcessData& sample);
+	// Add a sample that was measured by the caller, the process id can be synthetic
+	void addSample(const TickTime& time, const UniqueProcess& uniqueProcess, const MemoryCounters& memoryCounters, double cpuUsage, const CpuTimes& cpuTimes, const IoUsage& ioUsage);
+	// Add a memory composition walked by the slow tier, ignored until the process has a sample
+	void addComposition(const TickTime& time, const UniqueProcess& uniqueProcess, const MemoryComposition& composition, uint64_t walkTime);
+	// Add the totals of the subtree of a process, ignored until the process has a sample
+	void addRollup(const UniqueProcess& uniqueProcess, const RollupData& rollup);
+	void endTick();
+
+	// Counters of a process of the last snapshot, the time spent is accounted to the tick
+	bool queryCounters(const ProcessInfo& process, MemoryCounters& memoryCounters, CpuTimes& cpuTimes, IoCounters& ioCounters);
+	// Percent of all processors used since the previous counters, updates last. A process that
+	// started since the previous tick is measured from there, so its whole CPU time counts.
+	double getCurrentCPUUsage(LastCpuUsage& last, const CpuTimes& cpu);
+	// Throughput since the previous counters, updates last. The first call only initializes last.
+	static IoUsage getCurrentIoUsage(LastIoUsage& last, const IoCounters& io, uint64_t now);
+
+	// Bytes the working set or private usage of the tracked processes changed by since the previous tick
+	uint64_t memoryChange() const { return std::max(m_workingSetChange, m_privateChange); }
+	// Exit code of the monitored process, for the summaries written when closing
+	void setExitCode(int32_t exitCode)
+	{
+		m_hasExitCode = true;
+		m_exitCode = exitCode;
+	}
+	// Waits for the writer thread to write the queued ticks, then adds the summaries to the
+	// trace and prints them to stderr
+	bool close();
+
+private:
+	void logThreads(const TickTime& time, const UniqueProcess& uniqueProcess, const ProcessInfo& process);
+	void stopWriter();
+	void writerThread();
+	void writeRecord(const TickRecord& record);
+	void summarizeOverhead(OverheadData& overhead, uint64_t writeStart);
+	void recordFlight(const TickRecord& record);
+	void storeFlightRecord(const TickRecord& record);
+	void evictFlightTick();
+	bool dumpFlight(const std::string& reason);
+	bool dumpCsv(const std::string& file);
+	void logOverheadSummary();
+	void writeSummaries();
+	void printSummary(FILE* file) const;
+	std::vector<SortedProcess> getSortedProcesses() const;
+};
@@ -0,0 +1,203 @@
+#include "ProcessTree.h"
+
+#include <algorithm>
+
+uint32_t ProcessTree::addRoot(uint32_t rootPid)
+{
+	Root root;
+	root.pid = rootPid;
+	m_roots.push_back(root);
+	return uint32_t(m_roots.size() - 1);
+}
+
+bool ProcessTree::update()
+{
+	// The nodes removed by the previous update can be reused now
+	m_freeNodes.insert(m_freeNodes.end(), m_removed.begin(), m_removed.end());
+	m_removed.clear();
+	m_added.clear();
+	for (Root& root : m_roots)
+		root.trackedChanges = 0;
+
+	if (!m_source.snapshot(m_snapshot))
+		return false;
+	m_generation++;
+
+	for (const ProcessInfo& info : m_snapshot)
+	{
+		if (auto existing = m_pidToNode.find(info.pid))
+		{
+			auto index = *existing;
+			Node& node = m_nodes[index];
+			if (node.info.createTime == info.createTime && node.info.imageHash == info.imageHash)
+			{
+				node.info = info;
+				node.generation = m_generation;
+				continue;
+			}
+			// The pid was reused or the image replaced
+			removeNode(index);
+		}
+		m_added.push_back(addNode(info));
+	}
+
+	for (uint32_t index = 0; index < m_nodes.size(); index++)
+	{
+		const Node& node = m_nodes[index];
+		if (node.alive && node.generation != m_generation)
+			removeNode(index);
+	}
+
+	if (m_added.empty())
+		return true;
+
+	// Link after all processes were added, a child can come before its parent in the snapshot
+	for (auto index : m_added)
+		linkParent(index);
+
+	for (auto index : m_added)
+	{
+		Node& node = m_nodes[index];
+		auto id = ProcessId(++m_serial) << 32 | node.info.pid;
+		node.uniqueProcess = UniqueProcess(id, node.info, m_names.intern(m_source.processName(node.info)));
+	}
+
+	for (auto index : m_added)
+	{
+		for (uint32_t root = 0; root < m_roots.size(); root++)
+		{
+			const Node& node = m_nodes[index];
+			if (node.trackedBy & (1ull << root))
+				continue;
+			if (isRoot(node, root) || (node.parent != NoNode && (m_nodes[node.parent].trackedBy & (1ull << root))))
+				trackSubtree(index, root);
+		}
+	}
+	return true;
+}
+
+uint32_t ProcessTree::addNode(const ProcessInfo& info)
+{
+	uint32_t index = 0;
+	if (!m_freeNodes.empty())
+	{
+		index = m_freeNodes.back();
+		m_freeNodes.pop_back();
+	}
+	else
+	{
+		index = uint32_t(m_nodes.size());
+		m_nodes.emplace_back();
+	}
+	Node& node = m_nodes[index];
+	node.info = info;
+	node.parent = NoNode;
+	node.firstChild = NoNode;
+	node.nextSibling = NoNode;
+	node.prevSibling = NoNode;
+	node.generation = m_generation;
+	node.alive = true;
+	node.trackedBy = 0;
+	m_pidToNode[info.pid] = index;
+	return index;
+}
+
+void ProcessTree::removeNode(uint32_t index)
+{
+	Node& node = m_nodes[index];
+
+	// Unlink from the parent
+	if (node.prevSibling != NoNode)
+		m_nodes[node.prevSibling].nextSibling = node.nextSibling;
+	else if (node.parent != NoNode)
+		m_nodes[node.parent].firstChild = node.nextSibling;
+	if (node.nextSibling != NoNode)
+		m_nodes[node.nextSibling].prevSibling = node.prevSibling;
+
+	// Orphan the children, they keep their tracked state
+	for (auto child = node.firstChild; child != NoNode;)
+	{
+		Node& c = m_nodes[child];
+		auto next = c.nextSibling;
+		c.parent = NoNode;
+		c.prevSibling = NoNode;
+		c.nextSibling = NoNode;
+		child = next;
+	}
+
+	for (uint32_t root = 0; root < m_roots.size(); root++)
+	{
+		if (node.trackedBy & (1ull << root))
+		{
+			auto& tracked = m_roots[root].tracked;
+			tracked.erase(std::find(tracked.begin(), tracked.end(), index));
+			m_roots[root].trackedChanges++;
+		}
+	}
+
+	auto mapped = m_pidToNode.find(node.info.pid);
+	if (mapped && *mapped == index)
+		m_pidToNode.erase(node.info.pid);
+
+	node.parent = NoNode;
+	node.firstChild = NoNode;
+	node.nextSibling = NoNode;
+	node.prevSibling = NoNode;
+	node.alive = false;
+	node.trackedBy = 0;
+	m_removed.push_back(index);
+}
+
+void ProcessTree::linkParent(uint32_t index)
+{
+	Node& node = m_nodes[index];
+	auto mapped = m_pidToNode.find(node.info.ppid);
+	if (!mapped || *mapped == index)
+		return;
+	auto parentIndex = *mapped;
+	Node& parent = m_nodes[parentIndex];
+	// Child started before the parent -> not a real parent
+	if (node.info.createTime < parent.info.createTime)
+		return;
+	node.parent = parentIndex;
+	node.nextSibling = parent.firstChild;
+	if (parent.firstChild != NoNode)
+		m_nodes[parent.firstChild].prevSibling = index;
+	parent.firstChild = index;
+}
+
+void ProcessTree::trackSubtree(uint32_t index, uint32_t root)
+{
+	auto currentPid = m_source.currentProcessId();
+	auto mask = 1ull << root;
+	Root& r = m_roots[root];
+	m_stack.clear();
+	m_stack.push_back(index);
+	while (!m_stack.empty())
+	{
+		auto top = m_stack.back();
+		m_stack.pop_back();
+		Node& node = m_nodes[top];
+		if ((node.trackedBy & mask) || node.info.pid == currentPid)
+			continue;
+		node.trackedBy |= mask;
+		r.tracked.push_back(top);
+		r.trackedChanges++;
+		if (isRoot(node, root))
+		{
+			r.seen = true;
+			r.createTime = node.info.createTime;
+		}
+		for (auto child = node.firstChild; child != NoNode; child = m_nodes[child].nextSibling)
+			m_stack.push_back(child);
+	}
+}
+
+bool ProcessTree::isRoot(const Node& node, uint32_t root) const
+{
+	const Root& r = m_roots[root];
+	if (node.info.pid != r.pid)
+		return false;
+	// A later process reusing the pid of the root is not tracked
+	return !r.seen || node.info.createTime == r.createTime;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "ProcessSource.h"
+#include "ProcessData.h"
+#include "FlatHashMap.h"
+#include "StringTable.h"
+
+// Process tree that is updated incrementally from the snapshots of a ProcessSource.
+// Once warmed up, a tick without started or exited processes does not allocate.
+// Several roots share the snapshot, every root tracks its own subtree (they can overlap).
+class ProcessTree
+{
+public:
+	static const uint32_t NoNode = -1;
+	static const uint32_t MaxRoots = 64;
+
+	struct Node
+	{
+		ProcessInfo info;
+		UniqueProcess uniqueProcess; // resolved once when the process is added
+		uint32_t parent = NoNode;
+		uint32_t firstChild = NoNode;
+		uint32_t nextSibling = NoNode;
+		uint32_t prevSibling = NoNode;
+		uint64_t generation = 0; // last snapshot the process was seen in
+		uint64_t trackedBy = 0; // bit mask of the roots
+		bool alive = false;
+	};
+
+	explicit ProcessTree(ProcessSource& source) : m_source(source) { }
+	ProcessTree(ProcessSource& source, uint32_t rootPid) : m_source(source) { addRoot(rootPid); }
+
+	// Returns the index of the root, only allowed before the first update
+	uint32_t addRoot(uint32_t rootPid);
+	uint32_t rootCount() const { return uint32_t(m_roots.size()); }
+	uint32_t rootPid(uint32_t root) const { return m_roots[root].pid; }
+
+	// Apply a new snapshot, the node indices of the last update stay valid until the next one
+	bool update();
+
+	const Node& node(uint32_t index) const { return m_nodes[index]; }
+	// All nodes including unused ones, the processes of the last snapshot are alive
+	const std::vector<Node>& nodes() const { return m_nodes; }
+	const std::vector<uint32_t>& added() const { return m_added; }
+	const std::vector<uint32_t>& removed() const { return m_removed; }
+	// Node of a process of the last snapshot, or NoNode
+	uint32_t find(uint32_t pid) const
+	{
+		auto index = m_pidToNode.find(pid);
+		return index ? *index : NoNode;
+	}
+
+	// Subtree of the root pid, a process stays tracked until it exits even if its parent exits first
+	const std::vector<uint32_t>& tracked(uint32_t root = 0) const { return m_roots[root].tracked; }
+
+	// Number of tracked processes that started or exited in the last update
+	uint32_t trackedChanges(uint32_t root = 0) const { return m_roots[root].trackedChanges; }
+
+	// Process names, they stay valid after the processes exited
+	const StringTable& names() const { return m_names; }
+
+private:
+	struct Root
+	{
+		uint32_t pid = 0;
+		bool seen = false;
+		uint64_t createTime = 0;
+		std::vector<uint32_t> tracked;
+		uint32_t trackedChanges = 0;
+	};
+
+	uint32_t addNode(const ProcessInfo& info);
+	void removeNode(uint32_t index);
+	void linkParent(uint32_t index);
+	void trackSubtree(uint32_t index, uint32_t root);
+	bool isRoot(const Node& node, uint32_t root) const;
+
+	ProcessSource& m_source;
+	std::vector<Root> m_roots;
+	uint64_t m_generation = 0;
+	uint32_t m_serial = 0;
+
+	std::vector<ProcessInfo> m_snapshot;
+	std::vector<Node> m_nodes;
+	std::vector<uint32_t> m_freeNodes;
+	FlatHashMap<uint32_t, uint32_t> m_pidToNode;
+	StringTable m_names;
+	std::vector<uint32_t> m_added;
+	std::vector<uint32_t> m_removed;
+	std::vector<uint32_t> m_stack;
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+
+#include <vector>
+
+// Fixed-capacity FIFO that never allocates after construction, the caller makes room by
+// popping the oldest items before pushing to a full buffer
+template <typename T>
+class RingBuffer
+{
+	std::vector<T> m_items;
+	size_t m_head = 0; // oldest item
+	size_t m_size = 0;
+
+public:
+	explicit RingBuffer(size_t capacity) : m_items(capacity) { }
+
+	RingBuffer(const RingBuffer&) = delete;
+	RingBuffer& operator=(const RingBuffer&) = delete;
+
+	size_t capacity() const { return m_items.size(); }
+	size_t size() const { return m_size; }
+	bool empty() const { return m_size == 0; }
+	bool full() const { return m_size == m_items.size(); }
+
+	// From the oldest (0) to the newest item
+	const T& operator[](size_t index) const { return m_items[(m_head + index) % m_items.size()]; }
+	const T& front() const { return (*this)[0]; }
+
+	bool push(const T& item)
+	{
+		if (full())
+			return false;
+		m_items[(m_head + m_size) % m_items.size()] = item;
+		m_size++;
+		return true;
+	}
+
+	void pop()
+	{
+		m_head = (m_head + 1) % m_items.size();
+		m_size--;
+	}
+};
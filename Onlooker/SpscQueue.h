@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+
+#include <atomic>
+#include <vector>
+
+// Bounded lock-free queue for exactly one producer and one consumer thread.
+// Neither side ever blocks or allocates, a full queue makes the producer fail instead.
+template <typename T>
+class SpscQueue
+{
+	std::vector<T> m_items;
+	size_t m_mask = 0;
+
+	// Each index is only written by one side, they live on separate cache lines
+	alignas(64) std::atomic<size_t> m_head{ 0 }; // next item to pop, written by the consumer
+	size_t m_cachedTail = 0; // consumer copy of m_tail
+	alignas(64) std::atomic<size_t> m_tail{ 0 }; // next free slot, written by the producer
+	size_t m_cachedHead = 0; // producer copy of m_head
+
+public:
+	// The capacity is rounded up to a power of two
+	explicit SpscQueue(size_t capacity)
+	{
+		size_t size = 2;
+		while (size < capacity)
+			size *= 2;
+		m_items.resize(size);
+		m_mask = size - 1;
+	}
+
+	SpscQueue(const SpscQueue&) = delete;
+	SpscQueue& operator=(const SpscQueue&) = delete;
+
+	size_t capacity() const { return m_items.size(); }
+
+	// Only exact when called from one of the two threads while the other one is idle
+	size_t size() const
+	{
+		return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+	}
+
+	bool empty() const { return size() == 0; }
+
+	// Producer: push all items or none of them
+	bool tryPush(const T* items, size_t count)
+	{
+		auto tail = m_tail.load(std::memory_order_relaxed);
+		if (tail + count - m_cachedHead > m_items.size())
+		{
+			m_cachedHead = m_head.load(std::memory_order_acquire);
+			if (tail + count - m_cachedHead > m_items.size())
+				return false;
+		}
+		for (size_t i = 0; i < count; i++)
+			m_items[(tail + i) & m_mask] = items[i];
+		m_tail.store(tail + count, std::memory_order_release);
+		return true;
+	}
+
+	bool tryPush(const T& item)
+	{
+		return tryPush(&item, 1);
+	}
+
+	// Consumer: the oldest item or nullptr, it stays valid until pop()
+	const T* front()
+	{
+		auto head = m_head.load(std::memory_order_relaxed);
+		if (head == m_cachedTail)
+		{
+			m_cachedTail = m_tail.load(std::memory_order_acquire);
+			if (head == m_cachedTail)
+				return nullptr;
+		}
+		return &m_items[head & m_mask];
+	}
+
+	void pop()
+	{
+		m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+};
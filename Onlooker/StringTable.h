@@ -0,0 +1,32 @@
+#pragma once
+
+#include "FlatHashMap.h"
+
+#include <deque>
+#include <string>
+#include <string_view>
+
+// Interned strings: every distinct string is stored once and keeps its address,
+// so it can be referenced, compared and hashed by pointer
+class StringTable
+{
+	std::deque<std::string> m_strings;
+	FlatHashMap<std::string_view, const std::string*> m_index;
+
+public:
+	StringTable() = default;
+	StringTable(const StringTable&) = delete;
+	StringTable& operator=(const StringTable&) = delete;
+
+	const std::string* intern(std::string_view str)
+	{
+		if (auto existing = m_index.find(str))
+			return *existing;
+		m_strings.emplace_back(str);
+		const std::string* interned = &m_strings.back();
+		m_index[*interned] = interned;
+		return interned;
+	}
+
+	size_t size() const { return m_strings.size(); }
+};
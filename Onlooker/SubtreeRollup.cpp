@@ -0,0 +1,78 @@
+#include "SubtreeRollup.h"
+
+#include <algorithm>
+
+SubtreeRollup::SubtreeRollup(ProcessTimeSeries& timeSeries, uint32_t root) :
+	m_timeSeries(timeSeries),
+	m_root(root)
+{
+}
+
+void SubtreeRollup::addSample(uint32_t node, const ProcessData& data)
+{
+	if (node >= m_entries.size())
+		m_entries.resize(node + 1);
+	Entry& entry = m_entries[node];
+	entry.tick = m_tick;
+	entry.sample.time = data.time;
+	entry.sample.workingSetSize = data.memory.workingSetSize;
+	entry.sample.privateUsage = data.memory.privateUsage;
+	entry.sample.cpuUsage = data.cpuUsage;
+	entry.sample.processCount = 1;
+}
+
+void SubtreeRollup::endTick(const ProcessTree& tree, const TickTime& time)
+{
+	auto mask = 1ull << m_root;
+	auto isTracked = [&](uint32_t index)
+	{
+		return index != ProcessTree::NoNode && (tree.node(index).trackedBy & mask);
+	};
+	m_entries.resize(std::max(m_entries.size(), tree.nodes().size()));
+
+	// The tops are the tracked processes whose parent is not, a process stays tracked when its
+	// parent exits
+	m_order.clear();
+	m_stack.clear();
+	for (auto index : tree.tracked(m_root))
+	{
+		if (!isTracked(tree.node(index).parent))
+			m_stack.push_back(index);
+	}
+	while (!m_stack.empty())
+	{
+		auto index = m_stack.back();
+		m_stack.pop_back();
+		m_order.push_back(index);
+		Entry& entry = m_entries[index];
+		entry.total = entry.tick == m_tick ? entry.sample : RollupData();
+		for (auto child = tree.node(index).firstChild; child != ProcessTree::NoNode; child = tree.node(child).nextSibling)
+		{
+			if (isTracked(child))
+				m_stack.push_back(child);
+		}
+	}
+
+	// Backwards every subtree is complete before its parent is reached
+	for (auto i = m_order.size(); i-- > 0;)
+	{
+		auto index = m_order[i];
+		const ProcessTree::Node& node = tree.node(index);
+		const RollupData& total = m_entries[index].total;
+		if (m_entries[index].tick == m_tick && total.processCount > 1)
+		{
+			RollupData rollup = total;
+			rollup.time = time.time;
+			m_timeSeries.addRollup(node.uniqueProcess, rollup);
+		}
+		if (isTracked(node.parent))
+		{
+			RollupData& parent = m_entries[node.parent].total;
+			parent.workingSetSize += total.workingSetSize;
+			parent.privateUsage += total.privateUsage;
+			parent.cpuUsage += total.cpuUsage;
+			parent.processCount += total.processCount;
+		}
+	}
+	m_tick++;
+}
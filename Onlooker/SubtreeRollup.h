@@ -0,0 +1,33 @@
+#pragma once
+
+#include "ProcessTimeSeries.h"
+#include "ProcessTree.h"
+
+// Totals of every tracked subtree, computed from the samples of a tick in a single post-order
+// pass over the tree, so "how much does the linker use" needs no post-processing. Only the
+// processes with sampled descendants get a rollup, the one of a leaf is its own sample.
+class SubtreeRollup
+{
+public:
+	SubtreeRollup(ProcessTimeSeries& timeSeries, uint32_t root);
+
+	// Sample of a tracked process in the current tick
+	void addSample(uint32_t node, const ProcessData& data);
+	// Add the rollups of the tick, before endTick of the time series
+	void endTick(const ProcessTree& tree, const TickTime& time);
+
+private:
+	struct Entry
+	{
+		uint64_t tick = 0; // the sample is of this tick
+		RollupData sample;
+		RollupData total;
+	};
+
+	ProcessTimeSeries& m_timeSeries;
+	uint32_t m_root = 0;
+	uint64_t m_tick = 1;
+	std::vector<Entry> m_entries; // by node index
+	std::vector<uint32_t> m_order; // parents before their children
+	std::vector<uint32_t> m_stack;
+};
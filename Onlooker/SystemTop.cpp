@@ -0,0 +1,110 @@
+#include "SystemTop.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+
+SystemTop::SystemTop(ProcessTimeSeries& timeSeries, uint32_t count, Rank rank) :
+	m_timeSeries(timeSeries),
+	m_count(count),
+	m_rank(rank)
+{
+	// Never collides with the identities of the ProcessTree, their serial starts at 1
+	m_other.id = ProcessId(-1);
+	m_other.pid = 0;
+	m_other.ppid = 0;
+	m_other.name = m_names.intern("<other>");
+}
+
+bool SystemTop::parse(const char* str, uint32_t& count, Rank& rank)
+{
+	char* end = nullptr;
+	auto value = strtoul(str, &end, 10);
+	if (end == str || value == 0)
+		return false;
+	count = uint32_t(value);
+	rank = Rank::Memory;
+	if (*end == '\0')
+		return true;
+	if (*end != ',')
+		return false;
+	end++;
+	if (strcmp(end, "memory") == 0)
+		rank = Rank::Memory;
+	else if (strcmp(end, "cpu") == 0)
+		rank = Rank::Cpu;
+	else
+		return false;
+	return true;
+}
+
+void SystemTop::sample(const ProcessTree& tree, const TickTime& time)
+{
+	for (auto index : tree.removed())
+		m_lastUsage.erase(tree.node(index).uniqueProcess.id);
+
+	m_candidates.clear();
+	const auto& nodes = tree.nodes();
+	for (uint32_t index = 0; index < nodes.size(); index++)
+	{
+		const ProcessTree::Node& node = nodes[index];
+		// The idle process of Windows only accounts the idle time
+		if (!node.alive || node.info.pid == 0)
+			continue;
+
+		Candidate candidate;
+		IoCounters ioCounters;
+		if (!m_timeSeries.queryCounters(node.info, candidate.memory, candidate.cpu, ioCounters))
+			continue;
+		LastUsage& lastUsage = m_lastUsage[node.uniqueProcess.id];
+		candidate.node = index;
+		candidate.cpuUsage = m_timeSeries.getCurrentCPUUsage(lastUsage.cpu, candidate.cpu);
+		candidate.io = ProcessTimeSeries::getCurrentIoUsage(lastUsage.io, ioCounters, candidate.cpu.now);
+		candidate.key = m_rank == Rank::Cpu ? candidate.cpuUsage : double(candidate.memory.workingSetSize);
+		m_candidates.push_back(candidate);
+	}
+
+	// Partition in linear time, only the top N are sorted for a stable order in the log
+	auto byKey = [](const Candidate& a, const Candidate& b)
+	{
+		return a.key > b.key || (a.key == b.key && a.node < b.node);
+	};
+	auto top = std::min(size_t(m_count), m_candidates.size());
+	std::nth_element(m_candidates.begin(), m_candidates.begin() + top, m_candidates.end(), byKey);
+	std::sort(m_candidates.begin(), m_candidates.begin() + top, byKey);
+
+	for (size_t i = 0; i < top; i++)
+	{
+		const Candidate& candidate = m_candidates[i];
+		m_timeSeries.addSample(time, tree.node(candidate.node).uniqueProcess, candidate.memory, candidate.cpuUsage, candidate.cpu, candidate.io);
+	}
+
+	if (top == m_candidates.size())
+		return;
+	MemoryCounters other;
+	double otherCpuUsage = 0;
+	IoUsage otherIo;
+	for (size_t i = top; i < m_candidates.size(); i++)
+	{
+		const MemoryCounters& memory = m_candidates[i].memory;
+		other.pageFaultCount += memory.pageFaultCount;
+		other.peakWorkingSetSize += memory.peakWorkingSetSize;
+		other.workingSetSize += memory.workingSetSize;
+		other.quotaPeakPagedPoolUsage += memory.quotaPeakPagedPoolUsage;
+		other.quotaPagedPoolUsage += memory.quotaPagedPoolUsage;
+		other.quotaPeakNonPagedPoolUsage += memory.quotaPeakNonPagedPoolUsage;
+		other.quotaNonPagedPoolUsage += memory.quotaNonPagedPoolUsage;
+		other.pagefileUsage += memory.pagefileUsage;
+		other.peakPagefileUsage += memory.peakPagefileUsage;
+		other.privateUsage += memory.privateUsage;
+		otherCpuUsage += m_candidates[i].cpuUsage;
+		const IoUsage& io = m_candidates[i].io;
+		otherIo.readBytes += io.readBytes;
+		otherIo.writeBytes += io.writeBytes;
+		otherIo.readOperations += io.readOperations;
+		otherIo.writeOperations += io.writeOperations;
+	}
+	// Totals of a changing set of processes mean nothing
+	m_timeSeries.addSample(time, m_other, other, otherCpuUsage, CpuTimes(), otherIo);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "ProcessTimeSeries.h"
+#include "ProcessTree.h"
+#include "StringTable.h"
+
+// System-wide recording: every process of the snapshot is sampled, but only the top N
+// by memory or CPU usage get a series of their own, the others are summed into a single
+// "<other>" series so the size of the trace stays bounded
+class SystemTop
+{
+public:
+	enum class Rank
+	{
+		Memory, // working set
+		Cpu,
+	};
+
+	SystemTop(ProcessTimeSeries& timeSeries, uint32_t count, Rank rank);
+
+	// Parse the value of ONLOOKER_SYSTEM_TOP: <count>[,memory|cpu]
+	static bool parse(const char* str, uint32_t& count, Rank& rank);
+
+	// Add the samples of the current tick, between startTick and endTick of the time series
+	void sample(const ProcessTree& tree, const TickTime& time);
+
+private:
+	struct Candidate
+	{
+		uint32_t node = 0;
+		double key = 0;
+		double cpuUsage = 0;
+		CpuTimes cpu;
+		MemoryCounters memory;
+		IoUsage io;
+	};
+
+	struct LastUsage
+	{
+		LastCpuUsage cpu;
+		LastIoUsage io;
+	};
+
+	ProcessTimeSeries& m_timeSeries;
+	uint32_t m_count = 0;
+	Rank m_rank = Rank::Memory;
+	FlatHashMap<ProcessId, LastUsage> m_lastUsage; // of every process, also the ones not in the top
+	std::vector<Candidate> m_candidates;
+	StringTable m_names;
+	UniqueProcess m_other;
+};
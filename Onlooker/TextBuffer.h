@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+
+#include <algorithm>
+#include <charconv>
+#include <memory>
+#include <string>
+
+// Text assembled in memory and written to a file in large blocks. Numbers are formatted by
+// hand instead of through printf, which parses its format string again for every field.
+class TextBuffer
+{
+	std::unique_ptr<char[]> m_data;
+	size_t m_size = 0;
+	size_t m_capacity = 0;
+	size_t m_blockSize = 0;
+
+	// Rarely needed, the buffer is allocated for a block and a record up front
+	void grow(size_t length)
+	{
+		auto capacity = std::max(m_capacity * 2, m_size + length);
+		std::unique_ptr<char[]> data(new char[capacity]);
+		memcpy(data.get(), m_data.get(), m_size);
+		m_data = std::move(data);
+		m_capacity = capacity;
+	}
+
+	char* reserve(size_t length)
+	{
+		if (m_size + length > m_capacity)
+			grow(length);
+		return m_data.get() + m_size;
+	}
+
+public:
+	// Writers check full() at the end of a record and write the block when it is reached
+	explicit TextBuffer(size_t blockSize = 256 * 1024) :
+		m_data(new char[blockSize + 4096]),
+		m_capacity(blockSize + 4096),
+		m_blockSize(blockSize)
+	{
+	}
+
+	TextBuffer(const TextBuffer&) = delete;
+	TextBuffer& operator=(const TextBuffer&) = delete;
+
+	size_t size() const { return m_size; }
+	bool full() const { return m_size >= m_blockSize; }
+	const char* data() const { return m_data.get(); }
+	// Drops the text after the given size, once a record formatted at the end was moved elsewhere
+	void truncate(size_t size) { m_size = std::min(size, m_size); }
+
+	void append(char c)
+	{
+		*reserve(1) = c;
+		m_size++;
+	}
+
+	void append(const char* str, size_t length)
+	{
+		memcpy(reserve(length), str, length);
+		m_size += length;
+	}
+
+	// The length of a literal is known at compile time
+	template <size_t N>
+	void appendLiteral(const char (&literal)[N])
+	{
+		append(literal, N - 1);
+	}
+
+	void append(const char* str) { append(str, strlen(str)); }
+	void append(const std::string& str) { append(str.data(), str.size()); }
+
+	void appendUnsigned(uint64_t value)
+	{
+		auto begin = reserve(20);
+		m_size += std::to_chars(begin, begin + 20, value).ptr - begin;
+	}
+
+	// Like %.<precision>f for precisions up to 6, JSON has no NaN or infinity so they are written as 0
+	void appendFixed(double value, int precision)
+	{
+		static const uint64_t scales[] = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+		if (!std::isfinite(value))
+		{
+			append('0');
+			return;
+		}
+		if (value < 0)
+		{
+			append('-');
+			value = -value;
+		}
+		auto scale = scales[precision];
+		if (value * scale >= 1e18)
+		{
+			char text[512];
+			auto length = snprintf(text, sizeof(text), "%.*f", precision, value);
+			append(text, size_t(length));
+			return;
+		}
+		auto scaled = uint64_t(std::nearbyint(value * scale)); // ties to even, like printf
+		appendUnsigned(scaled / scale);
+		if (!precision)
+			return;
+		append('.');
+		auto fraction = scaled % scale;
+		for (auto digit = scale / 10; digit; digit /= 10)
+			append(char('0' + fraction / digit % 10));
+	}
+
+	// A quoted JSON string, quotes, backslashes and control characters are escaped
+	void appendJsonString(const std::string& str)
+	{
+		static const char hex[] = "0123456789abcdef";
+		append('"');
+		size_t clean = 0; // start of the characters that need no escaping
+		for (size_t i = 0; i < str.size(); i++)
+		{
+			auto c = static_cast<unsigned char>(str[i]);
+			if (c >= 0x20 && c != '"' && c != '\\')
+				continue;
+			append(str.data() + clean, i - clean);
+			clean = i + 1;
+			append('\\');
+			switch (c)
+			{
+			case '"': append('"'); break;
+			case '\\': append('\\'); break;
+			case '\n': append('n'); break;
+			case '\r': append('r'); break;
+			case '\t': append('t'); break;
+			default:
+				appendLiteral("u00");
+				append(hex[c >> 4]);
+				append(hex[c & 15]);
+				break;
+			}
+		}
+		append(str.data() + clean, str.size() - clean);
+		append('"');
+	}
+
+	// Write everything and start over, false when the write failed
+	bool writeTo(FILE* file)
+	{
+		auto success = fwrite(m_data.get(), 1, m_size, file) == m_size;
+		m_size = 0;
+		return success;
+	}
+};
@@ -0,0 +1,130 @@
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#include <mmsystem.h>
+
+#pragma comment(lib, "winmm.lib")
+#endif // _WIN32
+
+#include "TickScheduler.h"
+
+#include <cstdio>
+#include <cctype>
+
+#include <algorithm>
+#include <thread>
+
+// The scheduler wakes up this much before a deadline and yields until it is reached,
+// the sleep granularity of Windows is a timer period (1ms with timeBeginPeriod)
+#ifdef _WIN32
+static const std::chrono::microseconds SpinThreshold(1500);
+#else
+static const std::chrono::microseconds SpinThreshold(100);
+#endif // _WIN32
+
+TickScheduler::TickScheduler(std::chrono::microseconds interval) :
+	m_interval(std::max(interval, std::chrono::microseconds(1))),
+	m_start(Clock::now())
+{
+	using namespace std::chrono;
+	m_startWallTime = uint64_t(duration_cast<microseconds>(system_clock::now().time_since_epoch()).count());
+	// The samples are stamped in milliseconds, the grid starts at one so they get the exact grid time
+	m_startWallTime -= m_startWallTime % 1000;
+#ifdef _WIN32
+	timeBeginPeriod(1);
+#endif // _WIN32
+}
+
+TickScheduler::~TickScheduler()
+{
+#ifdef _WIN32
+	timeEndPeriod(1);
+#endif // _WIN32
+}
+
+uint64_t TickScheduler::tickTime() const
+{
+	if (m_replay)
+		return m_replayTime;
+	return m_startWallTime + (m_tick - m_startTick) * uint64_t(m_interval.count());
+}
+
+void TickScheduler::setInterval(std::chrono::microseconds interval)
+{
+	interval = std::max(interval, std::chrono::microseconds(1));
+	if (interval == m_interval)
+		return;
+	m_startWallTime = tickTime();
+	m_start = deadline(m_tick);
+	m_startTick = m_tick;
+	m_interval = interval;
+}
+
+TickScheduler::Clock::time_point TickScheduler::deadline(uint64_t tick) const
+{
+	return m_start + m_interval * (tick - m_startTick);
+}
+
+void TickScheduler::replayTick(uint64_t wallTime)
+{
+	m_replay = true;
+	m_replayTime = wallTime;
+}
+
+void TickScheduler::waitNextTick()
+{
+	if (m_replay)
+	{
+		m_tick++;
+		m_missedTicks = 0;
+		return;
+	}
+	auto next = m_tick + 1;
+	auto now = Clock::now();
+	if (now >= deadline(next))
+	{
+		// The tick overran, continue with the first grid point in the future
+		auto passed = m_startTick + uint64_t((now - m_start) / m_interval);
+		m_missedTicks = uint32_t(passed + 1 - next);
+		next = passed + 1;
+	}
+	else
+	{
+		m_missedTicks = 0;
+	}
+	m_totalMissedTicks += m_missedTicks;
+	m_tick = next;
+	sleepUntil(deadline(next), m_interval);
+}
+
+bool AdaptiveInterval::parse(const char* str, std::chrono::microseconds& minInterval, std::chrono::microseconds& maxInterval, double& threshold)
+{
+	// Whole milliseconds, like the time stamps of the samples
+	unsigned minMs = 0, maxMs = 0;
+	double mbPerSecond = 10;
+	int length = 0;
+	if (!isdigit((unsigned char)str[0]) || sscanf(str, "%u,%u%n", &minMs, &maxMs, &length) != 2 || minMs == 0 || maxMs < minMs)
+		return false;
+	if (str[length] && (sscanf(str + length, ",%lf", &mbPerSecond) != 1 || !(mbPerSecond > 0)))
+		return false;
+	minInterval = std::chrono::milliseconds(minMs);
+	maxInterval = std::chrono::milliseconds(maxMs);
+	threshold = mbPerSecond * 1024 * 1024;
+	return true;
+}
+
+std::chrono::microseconds AdaptiveInterval::next(std::chrono::microseconds current, uint64_t memoryChange, bool processesChanged) const
+{
+	auto seconds = current.count() / 1e6;
+	if (processesChanged || memoryChange > m_threshold * seconds)
+		return m_minInterval;
+	return std::min(std::max(current * 2, m_minInterval), m_maxInterval);
+}
+
+void TickScheduler::sleepUntil(Clock::time_point deadline, std::chrono::microseconds interval)
+{
+	auto spin = std::min<Clock::duration>(SpinThreshold, interval / 10);
+	std::this_thread::sleep_until(deadline - spin);
+	while (Clock::now() < deadline)
+		std::this_thread::yield();
+}
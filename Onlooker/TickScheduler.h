@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+
+#include <chrono>
+#include <algorithm>
+
+// Schedules ticks on a regular grid of absolute deadlines on the monotonic clock. Tick n is
+// due at start + n * interval, so a slow tick does not shift the following ones. Deadlines
+// that passed while a tick was still running are skipped and counted as missed, there is no
+// burst of catch-up ticks.
+class TickScheduler
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	explicit TickScheduler(std::chrono::microseconds interval);
+	~TickScheduler();
+
+	TickScheduler(const TickScheduler&) = delete;
+	TickScheduler& operator=(const TickScheduler&) = delete;
+
+	// Number of the current tick on the grid, missed ticks leave gaps
+	uint64_t tick() const { return m_tick; }
+
+	// Wall clock time of the grid point of the current tick (microseconds since epoch)
+	uint64_t tickTime() const;
+
+	std::chrono::microseconds interval() const { return m_interval; }
+
+	// Change the interval starting with the next tick, the grid is re-anchored at the current tick
+	void setInterval(std::chrono::microseconds interval);
+
+	// Ticks skipped before the current one, and in total
+	uint32_t missedTicks() const { return m_missedTicks; }
+	uint32_t totalMissedTicks() const { return m_totalMissedTicks; }
+
+	// Sleep until the deadline of the next tick that is still in the future
+	void waitNextTick();
+
+	// Replay of a recording: the current tick is stamped with the time its snapshot was captured
+	// at (microseconds since epoch) and the following ones are not waited for
+	void replayTick(uint64_t wallTime);
+
+private:
+	Clock::time_point deadline(uint64_t tick) const;
+	static void sleepUntil(Clock::time_point deadline, std::chrono::microseconds interval);
+
+	std::chrono::microseconds m_interval;
+	Clock::time_point m_start; // deadline of m_startTick
+	uint64_t m_startWallTime = 0; // microseconds since epoch at m_start
+	uint64_t m_startTick = 0;
+	uint64_t m_tick = 0;
+	uint32_t m_missedTicks = 0;
+	uint32_t m_totalMissedTicks = 0;
+	bool m_replay = false;
+	uint64_t m_replayTime = 0;
+};
+
+// Adaptive sampling: the interval drops to the minimum while the memory of the tracked
+// processes changes faster than the threshold or processes start or exit, and doubles
+// up to the maximum for every quiet tick
+class AdaptiveInterval
+{
+public:
+	AdaptiveInterval(std::chrono::microseconds minInterval, std::chrono::microseconds maxInterval, double threshold) :
+		m_minInterval(minInterval),
+		m_maxInterval(std::max(minInterval, maxInterval)),
+		m_threshold(threshold)
+	{
+	}
+
+	// Parse the value of ONLOOKER_ADAPTIVE_INTERVAL: <min ms>,<max ms>[,<threshold MB/s>]
+	static bool parse(const char* str, std::chrono::microseconds& minInterval, std::chrono::microseconds& maxInterval, double& threshold);
+
+	// The change is in bytes and was measured over the current interval
+	std::chrono::microseconds next(std::chrono::microseconds current, uint64_t memoryChange, bool processesChanged) const;
+
+	std::chrono::microseconds minInterval() const { return m_minInterval; }
+	std::chrono::microseconds maxInterval() const { return m_maxInterval; }
+
+private:
+	std::chrono::microseconds m_minInterval;
+	std::chrono::microseconds m_maxInterval;
+	double m_threshold = 0; // bytes per second
+};
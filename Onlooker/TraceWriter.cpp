@@ -0,0 +1,317 @@
+#include "TraceWriter.h"
+#include "Utils.h"
+#include "Compression.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <cinttypes>
+#include <map>
+#include <vector>
+
+class TeeTraceWriter : public TraceWriter
+{
+	std::unique_ptr<TraceWriter> m_first;
+	std::unique_ptr<TraceWriter> m_second;
+
+public:
+	TeeTraceWriter(std::unique_ptr<TraceWriter> first, std::unique_ptr<TraceWriter> second) :
+		m_first(std::move(first)),
+		m_second(std::move(second))
+	{
+	}
+
+	bool open(const std::string& basename) override
+	{
+		return m_first->open(basename) && m_second->open(basename);
+	}
+
+	void addSample(uint32_t index, const UniqueProcess& process, const ProcessData& data) override
+	{
+		m_first->addSample(index, process, data);
+		m_second->addSample(index, process, data);
+	}
+
+	void addThreadSample(uint32_t index, const UniqueProcess& process, const ThreadData& data) override
+	{
+		m_first->addThreadSample(index, process, data);
+		m_second->addThreadSample(index, process, data);
+	}
+
+	void addComposition(uint32_t index, const UniqueProcess& process, const CompositionData& data) override
+	{
+		m_first->addComposition(index, process, data);
+		m_second->addComposition(index, process, data);
+	}
+
+	void addRollup(uint32_t index, const UniqueProcess& process, const RollupData& data) override
+	{
+		m_first->addRollup(index, process, data);
+		m_second->addRollup(index, process, data);
+	}
+
+	void addOverhead(const OverheadData& overhead) override
+	{
+		m_first->addOverhead(overhead);
+		m_second->addOverhead(overhead);
+	}
+
+	void endTick() override
+	{
+		m_first->endTick();
+		m_second->endTick();
+	}
+
+	void addSummary(uint32_t index, const UniqueProcess& process, const SummaryData& data) override
+	{
+		m_first->addSummary(index, process, data);
+		m_second->addSummary(index, process, data);
+	}
+
+	void addTreeSummary(const SummaryData& data) override
+	{
+		m_first->addTreeSummary(data);
+		m_second->addTreeSummary(data);
+	}
+
+	bool close() override
+	{
+		auto success = m_first->close();
+		return m_second->close() && success;
+	}
+};
+
+std::unique_ptr<TraceWriter> createTraceWriter(TraceFormat format)
+{
+	switch (format)
+	{
+	case TraceFormat::Json:
+		return createJsonTraceWriter(JsonLayout::Processes);
+	case TraceFormat::JsonTicks:
+		return createJsonTraceWriter(JsonLayout::Ticks);
+	case TraceFormat::Binary:
+		return createBinaryTraceWriter();
+	}
+	return nullptr;
+}
+
+std::unique_ptr<TraceWriter> createTeeTraceWriter(std::unique_ptr<TraceWriter> first, std::unique_ptr<TraceWriter> second)
+{
+	return std::make_unique<TeeTraceWriter>(std::move(first), std::move(second));
+}
+
+bool parseTraceFormat(const char* str, TraceFormat& format)
+{
+	if (strcmp(str, "json") == 0)
+		format = TraceFormat::Json;
+	else if (strcmp(str, "json-ticks") == 0)
+		format = TraceFormat::JsonTicks;
+	else if (strcmp(str, "binary") == 0)
+		format = TraceFormat::Binary;
+	else
+		return false;
+	return true;
+}
+
+const char* traceExtension(TraceFormat format)
+{
+	return format == TraceFormat::Binary ? ".olt" : ".json";
+}
+
+// The JSON serializer before the trace was streamed: ProcessData::toJson, one fprintf per sample
+static void toJson(FILE* file, const ProcessData& data)
+{
+	const MemoryCounters& memory = data.memory;
+	fprintf(file, R"({"time":%)" PRIu64 R"(,"cpuUsage":%.0f,"memory":{"pageFaultCount":%u,"peakWorkingSetSize":%zu,"workingSetSize":%zu,"quotaPeakPagedPoolUsage":%zu,"quotaPagedPoolUsage":%zu,"quotaPeakNonPagedPoolUsage":%zu,"quotaNonPagedPoolUsage":%zu,"pagefileUsage":%zu,"peakPagefileUsage":%zu,"privateUsage":%zu},"io":{"readBytes":%)" PRIu64 R"(,"writeBytes":%)" PRIu64 R"(,"readOperations":%)" PRIu64 R"(,"writeOperations":%)" PRIu64 R"(},"cpuTime":%)" PRIu64 R"(,"cycleTime":%)" PRIu64 R"(})",
+		data.time,
+		data.cpuUsage,
+		memory.pageFaultCount,
+		memory.peakWorkingSetSize,
+		memory.workingSetSize,
+		memory.quotaPeakPagedPoolUsage,
+		memory.quotaPagedPoolUsage,
+		memory.quotaPeakNonPagedPoolUsage,
+		memory.quotaNonPagedPoolUsage,
+		memory.pagefileUsage,
+		memory.peakPagefileUsage,
+		memory.privateUsage,
+		data.io.readBytes,
+		data.io.writeBytes,
+		data.io.readOperations,
+		data.io.writeOperations,
+		data.cpuTime,
+		data.cycleTime
+	);
+}
+
+// ProcessTimeSeries::dumpJson before the trace was streamed: the samples were kept by process
+// until the end of the run, then written as an object per process in the order of the first samples
+class DumpJsonWriter
+{
+	std::vector<UniqueProcess> m_processes;
+	std::map<uint32_t, std::vector<ProcessData>> m_processData;
+
+public:
+	void addSample(uint32_t index, const UniqueProcess& process, const ProcessData& data)
+	{
+		auto& samples = m_processData[index];
+		if (samples.empty())
+			m_processes.push_back(process);
+		samples.push_back(data);
+	}
+
+	bool dumpJson(const std::string& file) const
+	{
+		FILE* jsonFile = openOutputFile(file);
+		if (!jsonFile)
+			return false;
+		fprintf(jsonFile, "[");
+		bool firstProcess = true;
+		for (size_t index = 0; index < m_processes.size(); index++)
+		{
+			const UniqueProcess& uniqueProcess = m_processes[index];
+			fprintf(jsonFile, R"(%s{"pid":%u,"ppid":%u,"createTime":%)" PRIu64 R"(,"name":"%s","data":[)",
+				firstProcess ? "" : ",",
+				uniqueProcess.pid,
+				uniqueProcess.ppid,
+				uniqueProcess.createTime,
+				uniqueProcess.name->c_str()
+			);
+			bool firstData = true;
+			for (const ProcessData& data : m_processData.at(uint32_t(index)))
+			{
+				if (!firstData)
+					fprintf(jsonFile, ",");
+				toJson(jsonFile, data);
+				firstData = false;
+			}
+			fprintf(jsonFile, "]}");
+			firstProcess = false;
+		}
+		fprintf(jsonFile, "]");
+		return fclose(jsonFile) == 0;
+	}
+};
+
+int benchmarkTraceWriters(uint64_t samples)
+{
+	// A build with a few hundred processes that slowly grow, sampled every 100 ms
+	const uint32_t processCount = 256;
+	std::vector<std::string> names(processCount);
+	std::vector<UniqueProcess> processes(processCount);
+	for (uint32_t i = 0; i < processCount; i++)
+	{
+		names[i] = i % 16 ? "cl.exe" : "link \"release\".exe";
+		processes[i].id = i;
+		processes[i].pid = 1000 + i * 4;
+		processes[i].ppid = i ? 1000 : 4;
+		processes[i].createTime = 132000000000000000ull + i * 10000;
+		processes[i].name = &names[i];
+	}
+	auto sampleOf = [&](uint64_t sample)
+	{
+		auto tick = sample / processCount;
+		auto index = uint32_t(sample % processCount);
+		ProcessData data;
+		data.time = 1700000000000ull + tick * 100;
+		data.memory.pageFaultCount = uint32_t(tick * 37 + index);
+		data.memory.workingSetSize = (64ull << 20) + tick * 4096 + index * 65536;
+		data.memory.peakWorkingSetSize = data.memory.workingSetSize + 8192;
+		data.memory.privateUsage = data.memory.workingSetSize / 2;
+		data.memory.pagefileUsage = data.memory.privateUsage;
+		data.memory.peakPagefileUsage = data.memory.privateUsage + 4096;
+		data.memory.quotaPagedPoolUsage = 120000 + index;
+		data.memory.quotaPeakPagedPoolUsage = 130000 + index;
+		data.memory.quotaNonPagedPoolUsage = 9000 + index;
+		data.memory.quotaPeakNonPagedPoolUsage = 9500 + index;
+		data.cpuUsage = (tick * 7 + index) % 1000 / 10.0;
+		data.io.readBytes = (tick * 1000 + index) % 5000000;
+		data.io.writeBytes = (tick * 3000 + index) % 2000000;
+		data.io.readOperations = data.io.readBytes / 4096;
+		data.io.writeOperations = data.io.writeBytes / 4096;
+		data.cpuTime = tick * 250000 + index;
+		return data;
+	};
+
+	const std::string basename = "Onlooker_benchmark";
+	struct Result
+	{
+		const char* name;
+		std::string file;
+		uint64_t time = 0;
+		uint64_t bytes = 0;
+	};
+	std::vector<Result> results;
+	auto fileSize = [](const std::string& file)
+	{
+		FILE* f = fopen(file.c_str(), "rb");
+		if (!f)
+			return uint64_t(0);
+		fseek(f, 0, SEEK_END);
+		auto size = uint64_t(ftell(f));
+		fclose(f);
+		return size;
+	};
+
+	{
+		Result result{ "json (dumpJson)", basename + "_dump.json" };
+		auto start = monotonicMicroseconds();
+		DumpJsonWriter writer;
+		for (uint64_t sample = 0; sample < samples; sample++)
+		{
+			auto index = uint32_t(sample % processCount);
+			writer.addSample(index, processes[index], sampleOf(sample));
+		}
+		if (!writer.dumpJson(result.file))
+		{
+			fprintf(stderr, "[Onlooker] Failed to write %s.\n", result.file.c_str());
+			return EXIT_FAILURE;
+		}
+		result.time = monotonicMicroseconds() - start;
+		results.push_back(result);
+	}
+
+	for (auto format : { TraceFormat::Json, TraceFormat::JsonTicks, TraceFormat::Binary })
+	{
+		static const char* names[] = { "json", "json-ticks", "binary" };
+		auto file = basename + "_" + names[int(format)];
+		Result result{ names[int(format)], file + traceExtension(format) };
+		auto writer = createTraceWriter(format);
+		if (!writer->open(file))
+		{
+			fprintf(stderr, "[Onlooker] Failed to open %s.\n", result.file.c_str());
+			return EXIT_FAILURE;
+		}
+		auto start = monotonicMicroseconds();
+		for (uint64_t sample = 0; sample < samples; sample++)
+		{
+			auto index = uint32_t(sample % processCount);
+			writer->addSample(index, processes[index], sampleOf(sample));
+			if (index == processCount - 1)
+				writer->endTick();
+		}
+		writer->endTick();
+		writer->close();
+		result.time = monotonicMicroseconds() - start;
+		results.push_back(result);
+	}
+
+#ifdef NDEBUG
+	const char* build = "release build";
+#else
+	const char* build = "debug build, not representative of a release";
+#endif // NDEBUG
+	fprintf(stderr, "[Onlooker] %" PRIu64 " samples of %u processes per tick (%s):\n", samples, processCount, build);
+	for (Result& result : results)
+	{
+		result.bytes = fileSize(result.file);
+		remove(result.file.c_str());
+		fprintf(stderr, "  %-15s %9.3f s %10.0f samples/s %12s  x%.2f\n",
+			result.name,
+			result.time / 1e6,
+			samples / (std::max<uint64_t>(result.time, 1) / 1e6),
+			humanReadableSize(result.bytes).c_str(),
+			double(results.front().time) / std::max<uint64_t>(result.time, 1)
+		);
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "ProcessData.h"
+
+#include <memory>
+
+enum class TraceFormat
+{
+	Json, // .json, an object per process with all its samples, loadable as a whole by Cutelooker
+	JsonTicks, // .json, a line of chunks per tick (version 2), a killed run can still be loaded
+	Binary, // .olt, see BinaryTrace.h
+};
+
+enum class JsonLayout
+{
+	Processes,
+	Ticks,
+};
+
+// Receives the samples of every tick in time order and writes them to disk
+class TraceWriter
+{
+public:
+	virtual ~TraceWriter() = default;
+
+	// The writer appends its own extension to the basename
+	virtual bool open(const std::string& basename) = 0;
+
+	// The index is assigned by ProcessTimeSeries when the process is first seen. It is unique,
+	// but when ticks are dropped some indices are skipped or their first samples are missing.
+	virtual void addSample(uint32_t index, const UniqueProcess& process, const ProcessData& data) = 0;
+	// Thread of a process that was sampled in the same tick, only added when it ran since the previous tick
+	virtual void addThreadSample(uint32_t index, const UniqueProcess& process, const ThreadData& data) = 0;
+	// Memory composition of a process that was sampled before, added less often than the samples
+	virtual void addComposition(uint32_t index, const UniqueProcess& process, const CompositionData& data) = 0;
+	// Totals of the subtree of a process that was sampled in the same tick
+	virtual void addRollup(uint32_t index, const UniqueProcess& process, const RollupData& data) = 0;
+	// Sampler overhead of the tick, added after its samples
+	virtual void addOverhead(const OverheadData& overhead) = 0;
+	virtual void endTick() = 0;
+	// Aggregates of a process over the whole run, once per sampled process after the last tick
+	virtual void addSummary(uint32_t index, const UniqueProcess& process, const SummaryData& data) = 0;
+	// Aggregates of all processes, after the summaries of the processes and before closing
+	virtual void addTreeSummary(const SummaryData& data) = 0;
+	virtual bool close() = 0;
+};
+
+std::unique_ptr<TraceWriter> createTraceWriter(TraceFormat format);
+std::unique_ptr<TraceWriter> createJsonTraceWriter(JsonLayout layout);
+std::unique_ptr<TraceWriter> createBinaryTraceWriter();
+// Streams the binary format to a connected viewer, every tick is written when it ends
+std::unique_ptr<TraceWriter> createLiveTraceWriter(FILE* stream);
+// Writes the same ticks to both writers
+std::unique_ptr<TraceWriter> createTeeTraceWriter(std::unique_ptr<TraceWriter> first, std::unique_ptr<TraceWriter> second);
+
+// Parse the value of ONLOOKER_TRACE_FORMAT: json, json-ticks or binary
+bool parseTraceFormat(const char* str, TraceFormat& format);
+const char* traceExtension(TraceFormat format);
+
+// Write the given number of synthetic samples with every trace writer and with the dumpJson path
+// of Onlooker before the trace was streamed, and print the throughput of each (Onlooker :benchmark)
+int benchmarkTraceWriters(uint64_t samples);
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <ctime>
+
+#include <chrono>
+#include <string>
+#include <iterator>
+#include <algorithm>
+
+static inline void humanReadableSize(size_t sizeInBytes, char* buf, size_t cb)
+{
+	static const char* sizeUnits[] = { "B", "KB", "MB", "GB", "TB", "PB" };
+
+	size_t sizeType = 0;
+	double actualSize = (double)sizeInBytes;
+
+	while (actualSize > 1024)
+	{
+		actualSize /= 1024;
+		sizeType++;
+	}
+
+	if (sizeType < std::size(sizeUnits))
+		snprintf(buf, cb, "%.03f %s", actualSize, sizeUnits[sizeType]);
+}
+
+static inline std::string humanReadableSize(size_t sizeInBytes)
+{
+	char temp[128] = "";
+	humanReadableSize(sizeInBytes, temp, std::size(temp));
+	return temp;
+}
+
+// <number>[K|M|G], in bytes
+static inline bool parseSize(const std::string& str, uint64_t& bytes)
+{
+	double value = 0;
+	char unit[2] = "";
+	auto count = sscanf(str.c_str(), "%lf%1[KkMmGg]", &value, unit);
+	if (count < 1 || !(value > 0))
+		return false;
+	uint64_t multiplier = 1;
+	switch (unit[0])
+	{
+	case 'K': case 'k': multiplier = 1024ull; break;
+	case 'M': case 'm': multiplier = 1024ull * 1024; break;
+	case 'G': case 'g': multiplier = 1024ull * 1024 * 1024; break;
+	}
+	bytes = uint64_t(value * multiplier);
+	return true;
+}
+
+template <typename Cont, typename Pred>
+Cont filter(const Cont& container, Pred predicate)
+{
+	Cont result;
+	std::copy_if(container.begin(), container.end(), std::back_inserter(result), predicate);
+	return result;
+}
+
+// Monotonic clock for measuring durations
+static inline uint64_t monotonicMicroseconds()
+{
+	using namespace std::chrono;
+	return uint64_t(duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count());
+}
+
+// Local wall clock time of a tick
+struct TickTime
+{
+	uint64_t time = 0; // milliseconds since epoch (UTC)
+	int year = 0;
+	int month = 0;
+	int day = 0;
+	int hour = 0;
+	int minute = 0;
+	int second = 0;
+	int milliseconds = 0;
+};
+
+static inline TickTime toTickTime(uint64_t now)
+{
+	time_t seconds = time_t(now / 1000);
+	tm lt = { };
+#ifdef _WIN32
+	localtime_s(&lt, &seconds);
+#else
+	localtime_r(&seconds, &lt);
+#endif // _WIN32
+	TickTime t;
+	t.time = uint64_t(now);
+	t.year = lt.tm_year + 1900;
+	t.month = lt.tm_mon + 1;
+	t.day = lt.tm_mday;
+	t.hour = lt.tm_hour;
+	t.minute = lt.tm_min;
+	t.second = lt.tm_sec;
+	t.milliseconds = int(now % 1000);
+	return t;
+}
+
+static inline TickTime currentTime()
+{
+	using namespace std::chrono;
+	return toTickTime(uint64_t(duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count()));
+}
@@ -0,0 +1,324 @@
+#ifdef _WIN32
+
+#define NOMINMAX
+#include "native.h"
+#include <Psapi.h>
+#include <io.h>
+#include <fcntl.h>
+
+#include "ProcessSource.h"
+#include "Compression.h"
+#include "ProcessSnapshot.h"
+#include "Utils.h"
+
+#include <algorithm>
+
+static uint64_t fileTimeToUInt64(const FILETIME& ft)
+{
+	ULARGE_INTEGER li;
+	li.LowPart = ft.dwLowDateTime;
+	li.HighPart = ft.dwHighDateTime;
+	return li.QuadPart;
+}
+
+// The portable parser in ProcessSnapshot.cpp hardcodes these offsets
+#ifdef _WIN64
+static_assert(offsetof(SYSTEM_PROCESS_INFORMATION, ImageName.Buffer) == 0x40, "SYSTEM_PROCESS_INFORMATION layout");
+static_assert(offsetof(SYSTEM_PROCESS_INFORMATION, UniqueProcessId) == 0x50, "SYSTEM_PROCESS_INFORMATION layout");
+static_assert(offsetof(SYSTEM_PROCESS_INFORMATION, PageFaultCount) == 0x80, "SYSTEM_PROCESS_INFORMATION layout");
+static_assert(offsetof(SYSTEM_PROCESS_INFORMATION, PeakWorkingSetSize) == 0x88, "SYSTEM_PROCESS_INFORMATION layout");
+static_assert(offsetof(SYSTEM_PROCESS_INFORMATION, ReadOperationCount) == 0xD0, "SYSTEM_PROCESS_INFORMATION layout");
+static_assert(offsetof(SYSTEM_PROCESS_INFORMATION, Threads) == 0x100, "SYSTEM_PROCESS_INFORMATION layout");
+static_assert(offsetof(SYSTEM_THREAD_INFORMATION, ClientId.UniqueThread) == 0x30, "SYSTEM_THREAD_INFORMATION layout");
+static_assert(offsetof(SYSTEM_THREAD_INFORMATION, ContextSwitches) == 0x40, "SYSTEM_THREAD_INFORMATION layout");
+static_assert(sizeof(SYSTEM_THREAD_INFORMATION) == 0x50, "SYSTEM_THREAD_INFORMATION layout");
+#else
+static_assert(offsetof(SYSTEM_PROCESS_INFORMATION, ImageName.Buffer) == 0x3C, "SYSTEM_PROCESS_INFORMATION layout");
+static_assert(offsetof(SYSTEM_PROCESS_INFORMATION, UniqueProcessId) == 0x44, "SYSTEM_PROCESS_INFORMATION layout");
+static_assert(offsetof(SYSTEM_PROCESS_INFORMATION, PageFaultCount) == 0x60, "SYSTEM_PROCESS_INFORMATION layout");
+static_assert(offsetof(SYSTEM_PROCESS_INFORMATION, PeakWorkingSetSize) == 0x64, "SYSTEM_PROCESS_INFORMATION layout");
+static_assert(offsetof(SYSTEM_PROCESS_INFORMATION, ReadOperationCount) == 0x88, "SYSTEM_PROCESS_INFORMATION layout");
+static_assert(offsetof(SYSTEM_PROCESS_INFORMATION, Threads) == 0xB8, "SYSTEM_PROCESS_INFORMATION layout");
+static_assert(offsetof(SYSTEM_THREAD_INFORMATION, ClientId.UniqueThread) == 0x24, "SYSTEM_THREAD_INFORMATION layout");
+static_assert(offsetof(SYSTEM_THREAD_INFORMATION, ContextSwitches) == 0x30, "SYSTEM_THREAD_INFORMATION layout");
+static_assert(sizeof(SYSTEM_THREAD_INFORMATION) == 0x40, "SYSTEM_THREAD_INFORMATION layout");
+#endif // _WIN64
+
+class WindowsProcessSource : public ProcessSource
+{
+	// Reused between snapshots, grows geometrically
+	std::vector<uint8_t> m_buffer = std::vector<uint8_t>(1024 * 1024);
+	std::vector<SnapshotProcess> m_processes;
+	uint64_t m_snapshotTime = 0;
+	FILE* m_captureFile = nullptr; // ONLOOKER_CAPTURE_SNAPSHOTS
+
+public:
+	WindowsProcessSource()
+	{
+		auto szCaptureFile = getenv("ONLOOKER_CAPTURE_SNAPSHOTS");
+		if (szCaptureFile && *szCaptureFile)
+		{
+			m_captureFile = openOutputFile(szCaptureFile);
+			if (!m_captureFile || !writeSnapshotCaptureHeader(m_captureFile, sizeof(void*), numberOfProcessors()))
+				fprintf(stderr, "[Onlooker] Failed to open snapshot capture file '%s'.\n", szCaptureFile);
+		}
+	}
+
+	~WindowsProcessSource() override
+	{
+		if (m_captureFile)
+			fclose(m_captureFile);
+	}
+
+	bool snapshot(std::vector<ProcessInfo>& processes) override
+	{
+		processes.clear();
+		ULONG Length = 0;
+		NTSTATUS status;
+		while ((status = NtQuerySystemInformation(SystemProcessInformation, m_buffer.data(), ULONG(m_buffer.size()), &Length)) == STATUS_INFO_LENGTH_MISMATCH)
+			m_buffer.resize(std::max(m_buffer.size() * 2, size_t(Length) + Length / 2));
+		if (status != STATUS_SUCCESS)
+			return false;
+
+		FILETIME now;
+		GetSystemTimeAsFileTime(&now);
+		m_snapshotTime = fileTimeToUInt64(now);
+		if (m_captureFile)
+			writeSnapshotCapture(m_captureFile, m_snapshotTime, uint64_t(ULONG_PTR(m_buffer.data())), m_buffer.data(), Length);
+
+		parseProcessSnapshot(m_buffer.data(), std::min(size_t(Length), m_buffer.size()), sizeof(void*), uint64_t(ULONG_PTR(m_buffer.data())), m_processes);
+		for (const SnapshotProcess& process : m_processes)
+		{
+			ProcessInfo info;
+			info.pid = process.pid;
+			info.ppid = process.ppid;
+			info.createTime = process.createTime;
+			info.entry = &process;
+			processes.push_back(info);
+		}
+		return true;
+	}
+
+	std::string processName(const ProcessInfo& process) override
+	{
+		return snapshotImageName(*(const SnapshotProcess*)process.entry);
+	}
+
+	bool hasSnapshotCounters() const override
+	{
+		return true;
+	}
+
+	bool snapshotCounters(const ProcessInfo& process, MemoryCounters& memory, CpuTimes& cpu, IoCounters& io) override
+	{
+		auto snapshotProcess = (const SnapshotProcess*)process.entry;
+		memory = snapshotProcess->memory;
+		io = snapshotProcess->io;
+		snapshotCpuTimes(*snapshotProcess, m_snapshotTime, cpu);
+		return true;
+	}
+
+	// The snapshot already contains the threads, even when the processes are queried
+	bool queryThreads(const ProcessInfo& process, uint64_t& now, std::vector<ThreadCounters>& threads) override
+	{
+		now = m_snapshotTime;
+		snapshotThreads(*(const SnapshotProcess*)process.entry, sizeof(void*), threads);
+		return true;
+	}
+
+	bool queryProcess(const ProcessInfo& process, MemoryCounters& memory, CpuTimes& cpu, IoCounters& io) override
+	{
+		HANDLE hProcess = OpenProcess(PROCESS_QUERY_INFORMATION | PROCESS_VM_READ, FALSE, process.pid);
+		if (!hProcess)
+			return false;
+		bool success = queryMemoryCounters(hProcess, memory);
+		// All processes of the tick share the time of the snapshot
+		snapshotCpuTimes(*(const SnapshotProcess*)process.entry, m_snapshotTime, cpu);
+		IO_COUNTERS ioCounters = { 0 };
+		if (success && GetProcessIoCounters(hProcess, &ioCounters))
+		{
+			io.readOperationCount = ioCounters.ReadOperationCount;
+			io.writeOperationCount = ioCounters.WriteOperationCount;
+			io.otherOperationCount = ioCounters.OtherOperationCount;
+			io.readTransferCount = ioCounters.ReadTransferCount;
+			io.writeTransferCount = ioCounters.WriteTransferCount;
+			io.otherTransferCount = ioCounters.OtherTransferCount;
+		}
+		CloseHandle(hProcess);
+		return success;
+	}
+
+	// Walks the regions of the address space, the committed bytes of an allocation are classified
+	// once all of its regions were seen
+	bool queryMemoryComposition(uint32_t pid, uint64_t createTime, MemoryComposition& composition) override
+	{
+		HANDLE hProcess = OpenProcess(PROCESS_QUERY_INFORMATION | PROCESS_VM_READ, FALSE, pid);
+		if (!hProcess)
+			return false;
+		FILETIME fcreate, fexit, fsys, fuser;
+		if (!GetProcessTimes(hProcess, &fcreate, &fexit, &fsys, &fuser) || fileTimeToUInt64(fcreate) != createTime)
+		{
+			CloseHandle(hProcess);
+			return false;
+		}
+
+		composition = MemoryComposition();
+		PVOID allocationBase = nullptr;
+		DWORD allocationType = 0;
+		uint64_t allocationCommitted = 0;
+		bool allocationGuarded = false;
+		auto addAllocation = [&]()
+		{
+			if (!allocationCommitted)
+				return;
+			MemoryCategory category = MemoryPrivate;
+			if (allocationType == MEM_IMAGE)
+				category = MemoryImage;
+			else if (allocationType == MEM_MAPPED)
+			{
+				// Sections without a file are backed by the pagefile
+				wchar_t szFileName[MAX_PATH];
+				category = GetMappedFileNameW(hProcess, allocationBase, szFileName, _countof(szFileName)) ? MemoryMapped : MemoryShareable;
+			}
+			else if (allocationGuarded)
+				category = MemoryStack; // thread stacks grow into a guard page, heaps are private
+			composition.bytes[category] += allocationCommitted;
+		};
+
+		MEMORY_BASIC_INFORMATION mbi;
+		const uint8_t* address = nullptr;
+		while (VirtualQueryEx(hProcess, address, &mbi, sizeof(mbi)) == sizeof(mbi))
+		{
+			if (mbi.AllocationBase != allocationBase)
+			{
+				addAllocation();
+				allocationBase = mbi.AllocationBase;
+				allocationType = mbi.Type;
+				allocationCommitted = 0;
+				allocationGuarded = false;
+			}
+			if (mbi.State == MEM_COMMIT)
+			{
+				allocationCommitted += mbi.RegionSize;
+				if (mbi.Protect & PAGE_GUARD)
+					allocationGuarded = true;
+			}
+			address = (const uint8_t*)mbi.BaseAddress + mbi.RegionSize;
+		}
+		addAllocation();
+		CloseHandle(hProcess);
+		return true;
+	}
+
+	uint64_t snapshotTime() const override
+	{
+		return m_snapshotTime;
+	}
+
+	bool querySelf(MemoryCounters& memory, CpuTimes& cpu) override
+	{
+		if (!queryMemoryCounters(GetCurrentProcess(), memory))
+			return false;
+		FILETIME ftime, fcreate, fexit, fsys, fuser;
+		GetSystemTimeAsFileTime(&ftime);
+		GetProcessTimes(GetCurrentProcess(), &fcreate, &fexit, &fsys, &fuser);
+		cpu.now = fileTimeToUInt64(ftime);
+		cpu.kernelTime = fileTimeToUInt64(fsys);
+		cpu.userTime = fileTimeToUInt64(fuser);
+		cpu.startTime = fileTimeToUInt64(fcreate);
+		return true;
+	}
+
+	static bool queryMemoryCounters(HANDLE hProcess, MemoryCounters& memory)
+	{
+		PROCESS_MEMORY_COUNTERS_EX memoryCounters = { 0 };
+		bool success = !!GetProcessMemoryInfo(hProcess, (PPROCESS_MEMORY_COUNTERS)&memoryCounters, sizeof(PROCESS_MEMORY_COUNTERS_EX));
+		if (success)
+		{
+			memory.pageFaultCount = memoryCounters.PageFaultCount;
+			memory.peakWorkingSetSize = memoryCounters.PeakWorkingSetSize;
+			memory.workingSetSize = memoryCounters.WorkingSetSize;
+			memory.quotaPeakPagedPoolUsage = memoryCounters.QuotaPeakPagedPoolUsage;
+			memory.quotaPagedPoolUsage = memoryCounters.QuotaPagedPoolUsage;
+			memory.quotaPeakNonPagedPoolUsage = memoryCounters.QuotaPeakNonPagedPoolUsage;
+			memory.quotaNonPagedPoolUsage = memoryCounters.QuotaNonPagedPoolUsage;
+			memory.pagefileUsage = memoryCounters.PagefileUsage;
+			memory.peakPagefileUsage = memoryCounters.PeakPagefileUsage;
+			memory.privateUsage = memoryCounters.PrivateUsage;
+		}
+		return success;
+	}
+
+	uint32_t currentProcessId() const override
+	{
+		return GetCurrentProcessId();
+	}
+
+	unsigned numberOfProcessors() const override
+	{
+		SYSTEM_INFO sysInfo;
+		GetSystemInfo(&sysInfo);
+		return sysInfo.dwNumberOfProcessors;
+	}
+
+	void logSystemInformation(FILE* logFile) override
+	{
+		char szComputerName[MAX_PATH] = "";
+		DWORD size = _countof(szComputerName);
+		GetComputerNameA(szComputerName, &size);
+		fprintf(logFile, "Computer name: %s\n", szComputerName);
+		MEMORYSTATUSEX statex;
+		statex.dwLength = sizeof(statex);
+		GlobalMemoryStatusEx(&statex);
+		fprintf(logFile, "There is %u percent of memory in use.\n", statex.dwMemoryLoad);
+		fprintf(logFile, "There are %s total of physical memory.\n", humanReadableSize(statex.ullTotalPhys).c_str());
+		fprintf(logFile, "There are %s free of physical memory.\n", humanReadableSize(statex.ullAvailPhys).c_str());
+		fprintf(logFile, "There are %s total of paging file.\n", humanReadableSize(statex.ullTotalPageFile).c_str());
+		fprintf(logFile, "There are %s free of paging file.\n", humanReadableSize(statex.ullAvailPageFile).c_str());
+		fprintf(logFile, "There are %s total of virtual memory.\n", humanReadableSize(statex.ullTotalVirtual).c_str());
+		fprintf(logFile, "There are %s free of virtual memory.\n", humanReadableSize(statex.ullAvailVirtual).c_str());
+	}
+};
+
+std::unique_ptr<ProcessSource> createProcessSource()
+{
+	return std::make_unique<WindowsProcessSource>();
+}
+
+FILE* connectLiveStream(const std::string& name)
+{
+	// QLocalServer listens on a pipe of the same name
+	auto pipeName = "\\\\.\\pipe\\" + name;
+	HANDLE hPipe = CreateFileA(pipeName.c_str(), GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0, nullptr);
+	if (hPipe == INVALID_HANDLE_VALUE)
+		return nullptr;
+	int fd = _open_osfhandle(intptr_t(hPipe), _O_WRONLY | _O_BINARY);
+	if (fd < 0)
+	{
+		CloseHandle(hPipe);
+		return nullptr;
+	}
+	FILE* fp = _fdopen(fd, "wb");
+	if (!fp)
+		_close(fd);
+	return fp;
+}
+
+static HANDLE hDumpEvent;
+
+std::string listenForDumpRequests()
+{
+	// Auto-reset, every SetEvent is one dump
+	auto name = "Onlooker_Dump_" + std::to_string(GetCurrentProcessId());
+	hDumpEvent = CreateEventA(nullptr, FALSE, FALSE, name.c_str());
+	if (!hDumpEvent)
+		return std::string();
+	return "SetEvent on " + name;
+}
+
+bool takeDumpRequest()
+{
+	return hDumpEvent && WaitForSingleObject(hDumpEvent, 0) == WAIT_OBJECT_0;
+}
+
+#endif // _WIN32
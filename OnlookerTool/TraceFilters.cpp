@@ -0,0 +1,429 @@
+#include "TraceFilters.h"
+#include "FlatHashMap.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+
+bool TraceSelection::parseTime(const char* str, double& time, bool& relative)
+{
+	relative = *str == '+';
+	if (relative)
+		str++;
+	int length = 0;
+	return sscanf(str, "%lf%n", &time, &length) == 1 && str[length] == '\0' && time >= 0;
+}
+
+bool parseAggregate(const char* str, Aggregate& aggregate)
+{
+	if (strcmp(str, "min") == 0)
+		aggregate = Aggregate::Min;
+	else if (strcmp(str, "max") == 0)
+		aggregate = Aggregate::Max;
+	else if (strcmp(str, "avg") == 0)
+		aggregate = Aggregate::Avg;
+	else
+		return false;
+	return true;
+}
+
+class SelectionFilter : public TraceWriter
+{
+	enum State : uint8_t
+	{
+		Unknown,
+		Selected,
+		Dropped,
+	};
+
+	TraceSelection m_selection;
+	std::unique_ptr<TraceWriter> m_next;
+	std::vector<State> m_states; // process index -> State
+	FlatHashMap<uint32_t, uint32_t> m_pids; // pid -> index of the last process with it
+	bool m_started = false;
+	uint64_t m_from = 0;
+	uint64_t m_to = std::numeric_limits<uint64_t>::max();
+
+	bool inWindow(uint64_t time)
+	{
+		// Relative times start at the first record of the trace
+		if (!m_started)
+		{
+			m_started = true;
+			if (m_selection.hasFrom)
+				m_from = uint64_t(m_selection.fromRelative ? time + m_selection.from * 1000 : m_selection.from);
+			if (m_selection.hasTo)
+				m_to = uint64_t(m_selection.toRelative ? time + m_selection.to * 1000 : m_selection.to);
+		}
+		return time >= m_from && time <= m_to;
+	}
+
+	bool matches(const UniqueProcess& process) const
+	{
+		auto pid = std::to_string(process.pid);
+		for (const auto& selected : m_selection.processes)
+		{
+			if (selected == *process.name || selected == pid)
+				return true;
+		}
+		return false;
+	}
+
+	bool selected(uint32_t index, const UniqueProcess& process)
+	{
+		if (index >= m_states.size())
+			m_states.resize(index + 1, Unknown);
+		if (m_states[index] == Unknown)
+		{
+			auto selected = m_selection.processes.empty() || matches(process);
+			if (!selected && m_selection.descendants)
+			{
+				auto parent = m_pids.find(process.ppid);
+				selected = parent && m_states[*parent] == Selected;
+			}
+			m_states[index] = selected ? Selected : Dropped;
+			m_pids[process.pid] = index;
+		}
+		return m_states[index] == Selected;
+	}
+
+public:
+	SelectionFilter(const TraceSelection& selection, std::unique_ptr<TraceWriter> next) :
+		m_selection(selection),
+		m_next(std::move(next))
+	{
+	}
+
+	bool open(const std::string& basename) override
+	{
+		return m_next->open(basename);
+	}
+
+	void addSample(uint32_t index, const UniqueProcess& process, const ProcessData& data) override
+	{
+		if (selected(index, process) && inWindow(data.time))
+			m_next->addSample(index, process, data);
+	}
+
+	void addThreadSample(uint32_t index, const UniqueProcess& process, const ThreadData& data) override
+	{
+		if (selected(index, process) && inWindow(data.time))
+			m_next->addThreadSample(index, process, data);
+	}
+
+	void addComposition(uint32_t index, const UniqueProcess& process, const CompositionData& data) override
+	{
+		if (selected(index, process) && inWindow(data.time))
+			m_next->addComposition(index, process, data);
+	}
+
+	void addRollup(uint32_t index, const UniqueProcess& process, const RollupData& data) override
+	{
+		if (selected(index, process) && inWindow(data.time))
+			m_next->addRollup(index, process, data);
+	}
+
+	void addOverhead(const OverheadData& overhead) override
+	{
+		if (inWindow(overhead.time))
+			m_next->addOverhead(overhead);
+	}
+
+	void endTick() override
+	{
+		m_next->endTick();
+	}
+
+	// The summaries cover the whole run, they only still hold when nothing of it was cut off
+	void addSummary(uint32_t index, const UniqueProcess& process, const SummaryData& data) override
+	{
+		if (selected(index, process) && !m_selection.hasFrom && !m_selection.hasTo)
+			m_next->addSummary(index, process, data);
+	}
+
+	void addTreeSummary(const SummaryData& data) override
+	{
+		if (m_selection.processes.empty() && !m_selection.hasFrom && !m_selection.hasTo)
+			m_next->addTreeSummary(data);
+	}
+
+	bool close() override
+	{
+		return m_next->close();
+	}
+};
+
+class Downsampler : public TraceWriter
+{
+	struct Bucket
+	{
+		UniqueProcess process;
+		uint64_t start = 0;
+		uint32_t count = 0;
+		ProcessData min;
+		ProcessData max;
+		ProcessData sum;
+		ProcessData last;
+	};
+
+	uint64_t m_length = 0;
+	Aggregate m_aggregate = Aggregate::Avg;
+	std::unique_ptr<TraceWriter> m_next;
+	std::vector<Bucket> m_buckets; // process index -> bucket being filled
+	uint64_t m_latestStart = 0; // of any bucket
+
+	// Calls function(column of to, column of from) for every column that is not a peak or a
+	// cumulative counter
+	template <typename Function>
+	static void gauges(ProcessData& to, const ProcessData& from, Function function)
+	{
+		function(to.cpuUsage, from.cpuUsage);
+		function(to.memory.workingSetSize, from.memory.workingSetSize);
+		function(to.memory.quotaPagedPoolUsage, from.memory.quotaPagedPoolUsage);
+		function(to.memory.quotaNonPagedPoolUsage, from.memory.quotaNonPagedPoolUsage);
+		function(to.memory.pagefileUsage, from.memory.pagefileUsage);
+		function(to.memory.privateUsage, from.memory.privateUsage);
+		function(to.io.readBytes, from.io.readBytes);
+		function(to.io.writeBytes, from.io.writeBytes);
+		function(to.io.readOperations, from.io.readOperations);
+		function(to.io.writeOperations, from.io.writeOperations);
+	}
+
+	template <typename Function>
+	static void peaks(ProcessData& to, const ProcessData& from, Function function)
+	{
+		function(to.memory.peakWorkingSetSize, from.memory.peakWorkingSetSize);
+		function(to.memory.quotaPeakPagedPoolUsage, from.memory.quotaPeakPagedPoolUsage);
+		function(to.memory.quotaPeakNonPagedPoolUsage, from.memory.quotaPeakNonPagedPoolUsage);
+		function(to.memory.peakPagefileUsage, from.memory.peakPagefileUsage);
+	}
+
+	void emit(uint32_t index, Bucket& bucket)
+	{
+		// Cumulative counters keep their last value
+		ProcessData data = bucket.last;
+		data.time = bucket.start;
+		auto count = bucket.count;
+		switch (m_aggregate)
+		{
+		case Aggregate::Min:
+			gauges(data, bucket.min, [](auto& to, auto from) { to = from; });
+			break;
+		case Aggregate::Max:
+			gauges(data, bucket.max, [](auto& to, auto from) { to = from; });
+			break;
+		case Aggregate::Avg:
+			gauges(data, bucket.sum, [count](auto& to, auto from)
+			{
+				using T = std::decay_t<decltype(to)>;
+				if (std::is_floating_point<T>::value)
+					to = T(double(from) / count);
+				else
+					to = T(std::llround(double(from) / count));
+			});
+			break;
+		}
+		peaks(data, bucket.max, [](auto& to, auto from) { to = from; });
+		m_next->addSample(index, bucket.process, data);
+		bucket.count = 0;
+	}
+
+	// The last bucket of every process, at the end of the trace
+	void emitAll()
+	{
+		auto emitted = false;
+		for (uint32_t index = 0; index < m_buckets.size(); index++)
+		{
+			if (m_buckets[index].count)
+			{
+				emit(index, m_buckets[index]);
+				emitted = true;
+			}
+		}
+		if (emitted)
+			m_next->endTick();
+	}
+
+public:
+	Downsampler(uint64_t length, Aggregate aggregate, std::unique_ptr<TraceWriter> next) :
+		m_length(length),
+		m_aggregate(aggregate),
+		m_next(std::move(next))
+	{
+	}
+
+	bool open(const std::string& basename) override
+	{
+		return m_next->open(basename);
+	}
+
+	void addSample(uint32_t index, const UniqueProcess& process, const ProcessData& data) override
+	{
+		if (index >= m_buckets.size())
+			m_buckets.resize(index + 1);
+		Bucket& bucket = m_buckets[index];
+		// Buckets are aligned to multiples of their length, so those of all processes line up
+		auto start = data.time / m_length * m_length;
+		if (start > m_latestStart)
+		{
+			// In a trace in the order of time the earlier buckets are complete, also those of
+			// processes that exited, so the output stays in the order of time
+			for (uint32_t other = 0; other < m_buckets.size(); other++)
+			{
+				if (m_buckets[other].count && m_buckets[other].start < start)
+					emit(other, m_buckets[other]);
+			}
+			m_latestStart = start;
+		}
+		if (bucket.count && bucket.start != start)
+			emit(index, bucket);
+		if (!bucket.count)
+		{
+			bucket.process = process;
+			bucket.start = start;
+			bucket.min = data;
+			bucket.max = data;
+			bucket.sum = data;
+		}
+		else
+		{
+			gauges(bucket.min, data, [](auto& to, auto from) { to = std::min(to, from); });
+			gauges(bucket.max, data, [](auto& to, auto from) { to = std::max(to, from); });
+			gauges(bucket.sum, data, [](auto& to, auto from) { to += from; });
+			peaks(bucket.max, data, [](auto& to, auto from) { to = std::max(to, from); });
+		}
+		bucket.last = data;
+		bucket.count++;
+	}
+
+	void addThreadSample(uint32_t index, const UniqueProcess& process, const ThreadData& data) override
+	{
+		(void)index;
+		(void)process;
+		(void)data;
+	}
+
+	void addComposition(uint32_t index, const UniqueProcess& process, const CompositionData& data) override
+	{
+		m_next->addComposition(index, process, data);
+	}
+
+	void addRollup(uint32_t index, const UniqueProcess& process, const RollupData& data) override
+	{
+		(void)index;
+		(void)process;
+		(void)data;
+	}
+
+	void addOverhead(const OverheadData& overhead) override
+	{
+		(void)overhead;
+	}
+
+	void endTick() override
+	{
+		m_next->endTick();
+	}
+
+	// Computed from the original samples, so they stay exact. They follow the last tick.
+	void addSummary(uint32_t index, const UniqueProcess& process, const SummaryData& data) override
+	{
+		emitAll();
+		m_next->addSummary(index, process, data);
+	}
+
+	void addTreeSummary(const SummaryData& data) override
+	{
+		emitAll();
+		m_next->addTreeSummary(data);
+	}
+
+	bool close() override
+	{
+		emitAll();
+		return m_next->close();
+	}
+};
+
+class NullTraceWriter : public TraceWriter
+{
+public:
+	bool open(const std::string& basename) override
+	{
+		(void)basename;
+		return true;
+	}
+
+	void addSample(uint32_t index, const UniqueProcess& process, const ProcessData& data) override
+	{
+		(void)index;
+		(void)process;
+		(void)data;
+	}
+
+	void addThreadSample(uint32_t index, const UniqueProcess& process, const ThreadData& data) override
+	{
+		(void)index;
+		(void)process;
+		(void)data;
+	}
+
+	void addComposition(uint32_t index, const UniqueProcess& process, const CompositionData& data) override
+	{
+		(void)index;
+		(void)process;
+		(void)data;
+	}
+
+	void addRollup(uint32_t index, const UniqueProcess& process, const RollupData& data) override
+	{
+		(void)index;
+		(void)process;
+		(void)data;
+	}
+
+	void addOverhead(const OverheadData& overhead) override
+	{
+		(void)overhead;
+	}
+
+	void endTick() override
+	{
+	}
+
+	void addSummary(uint32_t index, const UniqueProcess& process, const SummaryData& data) override
+	{
+		(void)index;
+		(void)process;
+		(void)data;
+	}
+
+	void addTreeSummary(const SummaryData& data) override
+	{
+		(void)data;
+	}
+
+	bool close() override
+	{
+		return true;
+	}
+};
+
+std::unique_ptr<TraceWriter> createSelectionFilter(const TraceSelection& selection, std::unique_ptr<TraceWriter> next)
+{
+	return std::make_unique<SelectionFilter>(selection, std::move(next));
+}
+
+std::unique_ptr<TraceWriter> createDownsampler(uint64_t bucket, Aggregate aggregate, std::unique_ptr<TraceWriter> next)
+{
+	return std::make_unique<Downsampler>(bucket, aggregate, std::move(next));
+}
+
+std::unique_ptr<TraceWriter> createNullTraceWriter()
+{
+	return std::make_unique<NullTraceWriter>();
+}
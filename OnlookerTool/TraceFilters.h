@@ -0,0 +1,47 @@
+#pragma once
+
+#include "TraceWriter.h"
+
+#include <string>
+#include <vector>
+
+// Which part of a trace to keep. Processes are selected when they are first seen, so a
+// process started by a selected one is only kept with descendants when its parent was seen
+// before it, which is the order Onlooker writes them in.
+struct TraceSelection
+{
+	// Milliseconds since epoch, or seconds after the first sample of the trace when relative
+	double from = 0.0;
+	double to = 0.0;
+	bool fromRelative = false;
+	bool toRelative = false;
+	bool hasFrom = false;
+	bool hasTo = false;
+	std::vector<std::string> processes; // names or pids, all processes when empty
+	bool descendants = false; // also keep the processes started by the selected ones
+
+	// <milliseconds since epoch> or +<seconds after the start of the trace>
+	static bool parseTime(const char* str, double& time, bool& relative);
+};
+
+// Every column of a bucket of samples is reduced to a single value. Peaks are always
+// reduced to their maximum and cumulative counters to their last value.
+enum class Aggregate
+{
+	Min,
+	Max,
+	Avg,
+};
+
+bool parseAggregate(const char* str, Aggregate& aggregate);
+
+// Passes on the records of the selected processes within the time window
+std::unique_ptr<TraceWriter> createSelectionFilter(const TraceSelection& selection, std::unique_ptr<TraceWriter> next);
+
+// Reduces the samples of every process to one per bucket of the given length (ms), at the
+// start of the bucket. Compositions are passed on, thread samples, rollups and overhead are
+// per tick and dropped.
+std::unique_ptr<TraceWriter> createDownsampler(uint64_t bucket, Aggregate aggregate, std::unique_ptr<TraceWriter> next);
+
+// Discards everything, for runs that only print statistics
+std::unique_ptr<TraceWriter> createNullTraceWriter();
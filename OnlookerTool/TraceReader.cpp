@@ -0,0 +1,1106 @@
+#include "TraceReader.h"
+#include "BinaryTrace.h"
+#include "StringTable.h"
+#include "FlatHashMap.h"
+
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+
+#include <utility>
+#include <vector>
+
+#ifdef ONLOOKER_ZLIB
+#include <zlib.h>
+#endif // ONLOOKER_ZLIB
+
+// Buffered input file, gzip compressed files are inflated on the fly when built with zlib
+class TraceInput
+{
+#ifdef ONLOOKER_ZLIB
+	gzFile m_file = nullptr;
+#else
+	FILE* m_file = nullptr;
+#endif // ONLOOKER_ZLIB
+	std::vector<uint8_t> m_buffer = std::vector<uint8_t>(1024 * 1024);
+	size_t m_position = 0;
+	size_t m_size = 0;
+	uint64_t m_offset = 0; // of the start of the buffer in the (inflated) file
+	bool m_end = false;
+	bool m_failed = false;
+
+	bool fill()
+	{
+		if (m_end)
+			return false;
+		m_offset += m_size;
+		m_position = 0;
+#ifdef ONLOOKER_ZLIB
+		auto count = gzread(m_file, m_buffer.data(), unsigned(m_buffer.size()));
+		// A truncated compressed file, the data before the error is still good
+		if (count < 0)
+		{
+			m_failed = true;
+			count = 0;
+		}
+		m_size = size_t(count);
+#else
+		m_size = fread(m_buffer.data(), 1, m_buffer.size(), m_file);
+		if (!m_size && ferror(m_file))
+			m_failed = true;
+#endif // ONLOOKER_ZLIB
+		m_end = m_size == 0;
+		return !m_end;
+	}
+
+public:
+	TraceInput() = default;
+	TraceInput(const TraceInput&) = delete;
+	TraceInput& operator=(const TraceInput&) = delete;
+
+	~TraceInput()
+	{
+#ifdef ONLOOKER_ZLIB
+		if (m_file)
+			gzclose(m_file);
+#else
+		if (m_file)
+			fclose(m_file);
+#endif // ONLOOKER_ZLIB
+	}
+
+	bool open(const std::string& file, std::string& error)
+	{
+#ifdef ONLOOKER_ZLIB
+		// Files without a gzip header are read as they are
+		m_file = gzopen(file.c_str(), "rb");
+		if (m_file)
+			gzbuffer(m_file, 256 * 1024);
+#else
+		m_file = fopen(file.c_str(), "rb");
+#endif // ONLOOKER_ZLIB
+		if (!m_file)
+		{
+			error = "Failed to open " + file;
+			return false;
+		}
+#ifndef ONLOOKER_ZLIB
+		if (peek() == 0x1F && m_size >= 2 && m_buffer[1] == 0x8B)
+		{
+			error = "Compressed traces need a build with zlib";
+			return false;
+		}
+#endif // ONLOOKER_ZLIB
+		return true;
+	}
+
+	// -1 at the end of the file
+	int peek()
+	{
+		if (m_position == m_size && !fill())
+			return -1;
+		return m_buffer[m_position];
+	}
+
+	int get()
+	{
+		if (m_position == m_size && !fill())
+			return -1;
+		return m_buffer[m_position++];
+	}
+
+	// Fewer bytes than requested at the end of the file
+	size_t read(uint8_t* data, size_t size)
+	{
+		size_t total = 0;
+		while (total < size && (m_position < m_size || fill()))
+		{
+			auto count = std::min(size - total, m_size - m_position);
+			memcpy(data + total, m_buffer.data() + m_position, count);
+			m_position += count;
+			total += count;
+		}
+		return total;
+	}
+
+	uint64_t offset() const { return m_offset + m_position; }
+	// The end came from a read error or a truncated compressed stream
+	bool failed() const { return m_failed; }
+};
+
+class VarintReader
+{
+	const uint8_t* m_ptr = nullptr;
+	const uint8_t* m_end = nullptr;
+
+public:
+	VarintReader(const uint8_t* begin, const uint8_t* end) : m_ptr(begin), m_end(end) { }
+
+	bool read(uint64_t& value)
+	{
+		value = 0;
+		for (int shift = 0; m_ptr < m_end && shift < 64; shift += 7)
+		{
+			auto byte = *m_ptr++;
+			value |= uint64_t(byte & 0x7F) << shift;
+			if (!(byte & 0x80))
+				return true;
+		}
+		return false;
+	}
+
+	size_t remaining() const { return m_end - m_ptr; }
+};
+
+class BinaryTraceReader
+{
+	// Larger records can only come from a corrupt size
+	static const uint64_t MaximumRecordSize = 64 * 1024 * 1024;
+
+	TraceInput& m_input;
+	TraceWriter& m_writer;
+	StringTable& m_stringTable;
+	std::vector<const std::string*> m_strings;
+	std::vector<UniqueProcess> m_processes;
+	std::vector<ThreadData> m_threads; // identity of every thread, the counters are set per row
+	std::vector<uint32_t> m_threadProcesses; // thread index -> process index
+	std::vector<uint8_t> m_record;
+	std::vector<uint64_t> m_times;
+	std::vector<uint64_t> m_values;
+
+	bool readVarint(uint64_t& value)
+	{
+		value = 0;
+		for (int shift = 0; shift < 64; shift += 7)
+		{
+			auto byte = m_input.get();
+			if (byte < 0)
+				return false;
+			value |= uint64_t(byte & 0x7F) << shift;
+			if (!(byte & 0x80))
+				return true;
+		}
+		return false;
+	}
+
+	// Times and XOR-ed column values shared by the Samples and Overhead records, stored column
+	// by column (values[column * count + i]). Columns after requiredColumns can be missing in
+	// older traces, they are read as 0.
+	bool readBlock(VarintReader& record, size_t columnCount, size_t requiredColumns)
+	{
+		uint64_t count = 0, time = 0;
+		if (!record.read(count) || !record.read(time) || count > record.remaining())
+			return false;
+		m_times.resize(count);
+		for (uint64_t i = 0; i < count; i++)
+		{
+			uint64_t delta = 0;
+			if (i > 0 && !record.read(delta))
+				return false;
+			time += delta;
+			m_times[i] = time;
+		}
+		m_values.assign(count * columnCount, 0);
+		for (size_t column = 0; column < columnCount; column++)
+		{
+			if (column >= requiredColumns && !record.remaining())
+				break;
+			uint64_t previous = 0;
+			for (uint64_t i = 0; i < count; i++)
+			{
+				uint64_t value = 0;
+				if (!record.read(value))
+					return false;
+				previous ^= value;
+				m_values[column * count + i] = previous;
+			}
+		}
+		return true;
+	}
+
+	bool readSamples(VarintReader& record)
+	{
+		// The I/O, CPU time and cycle time columns were added later
+		uint64_t index = 0;
+		if (!record.read(index) || index >= m_processes.size() || !readBlock(record, ColumnCount, ColumnReadBytes))
+			return false;
+		auto count = m_times.size();
+		auto value = [&](size_t column, size_t i) { return m_values[column * count + i]; };
+		for (size_t i = 0; i < count; i++)
+		{
+			ProcessData data;
+			MemoryCounters& memory = data.memory;
+			data.time = m_times[i];
+			data.cpuUsage = value(ColumnCpuUsage, i) / 100.0;
+			memory.pageFaultCount = uint32_t(value(ColumnPageFaultCount, i));
+			memory.peakWorkingSetSize = size_t(value(ColumnPeakWorkingSetSize, i));
+			memory.workingSetSize = size_t(value(ColumnWorkingSetSize, i));
+			memory.quotaPeakPagedPoolUsage = size_t(value(ColumnQuotaPeakPagedPoolUsage, i));
+			memory.quotaPagedPoolUsage = size_t(value(ColumnQuotaPagedPoolUsage, i));
+			memory.quotaPeakNonPagedPoolUsage = size_t(value(ColumnQuotaPeakNonPagedPoolUsage, i));
+			memory.quotaNonPagedPoolUsage = size_t(value(ColumnQuotaNonPagedPoolUsage, i));
+			memory.pagefileUsage = size_t(value(ColumnPagefileUsage, i));
+			memory.peakPagefileUsage = size_t(value(ColumnPeakPagefileUsage, i));
+			memory.privateUsage = size_t(value(ColumnPrivateUsage, i));
+			data.io.readBytes = value(ColumnReadBytes, i);
+			data.io.writeBytes = value(ColumnWriteBytes, i);
+			data.io.readOperations = value(ColumnReadOperations, i);
+			data.io.writeOperations = value(ColumnWriteOperations, i);
+			data.cpuTime = value(ColumnCpuTime, i);
+			data.cycleTime = value(ColumnCycleTime, i);
+			m_writer.addSample(uint32_t(index), m_processes[index], data);
+		}
+		return true;
+	}
+
+	bool readOverhead(VarintReader& record)
+	{
+		// The tick, interval and queue columns were added later
+		if (!readBlock(record, OverheadColumnCount, OverheadTick))
+			return false;
+		auto count = m_times.size();
+		auto value = [&](size_t column, size_t i) { return m_values[column * count + i]; };
+		for (size_t i = 0; i < count; i++)
+		{
+			OverheadData overhead;
+			overhead.time = m_times[i];
+			overhead.snapshotTime = value(OverheadSnapshotTime, i);
+			overhead.queryCount = uint32_t(value(OverheadQueryCount, i));
+			overhead.queryTime = value(OverheadQueryTime, i);
+			overhead.writeTime = value(OverheadWriteTime, i);
+			overhead.cpuUsage = value(OverheadCpuUsage, i) / 100.0;
+			overhead.workingSetSize = size_t(value(OverheadWorkingSetSize, i));
+			overhead.missedDeadlines = uint32_t(value(OverheadMissedDeadlines, i));
+			overhead.tick = value(OverheadTick, i);
+			overhead.interval = uint32_t(value(OverheadInterval, i));
+			overhead.queueTime = value(OverheadQueueTime, i);
+			overhead.queuedRecords = uint32_t(value(OverheadQueuedRecords, i));
+			overhead.droppedTicks = uint32_t(value(OverheadDroppedTicks, i));
+			m_writer.addOverhead(overhead);
+		}
+		return true;
+	}
+
+	bool readThreads(VarintReader& record)
+	{
+		uint64_t time = 0, count = 0;
+		if (!record.read(time) || !record.read(count))
+			return false;
+		for (uint64_t i = 0; i < count; i++)
+		{
+			uint64_t index = 0;
+			uint64_t columns[ThreadColumnCount] = { };
+			if (!record.read(index) || index >= m_threads.size())
+				return false;
+			for (auto& column : columns)
+			{
+				if (!record.read(column))
+					return false;
+			}
+			ThreadData data = m_threads[index];
+			data.time = time;
+			data.userUsage = columns[ThreadColumnUserUsage] / 100.0;
+			data.kernelUsage = columns[ThreadColumnKernelUsage] / 100.0;
+			data.contextSwitches = uint32_t(columns[ThreadColumnContextSwitches]);
+			data.state = ThreadState(columns[ThreadColumnState]);
+			data.waitReason = uint8_t(columns[ThreadColumnWaitReason]);
+			auto process = m_threadProcesses[index];
+			m_writer.addThreadSample(process, m_processes[process], data);
+		}
+		return true;
+	}
+
+	bool readRecord(uint64_t type, const uint8_t* data, size_t size)
+	{
+		VarintReader record(data, data + size);
+		switch (type)
+		{
+		case RecordString:
+			m_strings.push_back(m_stringTable.intern(std::string_view((const char*)data, size)));
+			return true;
+
+		case RecordProcess:
+		{
+			uint64_t pid = 0, ppid = 0, name = 0, createTime = 0;
+			if (!record.read(pid) || !record.read(ppid) || !record.read(name) || name >= m_strings.size())
+				return false;
+			// Creation time was added later, older traces do not have it
+			record.read(createTime);
+			UniqueProcess process;
+			process.id = uint64_t(m_processes.size()) << 32 | uint32_t(pid);
+			process.pid = uint32_t(pid);
+			process.ppid = uint32_t(ppid);
+			process.createTime = createTime;
+			process.name = m_strings[name];
+			m_processes.push_back(process);
+			return true;
+		}
+
+		case RecordSamples:
+			return readSamples(record);
+
+		case RecordOverhead:
+			return readOverhead(record);
+
+		case RecordThread:
+		{
+			uint64_t process = 0, tid = 0, name = 0;
+			ThreadData thread;
+			if (!record.read(process) || process >= m_processes.size() || !record.read(tid) || !record.read(name) || name >= m_strings.size() || !record.read(thread.createTime))
+				return false;
+			thread.index = uint32_t(m_threads.size());
+			thread.tid = uint32_t(tid);
+			thread.name = m_strings[name];
+			m_threads.push_back(thread);
+			m_threadProcesses.push_back(uint32_t(process));
+			return true;
+		}
+
+		case RecordThreads:
+			return readThreads(record);
+
+		case RecordComposition:
+		{
+			uint64_t index = 0;
+			CompositionData composition;
+			if (!record.read(index) || index >= m_processes.size() || !record.read(composition.time))
+				return false;
+			for (auto& bytes : composition.composition.bytes)
+			{
+				if (!record.read(bytes))
+					return false;
+			}
+			m_writer.addComposition(uint32_t(index), m_processes[index], composition);
+			return true;
+		}
+
+		case RecordRollup:
+		{
+			uint64_t index = 0;
+			uint64_t columns[RollupColumnCount] = { };
+			RollupData rollup;
+			if (!record.read(index) || index >= m_processes.size() || !record.read(rollup.time))
+				return false;
+			for (auto& column : columns)
+			{
+				if (!record.read(column))
+					return false;
+			}
+			rollup.workingSetSize = columns[RollupWorkingSetSize];
+			rollup.privateUsage = columns[RollupPrivateUsage];
+			rollup.cpuUsage = columns[RollupCpuUsage] / 100.0;
+			rollup.processCount = uint32_t(columns[RollupProcessCount]);
+			m_writer.addRollup(uint32_t(index), m_processes[index], rollup);
+			return true;
+		}
+
+		case RecordSummary:
+		{
+			uint64_t index = 0;
+			SummaryData summary;
+			if (!record.read(index) || index >= m_processes.size() || !readSummary(record, summary))
+				return false;
+			m_writer.addSummary(uint32_t(index), m_processes[index], summary);
+			return true;
+		}
+
+		case RecordTreeSummary:
+		{
+			SummaryData summary;
+			if (!readSummary(record, summary))
+				return false;
+			m_writer.addTreeSummary(summary);
+			return true;
+		}
+
+		default: // unknown record
+			return true;
+		}
+	}
+
+	static bool readSummary(VarintReader& record, SummaryData& summary)
+	{
+		uint64_t columns[SummaryColumnCount] = { };
+		for (auto& column : columns)
+		{
+			if (!record.read(column))
+				return false;
+		}
+		summary.startTime = columns[SummaryStartTime];
+		summary.endTime = columns[SummaryEndTime];
+		summary.peakWorkingSetSize = columns[SummaryPeakWorkingSetSize];
+		summary.peakPrivateUsage = columns[SummaryPeakPrivateUsage];
+		summary.peakTime = columns[SummaryPeakTime];
+		summary.workingSetIntegral = columns[SummaryWorkingSetIntegral] * 1000.0;
+		summary.cpuTime = columns[SummaryCpuTime];
+		summary.processCount = uint32_t(columns[SummaryProcessCount]);
+		summary.hasExitCode = columns[SummaryExitCode] != 0;
+		summary.exitCode = int32_t(uint32_t(columns[SummaryExitCode] - 1));
+		return true;
+	}
+
+public:
+	BinaryTraceReader(TraceInput& input, StringTable& strings, TraceWriter& writer) :
+		m_input(input),
+		m_writer(writer),
+		m_stringTable(strings)
+	{
+	}
+
+	// Truncated when the file ends within a record
+	bool read(std::string& error, bool& truncated)
+	{
+		uint8_t header[sizeof(BinaryTraceMagic) + 4] = { };
+		if (m_input.read(header, sizeof(header)) != sizeof(header) || memcmp(header, BinaryTraceMagic, sizeof(BinaryTraceMagic)) != 0)
+		{
+			error = "Not a binary trace";
+			return false;
+		}
+		auto version = uint32_t(header[8]) | uint32_t(header[9]) << 8 | uint32_t(header[10]) << 16 | uint32_t(header[11]) << 24;
+		if (version != BinaryTraceVersion)
+		{
+			error = "Unsupported binary trace version " + std::to_string(version);
+			return false;
+		}
+		for (;;)
+		{
+			auto offset = m_input.offset();
+			uint64_t type = 0, size = 0;
+			if (!readVarint(type) || !readVarint(size))
+			{
+				truncated = m_input.offset() != offset;
+				break;
+			}
+			if (size > MaximumRecordSize)
+			{
+				error = "Corrupt record at offset " + std::to_string(offset);
+				return false;
+			}
+			m_record.resize(size_t(size));
+			// Like a killed run leaves it
+			if (m_input.read(m_record.data(), m_record.size()) != m_record.size())
+			{
+				truncated = true;
+				break;
+			}
+			if (!readRecord(type, m_record.data(), m_record.size()))
+			{
+				error = "Corrupt record at offset " + std::to_string(offset);
+				return false;
+			}
+			if (type != RecordString && type != RecordProcess && type != RecordThread)
+				m_writer.endTick();
+		}
+		return true;
+	}
+};
+
+// A value of a JSON chunk. The values of a chunk are parsed into the ones of the previous
+// chunk, so once the first chunks have been read parsing no longer allocates.
+struct JsonValue
+{
+	enum Type
+	{
+		Null,
+		Bool,
+		Number,
+		String,
+		Array,
+		Object,
+	};
+
+	Type type = Null;
+	uint64_t integer = 0; // exact for non-negative integers, creation times need all 64 bits
+	double number = 0.0;
+	std::string string;
+	std::vector<JsonValue> elements; // can have more entries than the value, see count
+	std::vector<std::pair<std::string, JsonValue>> members;
+	size_t count = 0; // elements or members used
+
+	const JsonValue* find(const char* key) const
+	{
+		if (type != Object)
+			return nullptr;
+		for (size_t i = 0; i < count; i++)
+		{
+			if (members[i].first == key)
+				return &members[i].second;
+		}
+		return nullptr;
+	}
+
+	// Of a member, 0 or empty when it is missing
+	uint64_t unsignedOf(const char* key) const
+	{
+		auto value = find(key);
+		return value && value->type == Number ? value->integer : 0;
+	}
+
+	double doubleOf(const char* key) const
+	{
+		auto value = find(key);
+		return value && value->type == Number ? value->number : 0.0;
+	}
+
+	const std::string& stringOf(const char* key) const
+	{
+		static const std::string empty;
+		auto value = find(key);
+		return value && value->type == String ? value->string : empty;
+	}
+};
+
+class JsonTraceReader
+{
+	// Deeper nesting than any chunk has can only come from a corrupt file
+	static const int MaximumDepth = 32;
+
+	TraceInput& m_input;
+	TraceWriter& m_writer;
+	StringTable& m_stringTable;
+	std::vector<UniqueProcess> m_processes;
+	// The records of a process are not always together, binary traces buffer the samples but
+	// not the rollups, and a process that replaced its image keeps its pid and creation time
+	FlatHashMap<uint32_t, std::vector<uint32_t>> m_pids; // pid -> indices of the processes with it
+	std::vector<ThreadData> m_threads;
+	std::vector<uint32_t> m_threadProcesses; // thread index -> process index
+	FlatHashMap<uint32_t, std::vector<uint32_t>> m_tids; // tid -> indices of the threads with it
+	JsonValue m_chunk;
+	std::string m_key;
+	std::string m_text;
+
+	// True when a line ended
+	bool skipWhitespace()
+	{
+		auto newline = false;
+		for (;;)
+		{
+			auto c = m_input.peek();
+			if (c == '\n')
+				newline = true;
+			else if (c != ' ' && c != '\t' && c != '\r')
+				return newline;
+			m_input.get();
+		}
+	}
+
+	bool expect(char c)
+	{
+		skipWhitespace();
+		return m_input.get() == c;
+	}
+
+	static void appendUtf8(std::string& str, uint32_t c)
+	{
+		if (c < 0x80)
+		{
+			str += char(c);
+		}
+		else if (c < 0x800)
+		{
+			str += char(0xC0 | c >> 6);
+			str += char(0x80 | (c & 0x3F));
+		}
+		else if (c < 0x10000)
+		{
+			str += char(0xE0 | c >> 12);
+			str += char(0x80 | (c >> 6 & 0x3F));
+			str += char(0x80 | (c & 0x3F));
+		}
+		else
+		{
+			str += char(0xF0 | c >> 18);
+			str += char(0x80 | (c >> 12 & 0x3F));
+			str += char(0x80 | (c >> 6 & 0x3F));
+			str += char(0x80 | (c & 0x3F));
+		}
+	}
+
+	bool parseHex(uint32_t& value)
+	{
+		value = 0;
+		for (int i = 0; i < 4; i++)
+		{
+			auto c = m_input.get();
+			value <<= 4;
+			if (c >= '0' && c <= '9')
+				value |= c - '0';
+			else if (c >= 'a' && c <= 'f')
+				value |= c - 'a' + 10;
+			else if (c >= 'A' && c <= 'F')
+				value |= c - 'A' + 10;
+			else
+				return false;
+		}
+		return true;
+	}
+
+	// After the opening quote
+	bool parseString(std::string& str)
+	{
+		str.clear();
+		for (;;)
+		{
+			auto c = m_input.get();
+			if (c < 0)
+				return false;
+			if (c == '"')
+				return true;
+			if (c != '\\')
+			{
+				str += char(c);
+				continue;
+			}
+			c = m_input.get();
+			switch (c)
+			{
+			case '"': case '\\': case '/': str += char(c); break;
+			case 'b': str += '\b'; break;
+			case 'f': str += '\f'; break;
+			case 'n': str += '\n'; break;
+			case 'r': str += '\r'; break;
+			case 't': str += '\t'; break;
+			case 'u':
+			{
+				uint32_t code = 0, low = 0;
+				if (!parseHex(code))
+					return false;
+				// Surrogate pair
+				if (code >= 0xD800 && code < 0xDC00 && m_input.get() == '\\' && m_input.get() == 'u' && parseHex(low))
+					code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+				appendUtf8(str, code);
+				break;
+			}
+			default:
+				return false;
+			}
+		}
+	}
+
+	bool parseNumber(JsonValue& value)
+	{
+		m_text.clear();
+		auto integral = true;
+		for (;;)
+		{
+			auto c = m_input.peek();
+			if (c == '.' || c == 'e' || c == 'E' || c == '-' || c == '+')
+				integral = false;
+			else if (c < '0' || c > '9')
+				break;
+			m_text += char(m_input.get());
+		}
+		if (m_text.empty())
+			return false;
+		char* end = nullptr;
+		value.type = JsonValue::Number;
+		if (integral)
+		{
+			value.integer = strtoull(m_text.c_str(), &end, 10);
+			value.number = double(value.integer);
+		}
+		else
+		{
+			value.number = strtod(m_text.c_str(), &end);
+			value.integer = value.number > 0 ? uint64_t(value.number) : 0;
+		}
+		return *end == '\0';
+	}
+
+	bool parseLiteral(const char* literal)
+	{
+		for (auto c = literal; *c; c++)
+		{
+			if (m_input.get() != *c)
+				return false;
+		}
+		return true;
+	}
+
+	bool parseValue(JsonValue& value, int depth)
+	{
+		if (depth > MaximumDepth)
+			return false;
+		skipWhitespace();
+		value.count = 0;
+		switch (m_input.peek())
+		{
+		case '{':
+		{
+			m_input.get();
+			value.type = JsonValue::Object;
+			skipWhitespace();
+			if (m_input.peek() == '}')
+			{
+				m_input.get();
+				return true;
+			}
+			for (;;)
+			{
+				if (!expect('"') || !parseString(m_key) || !expect(':'))
+					return false;
+				if (value.count == value.members.size())
+					value.members.emplace_back();
+				auto& member = value.members[value.count++];
+				member.first.swap(m_key);
+				if (!parseValue(member.second, depth + 1))
+					return false;
+				skipWhitespace();
+				auto c = m_input.get();
+				if (c == '}')
+					return true;
+				if (c != ',')
+					return false;
+			}
+		}
+
+		case '[':
+		{
+			m_input.get();
+			value.type = JsonValue::Array;
+			skipWhitespace();
+			if (m_input.peek() == ']')
+			{
+				m_input.get();
+				return true;
+			}
+			for (;;)
+			{
+				if (value.count == value.elements.size())
+					value.elements.emplace_back();
+				if (!parseValue(value.elements[value.count++], depth + 1))
+					return false;
+				skipWhitespace();
+				auto c = m_input.get();
+				if (c == ']')
+					return true;
+				if (c != ',')
+					return false;
+			}
+		}
+
+		case '"':
+			m_input.get();
+			value.type = JsonValue::String;
+			return parseString(value.string);
+
+		case 't':
+		case 'f':
+			value.type = JsonValue::Bool;
+			value.integer = m_input.peek() == 't';
+			return parseLiteral(value.integer ? "true" : "false");
+
+		case 'n':
+			value.type = JsonValue::Null;
+			return parseLiteral("null");
+
+		default:
+			return parseNumber(value);
+		}
+	}
+
+	// Index of the process of a chunk, a process that was not seen before is added
+	uint32_t processIndex(const JsonValue& chunk)
+	{
+		auto pid = uint32_t(chunk.unsignedOf("pid"));
+		auto createTime = chunk.unsignedOf("createTime");
+		const auto& name = chunk.stringOf("name");
+		auto& indices = m_pids[pid];
+		for (auto index : indices)
+		{
+			const UniqueProcess& process = m_processes[index];
+			if (process.createTime == createTime && *process.name == name)
+				return index;
+		}
+		auto index = uint32_t(m_processes.size());
+		UniqueProcess process;
+		process.id = uint64_t(index) << 32 | pid;
+		process.pid = pid;
+		process.ppid = uint32_t(chunk.unsignedOf("ppid"));
+		process.createTime = createTime;
+		process.name = m_stringTable.intern(name);
+		m_processes.push_back(process);
+		indices.push_back(index);
+		return index;
+	}
+
+	void readSamples(const JsonValue& chunk)
+	{
+		auto data = chunk.find("data");
+		if (!data || data->type != JsonValue::Array)
+			return;
+		auto index = processIndex(chunk);
+		for (size_t i = 0; i < data->count; i++)
+		{
+			const JsonValue& sample = data->elements[i];
+			ProcessData d;
+			d.time = sample.unsignedOf("time");
+			d.cpuUsage = sample.doubleOf("cpuUsage");
+			if (auto memory = sample.find("memory"))
+			{
+				d.memory.pageFaultCount = uint32_t(memory->unsignedOf("pageFaultCount"));
+				d.memory.peakWorkingSetSize = size_t(memory->unsignedOf("peakWorkingSetSize"));
+				d.memory.workingSetSize = size_t(memory->unsignedOf("workingSetSize"));
+				d.memory.quotaPeakPagedPoolUsage = size_t(memory->unsignedOf("quotaPeakPagedPoolUsage"));
+				d.memory.quotaPagedPoolUsage = size_t(memory->unsignedOf("quotaPagedPoolUsage"));
+				d.memory.quotaPeakNonPagedPoolUsage = size_t(memory->unsignedOf("quotaPeakNonPagedPoolUsage"));
+				d.memory.quotaNonPagedPoolUsage = size_t(memory->unsignedOf("quotaNonPagedPoolUsage"));
+				d.memory.pagefileUsage = size_t(memory->unsignedOf("pagefileUsage"));
+				d.memory.peakPagefileUsage = size_t(memory->unsignedOf("peakPagefileUsage"));
+				d.memory.privateUsage = size_t(memory->unsignedOf("privateUsage"));
+			}
+			if (auto io = sample.find("io"))
+			{
+				d.io.readBytes = io->unsignedOf("readBytes");
+				d.io.writeBytes = io->unsignedOf("writeBytes");
+				d.io.readOperations = io->unsignedOf("readOperations");
+				d.io.writeOperations = io->unsignedOf("writeOperations");
+			}
+			d.cpuTime = sample.unsignedOf("cpuTime");
+			d.cycleTime = sample.unsignedOf("cycleTime");
+			m_writer.addSample(index, m_processes[index], d);
+		}
+	}
+
+	void readThreads(const JsonValue& threads)
+	{
+		// The chunk only identifies the process by pid and creation time, it was added by its
+		// samples. After an image was replaced the threads belong to the new image.
+		auto data = threads.find("data");
+		auto indices = m_pids.find(uint32_t(threads.unsignedOf("pid")));
+		if (!data || data->type != JsonValue::Array || !indices)
+			return;
+		auto process = uint32_t(-1);
+		for (auto index : *indices)
+		{
+			if (m_processes[index].createTime == threads.unsignedOf("createTime"))
+				process = index;
+		}
+		if (process == uint32_t(-1))
+			return;
+		auto time = threads.unsignedOf("time");
+		for (size_t i = 0; i < data->count; i++)
+		{
+			const JsonValue& thread = data->elements[i];
+			auto tid = uint32_t(thread.unsignedOf("tid"));
+			auto createTime = thread.unsignedOf("createTime");
+			auto& indices = m_tids[tid];
+			auto index = uint32_t(-1);
+			for (auto existing : indices)
+			{
+				if (m_threads[existing].createTime == createTime && m_threadProcesses[existing] == process)
+					index = existing;
+			}
+			if (index == uint32_t(-1))
+			{
+				ThreadData identity;
+				identity.index = index = uint32_t(m_threads.size());
+				identity.tid = tid;
+				identity.createTime = createTime;
+				identity.name = m_stringTable.intern(thread.stringOf("name"));
+				m_threads.push_back(identity);
+				m_threadProcesses.push_back(process);
+				indices.push_back(index);
+			}
+			ThreadData d = m_threads[index];
+			d.time = time;
+			d.userUsage = thread.doubleOf("userUsage");
+			d.kernelUsage = thread.doubleOf("kernelUsage");
+			d.contextSwitches = uint32_t(thread.unsignedOf("contextSwitches"));
+			const auto& state = thread.stringOf("state");
+			d.state = state == "running" ? ThreadState::Running : state == "ready" ? ThreadState::Ready : state == "waiting" ? ThreadState::Waiting : ThreadState::Other;
+			d.waitReason = uint8_t(thread.unsignedOf("waitReason"));
+			m_writer.addThreadSample(process, m_processes[process], d);
+		}
+	}
+
+	void readComposition(const JsonValue& chunk)
+	{
+		auto index = processIndex(chunk);
+		CompositionData data;
+		data.time = chunk.unsignedOf("time");
+		auto& bytes = data.composition.bytes;
+		bytes[MemoryImage] = chunk.unsignedOf("image");
+		bytes[MemoryMapped] = chunk.unsignedOf("mapped");
+		bytes[MemoryShareable] = chunk.unsignedOf("shareable");
+		bytes[MemoryHeap] = chunk.unsignedOf("heap");
+		bytes[MemoryStack] = chunk.unsignedOf("stack");
+		bytes[MemoryPrivate] = chunk.unsignedOf("private");
+		m_writer.addComposition(index, m_processes[index], data);
+	}
+
+	void readRollup(const JsonValue& chunk)
+	{
+		auto index = processIndex(chunk);
+		RollupData data;
+		data.time = chunk.unsignedOf("time");
+		data.workingSetSize = chunk.unsignedOf("workingSetSize");
+		data.privateUsage = chunk.unsignedOf("privateUsage");
+		data.cpuUsage = chunk.doubleOf("cpuUsage");
+		data.processCount = uint32_t(chunk.unsignedOf("processCount"));
+		m_writer.addRollup(index, m_processes[index], data);
+	}
+
+	void readOverhead(const JsonValue& chunk)
+	{
+		OverheadData overhead;
+		overhead.time = chunk.unsignedOf("time");
+		overhead.tick = chunk.unsignedOf("tick");
+		overhead.interval = uint32_t(chunk.unsignedOf("interval"));
+		overhead.snapshotTime = chunk.unsignedOf("snapshotTime");
+		overhead.queryCount = uint32_t(chunk.unsignedOf("queryCount"));
+		overhead.queryTime = chunk.unsignedOf("queryTime");
+		overhead.writeTime = chunk.unsignedOf("writeTime");
+		overhead.queueTime = chunk.unsignedOf("queueTime");
+		overhead.queuedRecords = uint32_t(chunk.unsignedOf("queuedRecords"));
+		overhead.cpuUsage = chunk.doubleOf("cpuUsage");
+		overhead.workingSetSize = size_t(chunk.unsignedOf("workingSetSize"));
+		overhead.missedDeadlines = uint32_t(chunk.unsignedOf("missedDeadlines"));
+		overhead.droppedTicks = uint32_t(chunk.unsignedOf("droppedTicks"));
+		m_writer.addOverhead(overhead);
+	}
+
+	static SummaryData summaryOf(const JsonValue& chunk)
+	{
+		static const double GB = 1024.0 * 1024.0 * 1024.0;
+		SummaryData data;
+		data.startTime = chunk.unsignedOf("startTime");
+		data.endTime = chunk.unsignedOf("endTime");
+		data.peakWorkingSetSize = chunk.unsignedOf("peakWorkingSetSize");
+		data.peakPrivateUsage = chunk.unsignedOf("peakPrivateUsage");
+		data.peakTime = chunk.unsignedOf("peakTime");
+		data.workingSetIntegral = chunk.doubleOf("workingSetGigabyteSeconds") * GB * 1000.0;
+		data.cpuTime = uint64_t(std::llround(chunk.doubleOf("cpuSeconds") * 1e7));
+		data.processCount = uint32_t(chunk.unsignedOf("processCount"));
+		auto exitCode = chunk.find("exitCode");
+		data.hasExitCode = exitCode && exitCode->type == JsonValue::Number;
+		if (data.hasExitCode)
+			data.exitCode = int32_t(chunk.doubleOf("exitCode"));
+		return data;
+	}
+
+	void readSummary(const JsonValue& chunk)
+	{
+		auto index = processIndex(chunk);
+		auto data = summaryOf(chunk);
+		data.processCount = 1;
+		m_writer.addSummary(index, m_processes[index], data);
+	}
+
+	void readChunk(const JsonValue& chunk)
+	{
+		const JsonValue* value = nullptr;
+		if ((value = chunk.find("threads")))
+			readThreads(*value);
+		else if ((value = chunk.find("composition")))
+			readComposition(*value);
+		else if ((value = chunk.find("rollup")))
+			readRollup(*value);
+		else if ((value = chunk.find("overhead")))
+			readOverhead(*value);
+		else if ((value = chunk.find("summary")))
+			readSummary(*value);
+		else if ((value = chunk.find("treeSummary")))
+			m_writer.addTreeSummary(summaryOf(*value));
+		else if (chunk.find("pid"))
+			readSamples(chunk);
+	}
+
+public:
+	JsonTraceReader(TraceInput& input, StringTable& strings, TraceWriter& writer) :
+		m_input(input),
+		m_writer(writer),
+		m_stringTable(strings)
+	{
+	}
+
+	// Truncated when the file ends within a chunk
+	bool read(std::string& error, bool& truncated)
+	{
+		if (!expect('['))
+		{
+			error = "Not a JSON trace";
+			return false;
+		}
+		skipWhitespace();
+		if (m_input.peek() == ']')
+			return true;
+		for (;;)
+		{
+			auto offset = m_input.offset();
+			if (!parseValue(m_chunk, 0))
+			{
+				// An incomplete last line, like a killed run leaves it
+				if (m_input.peek() < 0)
+				{
+					truncated = true;
+					break;
+				}
+				error = "Invalid JSON at offset " + std::to_string(offset);
+				return false;
+			}
+			if (m_chunk.type == JsonValue::Object && m_chunk.find("version"))
+			{
+				// Only the ticks layout has a version, 2
+				if (m_chunk.unsignedOf("version") > 2)
+				{
+					error = "Unsupported JSON trace version " + std::to_string(m_chunk.unsignedOf("version"));
+					return false;
+				}
+			}
+			else if (m_chunk.type == JsonValue::Object)
+			{
+				readChunk(m_chunk);
+			}
+			// Every tick is written as a line, the separator starts the next one
+			if (skipWhitespace())
+				m_writer.endTick();
+			auto c = m_input.get();
+			if (c == ']')
+				break;
+			if (c < 0)
+			{
+				truncated = true;
+				break;
+			}
+			if (c != ',')
+			{
+				error = "Invalid JSON at offset " + std::to_string(m_input.offset() - 1);
+				return false;
+			}
+		}
+		m_writer.endTick();
+		return true;
+	}
+};
+
+bool readTrace(const std::string& file, StringTable& strings, TraceWriter& writer, std::string& error)
+{
+	TraceInput input;
+	if (!input.open(file, error))
+		return false;
+	// The JSON trace starts with its array, the binary one with its magic
+	auto truncated = false;
+	auto success = input.peek() == BinaryTraceMagic[0] ? BinaryTraceReader(input, strings, writer).read(error, truncated) : JsonTraceReader(input, strings, writer).read(error, truncated);
+	if (success && (truncated || input.failed()))
+		fprintf(stderr, "[Onlooker] %s is truncated, it was read up to the last complete record.\n", file.c_str());
+	return success;
+}
+
+bool readTraceOrder(const std::string& file, bool& ticks, std::string& error)
+{
+	TraceInput input;
+	if (!input.open(file, error))
+		return false;
+	// The ticks layout starts with its version, [{"version":2,"layout":"ticks"}
+	static const char Prefix[] = "[{\"version\"";
+	ticks = true;
+	for (const char* c = Prefix; *c && ticks; c++)
+	{
+		auto next = input.get();
+		while (next == ' ' || next == '\t' || next == '\r' || next == '\n')
+			next = input.get();
+		ticks = next == *c;
+	}
+	return true;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "TraceWriter.h"
+#include "StringTable.h"
+
+#include <string>
+
+// Streams a JSON (.json) or binary (.olt) trace, optionally gzip compressed, into a trace
+// writer: every process sample, thread sample, composition, rollup, overhead record and summary
+// in the order of the file. Only the current record is held in memory, so traces of any size
+// can be read. Process indices are assigned in order of appearance. endTick is called at the
+// end of every line of a JSON trace and after every record of a binary trace. A truncated
+// record at the end is ignored like in Cutelooker, the writer is not closed. The names are
+// interned in strings, writers that hold on to processes until they are closed need it to
+// live longer.
+bool readTrace(const std::string& file, StringTable& strings, TraceWriter& writer, std::string& error);
+
+// Whether the records of the trace are in the order of time, tick by tick. Only the ticks layout
+// of JSON traces is, the processes layout and binary traces group the samples by process.
+bool readTraceOrder(const std::string& file, bool& ticks, std::string& error);
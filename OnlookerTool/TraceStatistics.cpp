@@ -0,0 +1,157 @@
+#include "TraceStatistics.h"
+
+#include <cinttypes>
+
+#include <algorithm>
+#include <limits>
+#include <string>
+
+bool TraceStatistics::open(const std::string& basename)
+{
+	(void)basename;
+	return true;
+}
+
+void TraceStatistics::addSample(uint32_t index, const UniqueProcess& process, const ProcessData& data)
+{
+	if (index >= m_processes.size())
+		m_processes.resize(index + 1);
+	Process& p = m_processes[index];
+	if (!p.samples)
+	{
+		p.process = process;
+		p.firstTime = data.time;
+		p.lastTime = data.time;
+		p.peakTime = data.time;
+		p.firstCpuTime = data.cpuTime;
+	}
+	auto elapsed = double(data.time - p.lastTime);
+	p.samples++;
+	p.lastTime = data.time;
+	if (data.memory.workingSetSize > p.peakWorkingSetSize)
+	{
+		p.peakWorkingSetSize = data.memory.workingSetSize;
+		p.peakTime = data.time;
+	}
+	p.peakPrivateUsage = std::max<uint64_t>(p.peakPrivateUsage, data.memory.privateUsage);
+	p.workingSetIntegral += double(data.memory.workingSetSize) * elapsed;
+	p.maxCpuUsage = std::max(p.maxCpuUsage, data.cpuUsage);
+	p.lastCpuTime = data.cpuTime;
+	// The I/O rates are per second
+	p.readBytes += double(data.io.readBytes) * elapsed / 1000.0;
+	p.writeBytes += double(data.io.writeBytes) * elapsed / 1000.0;
+}
+
+void TraceStatistics::addThreadSample(uint32_t index, const UniqueProcess& process, const ThreadData& data)
+{
+	(void)index;
+	(void)process;
+	(void)data;
+}
+
+void TraceStatistics::addComposition(uint32_t index, const UniqueProcess& process, const CompositionData& data)
+{
+	(void)index;
+	(void)process;
+	(void)data;
+}
+
+void TraceStatistics::addRollup(uint32_t index, const UniqueProcess& process, const RollupData& data)
+{
+	(void)index;
+	(void)process;
+	(void)data;
+}
+
+void TraceStatistics::addOverhead(const OverheadData& overhead)
+{
+	(void)overhead;
+}
+
+void TraceStatistics::endTick()
+{
+}
+
+// The statistics are computed from the samples that were selected, the summaries of the
+// trace are of the whole run
+void TraceStatistics::addSummary(uint32_t index, const UniqueProcess& process, const SummaryData& data)
+{
+	(void)index;
+	(void)process;
+	(void)data;
+}
+
+void TraceStatistics::addTreeSummary(const SummaryData& data)
+{
+	(void)data;
+}
+
+bool TraceStatistics::close()
+{
+	return true;
+}
+
+void TraceStatistics::print(FILE* file, bool csv) const
+{
+	static const double MB = 1024.0 * 1024.0;
+	// By start, binary traces have the processes in a different order than JSON traces
+	std::vector<const Process*> sorted;
+	auto start = std::numeric_limits<uint64_t>::max();
+	auto end = uint64_t(0);
+	size_t nameWidth = 4;
+	for (const Process& p : m_processes)
+	{
+		if (!p.samples)
+			continue;
+		sorted.push_back(&p);
+		start = std::min(start, p.firstTime);
+		end = std::max(end, p.lastTime);
+		nameWidth = std::max(nameWidth, std::min<size_t>(p.process.name->size(), 32));
+	}
+	std::stable_sort(sorted.begin(), sorted.end(), [](const Process* a, const Process* b)
+	{
+		return a->firstTime != b->firstTime ? a->firstTime < b->firstTime : a->process.pid < b->process.pid;
+	});
+
+	if (csv)
+		fprintf(file, "pid,ppid,name,start,lifetime,samples,peakWorkingSetSize,peakTime,averageWorkingSetSize,peakPrivateUsage,cpuTime,maxCpuUsage,readBytes,writeBytes\n");
+	else
+		fprintf(file, "%7s %7s  %-*s %9s %9s %8s %10s %9s %10s %10s %9s %7s %10s %10s\n", "PID", "PPID", int(nameWidth), "Name", "Start(s)", "Life(s)", "Samples", "PeakWS(MB)", "PeakAt(s)", "AvgWS(MB)", "PeakPv(MB)", "CPU(s)", "MaxCPU%", "Read(MB)", "Write(MB)");
+
+	uint64_t processes = 0, samples = 0;
+	double cpuTime = 0.0, readBytes = 0.0, writeBytes = 0.0;
+	for (const Process* process : sorted)
+	{
+		const Process& p = *process;
+		auto lifetime = double(p.lastTime - p.firstTime);
+		auto averageWorkingSetSize = lifetime > 0 ? p.workingSetIntegral / lifetime : double(p.peakWorkingSetSize);
+		// cpuTime is in 100ns units
+		auto cpu = double(p.lastCpuTime - std::min(p.firstCpuTime, p.lastCpuTime)) / 1e7;
+		processes++;
+		samples += p.samples;
+		cpuTime += cpu;
+		readBytes += p.readBytes;
+		writeBytes += p.writeBytes;
+		const std::string& name = *p.process.name;
+		if (csv)
+		{
+			std::string quoted = "\"";
+			for (auto c : name)
+			{
+				if (c == '"')
+					quoted += '"';
+				quoted += c;
+			}
+			quoted += '"';
+			fprintf(file, "%u,%u,%s,%.3f,%.3f,%" PRIu64 ",%" PRIu64 ",%.3f,%.0f,%" PRIu64 ",%.3f,%.1f,%.0f,%.0f\n", p.process.pid, p.process.ppid, quoted.c_str(), (p.firstTime - start) / 1000.0, lifetime / 1000.0, p.samples, p.peakWorkingSetSize, (p.peakTime - start) / 1000.0, averageWorkingSetSize, p.peakPrivateUsage, cpu, p.maxCpuUsage, p.readBytes, p.writeBytes);
+		}
+		else
+		{
+			fprintf(file, "%7u %7u  %-*.*s %9.3f %9.3f %8" PRIu64 " %10.1f %9.3f %10.1f %10.1f %9.2f %7.1f %10.1f %10.1f\n", p.process.pid, p.process.ppid, int(nameWidth), int(nameWidth), name.c_str(), (p.firstTime - start) / 1000.0, lifetime / 1000.0, p.samples, p.peakWorkingSetSize / MB, (p.peakTime - start) / 1000.0, averageWorkingSetSize / MB, p.peakPrivateUsage / MB, cpu, p.maxCpuUsage, p.readBytes / MB, p.writeBytes / MB);
+		}
+	}
+	if (!csv && processes)
+		fprintf(file, "%" PRIu64 " processes, %" PRIu64 " samples over %.3f s, %.2f s of CPU, %.1f MB read, %.1f MB written\n", processes, samples, (end - start) / 1000.0, cpuTime, readBytes / MB, writeBytes / MB);
+	else if (!csv)
+		fprintf(file, "No samples\n");
+}
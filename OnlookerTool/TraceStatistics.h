@@ -0,0 +1,46 @@
+#pragma once
+
+#include "TraceWriter.h"
+
+#include <cstdio>
+#include <vector>
+
+// Statistics of every process from the samples it is given, only a few numbers per process
+// are kept. Integrals weigh every sample with the time since the previous sample of its
+// process, which is what the rates and usages of a sample cover.
+class TraceStatistics : public TraceWriter
+{
+	struct Process
+	{
+		UniqueProcess process;
+		uint64_t samples = 0;
+		uint64_t firstTime = 0;
+		uint64_t lastTime = 0;
+		uint64_t peakWorkingSetSize = 0;
+		uint64_t peakTime = 0; // of the peak working set
+		uint64_t peakPrivateUsage = 0;
+		double workingSetIntegral = 0.0; // bytes * ms
+		double maxCpuUsage = 0.0;
+		uint64_t firstCpuTime = 0;
+		uint64_t lastCpuTime = 0;
+		double readBytes = 0.0;
+		double writeBytes = 0.0;
+	};
+
+	std::vector<Process> m_processes; // process index -> statistics, in order of appearance
+
+public:
+	bool open(const std::string& basename) override;
+	void addSample(uint32_t index, const UniqueProcess& process, const ProcessData& data) override;
+	void addThreadSample(uint32_t index, const UniqueProcess& process, const ThreadData& data) override;
+	void addComposition(uint32_t index, const UniqueProcess& process, const CompositionData& data) override;
+	void addRollup(uint32_t index, const UniqueProcess& process, const RollupData& data) override;
+	void addOverhead(const OverheadData& overhead) override;
+	void endTick() override;
+	void addSummary(uint32_t index, const UniqueProcess& process, const SummaryData& data) override;
+	void addTreeSummary(const SummaryData& data) override;
+	bool close() override;
+
+	// A table of the processes with samples and a line of totals, or CSV with a header row
+	void print(FILE* file, bool csv) const;
+};
@@ -0,0 +1,170 @@
+#include "TraceReader.h"
+#include "TraceFilters.h"
+#include "TraceStatistics.h"
+#include "Compression.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static int usage()
+{
+	fprintf(stderr, "Usage: onlooker-tool [options] <trace>\n");
+	fprintf(stderr, "Reads a JSON (.json) or binary (.olt) trace of Onlooker, optionally gzip compressed, as a stream.\n");
+	fprintf(stderr, "Without --output the statistics of every process are printed.\n\n");
+	fprintf(stderr, "  --from <time>            keep the samples from this time on, in milliseconds since epoch\n");
+	fprintf(stderr, "                           or +<seconds> after the start of the trace\n");
+	fprintf(stderr, "  --to <time>              keep the samples up to this time\n");
+	fprintf(stderr, "  --process <name|pid>     keep this process, can be repeated (default: all)\n");
+	fprintf(stderr, "  --children               also keep the processes started by the kept ones\n");
+	fprintf(stderr, "  --downsample <ms>        one sample per process for every bucket of this length, thread\n");
+	fprintf(stderr, "                           samples, rollups and overhead are dropped\n");
+	fprintf(stderr, "  --aggregate min|max|avg  reduction of the samples of a bucket (default: max)\n");
+	fprintf(stderr, "  --output <basename>      write the result as a trace, the extension is added\n");
+	fprintf(stderr, "  --format <format>        json, json-ticks or binary, of the output (default: json),\n");
+	fprintf(stderr, "                           json-ticks needs a json-ticks input\n");
+	fprintf(stderr, "  --compress gzip[,<1-9>]  compress the output\n");
+	fprintf(stderr, "  --stats                  print the statistics of every process, of the kept samples\n");
+	fprintf(stderr, "                           before downsampling\n");
+	fprintf(stderr, "  --csv                    print the statistics as CSV\n");
+	return EXIT_FAILURE;
+}
+
+int main(int argc, char* argv[])
+{
+	TraceSelection selection;
+	uint64_t downsample = 0;
+	auto aggregate = Aggregate::Max;
+	std::string output;
+	auto format = TraceFormat::Json;
+	auto stats = false;
+	auto csv = false;
+	std::string input;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const char* arg = argv[i];
+		// Options with a value
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+		auto valid = true;
+		if (strcmp(arg, "--from") == 0 && value)
+			valid = selection.hasFrom = TraceSelection::parseTime(value, selection.from, selection.fromRelative);
+		else if (strcmp(arg, "--to") == 0 && value)
+			valid = selection.hasTo = TraceSelection::parseTime(value, selection.to, selection.toRelative);
+		else if (strcmp(arg, "--process") == 0 && value)
+			selection.processes.push_back(value);
+		else if (strcmp(arg, "--downsample") == 0 && value)
+			valid = (downsample = strtoull(value, nullptr, 10)) != 0;
+		else if (strcmp(arg, "--aggregate") == 0 && value)
+			valid = parseAggregate(value, aggregate);
+		else if (strcmp(arg, "--output") == 0 && value)
+			output = value;
+		else if (strcmp(arg, "--format") == 0 && value)
+			valid = parseTraceFormat(value, format);
+		else if (strcmp(arg, "--compress") == 0 && value)
+		{
+			int level = 0;
+			valid = parseCompression(value, level);
+			if (valid && !compressionSupported())
+			{
+				fprintf(stderr, "[Onlooker] --compress is not supported, onlooker-tool was built without zlib.\n");
+				return EXIT_FAILURE;
+			}
+			setOutputCompression(level);
+		}
+		// Flags
+		else if (strcmp(arg, "--children") == 0)
+		{
+			selection.descendants = true;
+			continue;
+		}
+		else if (strcmp(arg, "--stats") == 0)
+		{
+			stats = true;
+			continue;
+		}
+		else if (strcmp(arg, "--csv") == 0)
+		{
+			stats = true;
+			csv = true;
+			continue;
+		}
+		else if (*arg != '-' && input.empty())
+		{
+			input = arg;
+			continue;
+		}
+		else
+		{
+			return usage();
+		}
+		if (!valid)
+		{
+			fprintf(stderr, "[Onlooker] Invalid %s '%s'.\n", arg, value);
+			return usage();
+		}
+		i++;
+	}
+	if (input.empty())
+		return usage();
+	if (output.empty())
+		stats = true;
+
+	// The output is truncated when it is opened
+	if (!output.empty() && input == output + traceExtension(format) + (outputCompression() ? ".gz" : ""))
+	{
+		fprintf(stderr, "[Onlooker] The output would overwrite the input %s.\n", input.c_str());
+		return EXIT_FAILURE;
+	}
+
+	// A truncated copy of the ticks layout only loses the last ticks, samples grouped by process
+	// would have to be sorted by time first
+	if (!output.empty() && format == TraceFormat::JsonTicks)
+	{
+		auto ticks = false;
+		std::string error;
+		if (!readTraceOrder(input, ticks, error))
+		{
+			fprintf(stderr, "[Onlooker] %s: %s.\n", input.c_str(), error.c_str());
+			return EXIT_FAILURE;
+		}
+		if (!ticks)
+		{
+			fprintf(stderr, "[Onlooker] %s is not in the order of time, json-ticks can only be written from a json-ticks trace.\n", input.c_str());
+			return EXIT_FAILURE;
+		}
+	}
+
+	// The statistics are of the selected samples before downsampling. The writers keep
+	// processes of the trace until they are closed, so the names outlive them.
+	StringTable strings;
+	auto writer = output.empty() ? createNullTraceWriter() : createTraceWriter(format);
+	if (downsample)
+		writer = createDownsampler(downsample, aggregate, std::move(writer));
+	TraceStatistics* statistics = nullptr;
+	if (stats)
+	{
+		auto collector = std::make_unique<TraceStatistics>();
+		statistics = collector.get();
+		writer = createTeeTraceWriter(std::move(collector), std::move(writer));
+	}
+	writer = createSelectionFilter(selection, std::move(writer));
+
+	if (!writer->open(output))
+	{
+		fprintf(stderr, "[Onlooker] Failed to open the output %s.\n", output.c_str());
+		return EXIT_FAILURE;
+	}
+	std::string error;
+	auto success = readTrace(input, strings, *writer, error);
+	if (!success)
+		fprintf(stderr, "[Onlooker] %s: %s.\n", input.c_str(), error.c_str());
+	if (!writer->close() || !finishOutputs())
+	{
+		fprintf(stderr, "[Onlooker] Failed to write the output %s.\n", output.c_str());
+		success = false;
+	}
+	if (statistics && success)
+		statistics->print(stdout, csv);
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
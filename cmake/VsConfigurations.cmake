@@ -9,4 +9,7 @@ if(CMAKE_GENERATOR MATCHES "Visual Studio")
     set(CMAKE_BUILD_TYPE "Release" CACHE STRING "")
     #set(CMAKE_MSVC_RUNTIME_LIBRARY "MultiThreaded$<$<CONFIG:Debug>:Debug>" CACHE STRING "")
     cmake_policy(SET CMP0091 NEW)
-endif()
\ No newline at end of file
+elseif(NOT CMAKE_BUILD_TYPE)
+    # Single-configuration generators build what ships unless told otherwise
+    set(CMAKE_BUILD_TYPE "Release" CACHE STRING "" FORCE)
+endif()
\ No newline at end of file
@@ -0,0 +1,36 @@
+# Replays tests/replay.olsnap and compares the CSV to tests/replay.csv
+#
+# The capture holds 20 snapshots taken every 10 ms of a 64-bit system: root.exe (PID 100) runs
+# throughout, its child childé.exe (PID 200) exits after the 15th snapshot.
+#
+# cmake -DONLOOKER=<path of Onlooker> -DSOURCE_DIR=<tests directory> -DWORK_DIR=<scratch directory> -P ReplayTest.cmake
+
+file(REMOVE_RECURSE "${WORK_DIR}")
+file(MAKE_DIRECTORY "${WORK_DIR}")
+
+# The output files are named after the local time of the capture
+set(ENV{TZ} "UTC0")
+set(ENV{ONLOOKER_CSV} "memory+private+cpu,M,>0")
+unset(ENV{ONLOOKER_COMPRESS})
+unset(ENV{ONLOOKER_FLIGHT_RECORDER})
+
+execute_process(
+    COMMAND "${ONLOOKER}" :replay "${SOURCE_DIR}/replay.olsnap" 100
+    WORKING_DIRECTORY "${WORK_DIR}"
+    RESULT_VARIABLE result
+)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "Replay failed: ${result}")
+endif()
+
+set(csv "${WORK_DIR}/Onlooker_2019-04-17_18-40-00_100.csv")
+if(NOT EXISTS "${csv}")
+    message(FATAL_ERROR "The replay did not write ${csv}")
+endif()
+execute_process(
+    COMMAND "${CMAKE_COMMAND}" -E compare_files --ignore-eol "${csv}" "${SOURCE_DIR}/replay.csv"
+    RESULT_VARIABLE result
+)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${csv} differs from ${SOURCE_DIR}/replay.csv")
+endif()